@@ -0,0 +1,501 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lisp.h"
+#include "lisp_read.h"
+#include "lisp_eval.h"
+#include "stream.h"
+#include "scan.h"
+#include "builtin.h"
+#include "hashtable.h"
+#include "kernel.h"
+#include "hamt.h"
+#include "compile.h"
+
+#define BENCH_RECORD "(RECORD 12345 \"some string literal\" (SYM-A SYM-B) 'Q)\n"
+
+static const char *isa_names[] = { "scalar", "sse2", "avx2" };
+static const char *kernel_names[] = { "scalar", "sse4.1", "avx2" };
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Build n bytes of token-dense input from repeated records. */
+static char *bench_input(size_t n) {
+    char *buf = calloc(n + 1, sizeof(char));
+    size_t rec = strlen(BENCH_RECORD);
+
+    if(buf == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for(size_t i = 0; i + rec <= n; i += rec)
+        memcpy(buf + i, BENCH_RECORD, rec);
+
+    return buf;
+}
+
+/** Split the input into tokens, the tokenizer's inner loop. */
+static void bench_scan(const char *buf, size_t len) {
+    for(scan_isa_t isa = SCAN_SCALAR; isa <= scan_best(); isa++) {
+        scan_select(isa);
+
+        double t = now();
+        size_t tokens = 0;
+
+        for(size_t i = 0; i < len; tokens++)
+            i += scan_first_of(buf + i, len - i, " \t\r\n()\"") + 1;
+
+        t = now() - t;
+
+        printf("scan   %-6s %8.1f MB/s (%zu tokens)\n", isa_names[isa],
+               len / t / 1e6, tokens);
+    }
+}
+
+/** Read every form of the input from a memory stream. */
+static void bench_read(const char *buf, size_t len) {
+    for(scan_isa_t isa = SCAN_SCALAR; isa <= scan_best(); isa++) {
+        scan_select(isa);
+
+        lisp_t *l = lisp_new();
+        object_t *stream = istream_mem(buf, len);
+        object_t *o = NULL;
+        size_t forms = 0;
+        double t = now();
+
+        while(lisp_read_next(l, stream, &o))
+            forms++;
+
+        t = now() - t;
+
+        stream_close(stream);
+
+        printf("read   %-6s %8.1f MB/s (%zu forms)\n", isa_names[isa],
+               len / t / 1e6, forms);
+    }
+
+    /* the same input hash-consed: every record shares one set of cells */
+    lisp_t *l = lisp_new();
+    object_t *stream = istream_mem(buf, len);
+    object_t *o = NULL;
+    size_t forms = 0;
+
+    l->hcons_read = 1;
+
+    double t = now();
+
+    while(lisp_read_next(l, stream, &o))
+        forms++;
+
+    t = now() - t;
+
+    stream_close(stream);
+
+    printf("read   hcons  %8.1f MB/s (%zu forms, %zu conses)\n",
+           len / t / 1e6, forms, l->hcons_count);
+}
+
+/** Look up symbols in an alist with ASSOC and in a hash table. */
+static void bench_hash(void) {
+    lisp_t *l = lisp_new();
+    size_t lookups = 20000;
+
+    for(size_t n = 10; n <= 100000; n *= 10) {
+        object_t **keys = calloc(n, sizeof(object_t *));
+        object_t *alist = NULL;
+        object_t *h = object_hashtable_new(HASHTABLE_EQ);
+
+        for(size_t i = 0; i < n; i++) {
+            char name[32];
+
+            snprintf(name, sizeof(name), "KEY-%zu", i);
+
+            keys[i] = object_symbol_new(name);
+            alist = cons(cons(keys[i], cons(object_integer_new(i), NULL)),
+                         alist);
+            hashtable_put(l, h, keys[i], object_integer_new(i));
+        }
+
+        double t = now();
+
+        for(size_t i = 0; i < lookups; i++)
+            assoc(l, keys[(i * 7919) % n], alist);
+
+        double t_assoc = now() - t;
+
+        t = now();
+
+        for(size_t i = 0; i < lookups; i++)
+            hashtable_get(l, h, keys[(i * 7919) % n], NULL);
+
+        double t_hash = now() - t;
+
+        printf("lookup %6zu entries: ASSOC %10.1f ns, GETHASH %6.1f ns\n", n,
+               t_assoc / lookups * 1e9, t_hash / lookups * 1e9);
+
+        free(keys);
+    }
+}
+
+/** Layer overrides on a config, as an alist and as a persistent map. */
+static void bench_map(void) {
+    lisp_t *l = lisp_new();
+    size_t n = 1000, layers = 100, lookups = 20000;
+    object_t **keys = calloc(n, sizeof(object_t *));
+    object_t *alist = NULL;
+    object_t *m = object_map_new(HASHTABLE_EQ, NULL, 0);
+
+    for(size_t i = 0; i < n; i++) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "KEY-%zu", i);
+
+        keys[i] = object_symbol_new(name);
+        alist = cons(cons(keys[i], cons(object_integer_new(i), NULL)), alist);
+        m = hamt_put(l, m, keys[i], object_integer_new(i));
+    }
+
+    double t = now();
+
+    for(size_t j = 0; j < layers; j++) {
+        for(size_t i = 0; i < 10; i++) {
+            object_t *k = keys[(j * 31 + i) % n];
+
+            alist = cons(cons(k, cons(object_integer_new(j), NULL)), alist);
+        }
+    }
+
+    double t_alist = now() - t;
+
+    t = now();
+
+    for(size_t j = 0; j < layers; j++) {
+        for(size_t i = 0; i < 10; i++)
+            m = hamt_put(l, m, keys[(j * 31 + i) % n], object_integer_new(j));
+    }
+
+    double t_map = now() - t;
+
+    printf("layer  %zu x 10: alist %6.1f ns, MAP-PUT %6.1f ns\n", layers,
+           t_alist / layers / 10 * 1e9, t_map / layers / 10 * 1e9);
+
+    t = now();
+
+    for(size_t i = 0; i < lookups; i++)
+        assoc(l, keys[(i * 7919) % n], alist);
+
+    t_alist = now() - t;
+
+    t = now();
+
+    for(size_t i = 0; i < lookups; i++)
+        hamt_get(l, m, keys[(i * 7919) % n], NULL);
+
+    t_map = now() - t;
+
+    printf("lookup %zu keys: ASSOC %10.1f ns, MAP-GET %6.1f ns\n", n,
+           t_alist / lookups * 1e9, t_map / lookups * 1e9);
+
+    free(keys);
+}
+
+/** Sum and dot product of n integers, as a cons list and as arrays. */
+static void bench_array(size_t n) {
+    object_t *list = NULL;
+    object_array_t *a = (object_array_t *) object_array_new(ARRAY_INT32, n);
+    int reps = 20;
+
+    for(size_t i = 0; i < n; i++) {
+        ((int32_t *) a->data)[i] = (int32_t) (i % 1000) - 500;
+        list = cons(object_integer_new(((int32_t *) a->data)[i]), list);
+    }
+
+    double t = now();
+    int64_t sum = 0;
+
+    for(int r = 0; r < reps; r++) {
+        for(object_t * o = list; o != NULL; o = cdr(o))
+            sum += ((object_integer_t *) car(o))->number;
+    }
+
+    t = now() - t;
+
+    printf("sum    cons   %8.1f M/s (%lld)\n", n * reps / t / 1e6,
+           (long long) sum / reps);
+
+    for(kernel_isa_t isa = KERNEL_SCALAR; isa <= kernel_best(); isa++) {
+        kernel_select(isa);
+
+        const kernel_ops_t *k = kernel_ops();
+
+        t = now();
+        sum = 0;
+
+        for(int r = 0; r < reps; r++)
+            sum += k->sum_i32(a->data, n);
+
+        double t_sum = now() - t;
+
+        t = now();
+
+        for(int r = 0; r < reps; r++)
+            sum += k->dot_i32(a->data, a->data, n);
+
+        double t_dot = now() - t;
+
+        printf("sum    %-6s %8.1f M/s, dot %8.1f M/s\n", kernel_names[isa],
+               n * reps / t_sum / 1e6, n * reps / t_dot / 1e6);
+    }
+}
+
+/** Read the last field of an 8 field record, as an alist and a struct. */
+static void bench_struct(void) {
+    lisp_t *l = lisp_new();
+    const char *setup[] = {
+        "(DEFSTRUCT REC A B C D E F G H)",
+        "(LABEL S (MAKE-REC 1 2 3 4 5 6 7 8))",
+        "(LABEL R '((A 1) (B 2) (C 3) (D 4) (E 5) (F 6) (G 7) (H 8)))",
+    };
+    const char *access[] = { "(CAR (CDR (ASSOC 'H R)))", "(REC-H S)" };
+    const char *names[] = { "ASSOC", "struct" };
+    size_t n = 200000;
+
+    for(size_t i = 0; i < 3; i++)
+        lisp_eval(l, lisp_read(l, setup[i], strlen(setup[i])));
+
+    for(size_t i = 0; i < 2; i++) {
+        object_t *form = lisp_read(l, access[i], strlen(access[i]));
+        double t = now();
+
+        for(size_t j = 0; j < n; j++)
+            lisp_eval(l, form);
+
+        t = now() - t;
+
+        printf("field  %-6s %8.1f ns\n", names[i], t / n * 1e9);
+    }
+}
+
+/** A function using a macro against the same function written out. */
+static void bench_macro(void) {
+    lisp_t *l = lisp_new();
+    const char *setup[] = {
+        "(LABEL TWICE (MACRO (X) (+ X X)))",
+        "(DEFUN F (N) (TWICE N))",
+        "(DEFUN G (N) (+ N N))",
+    };
+    const char *calls[] = { "(F 21)", "(G 21)" };
+    const char *names[] = { "macro", "plain" };
+    size_t n = 200000;
+
+    l->optimize = 0;            // or both calls are folded to 42
+
+    for(size_t i = 0; i < 3; i++)
+        lisp_eval(l, lisp_read(l, setup[i], strlen(setup[i])));
+
+    for(size_t i = 0; i < 2; i++) {
+        object_t *form = lisp_read(l, calls[i], strlen(calls[i]));
+        double t = now();
+
+        for(size_t j = 0; j < n; j++)
+            lisp_eval(l, form);
+
+        t = now() - t;
+
+        printf("call   %-6s %8.1f ns\n", names[i], t / n * 1e9);
+    }
+}
+
+/** A function made of calls to small accessors, with and without them
+ *  inlined. */
+static void bench_inline(void) {
+    const char *setup[] = {
+        "(DEFUN FIRST (X) (CAR X))",
+        "(DEFUN REST (X) (CDR X))",
+        "(DEFUN SECOND (X) (FIRST (REST X)))",
+        "(DEFUN THIRD (X) (SECOND (REST X)))",
+        "(DEFUN F (X) (CONS (FIRST X) (CONS (SECOND X) (THIRD X))))",
+    };
+    const char *call = "(F '(1 2 3))";
+    const char *names[] = { "called", "inline" };
+    size_t n = 20000;
+
+    for(int opt = 0; opt < 2; opt++) {
+        lisp_t *l = lisp_new();
+
+        l->optimize = opt;
+
+        for(size_t i = 0; i < 5; i++)
+            lisp_eval(l, lisp_read(l, setup[i], strlen(setup[i])));
+
+        object_t *form = lisp_read(l, call, strlen(call));
+        double t = now();
+
+        for(size_t j = 0; j < n; j++)
+            lisp_eval(l, form);
+
+        t = now() - t;
+
+        printf("access %-6s %8.1f ns\n", names[opt], t / n * 1e9);
+    }
+}
+
+/** Deep recursion: every call resolves globals like +, past the frames
+ *  of all calls below it if functions see their callers' variables. Past
+ *  a few thousand calls deep evaluation moves to stack segments. */
+static void bench_depth(size_t n) {
+    lisp_t *l = lisp_new();
+    const char *defun = "(DEFUN DEPTH (N) "
+        "(COND ((EQ N 0) 0) (T (+ 1 (DEPTH (- N 1))))))";
+    char call[64];
+
+    snprintf(call, sizeof(call), "(DEPTH %zu)", n);
+    lisp_eval(l, lisp_read(l, defun, strlen(defun)));
+
+    object_t *form = lisp_read(l, call, strlen(call));
+    double t = now();
+
+    lisp_eval(l, form);
+
+    t = now() - t;
+
+    printf("depth  %-6zu %8.1f ms\n", n, t * 1e3);
+}
+
+/** List shuffling in the interpreter, nothing but CAR CDR and CONS. */
+static void bench_prims(void) {
+    lisp_t *l = lisp_new();
+    const char *defun = "(DEFUN SWAP (X) "
+        "(CONS (CAR (CDR X)) (CONS (CAR X) (CDR (CDR X)))))";
+    const char *call = "(SWAP '(1 2 3))";
+    size_t n = 20000;
+
+    l->jit = 0;
+    lisp_eval(l, lisp_read(l, defun, strlen(defun)));
+
+    object_t *form = lisp_read(l, call, strlen(call));
+    double t = now();
+
+    for(size_t j = 0; j < n; j++)
+        lisp_eval(l, form);
+
+    t = now() - t;
+
+    printf("prims         %8.1f ns\n", t / n * 1e9);
+}
+
+/** Naive recursive FIB, dominated by calls to + - and <. */
+static void bench_fib(int jit) {
+    lisp_t *l = lisp_new();
+    const char *defun = "(DEFUN FIB (N) "
+        "(COND ((< N 2) N) (T (+ (FIB (- N 1)) (FIB (- N 2))))))";
+    const char *call = "(FIB 22)";
+
+    l->jit = jit;
+    lisp_eval(l, lisp_read(l, defun, strlen(defun)));
+
+    object_t *form = lisp_read(l, call, strlen(call));
+    double t = now();
+    object_t *r = lisp_eval(l, form);
+
+    t = now() - t;
+
+    printf("fib    22     %8.1f ms %s(%lld)\n", t * 1e3, jit ? "jit " : "",
+           (long long) ((object_integer_t *) r)->number);
+}
+
+/** The same FIB compiled with COMPILE-FILE, and a loop whose arithmetic
+ *  has intermediate results that stay unboxed. */
+static void bench_compiled(void) {
+    lisp_t *l = lisp_new();
+    const char *path = "/tmp/lips_bench.lips";
+    char so[64];
+    const char *call = "(FIB 22)";
+
+    FILE *f = fopen(path, "w");
+
+    if(f == NULL) {
+        perror("fopen");
+        return;
+    }
+
+    fputs("(DEFUN FIB (N) "
+          "(COND ((< N 2) N) (T (+ (FIB (- N 1)) (FIB (- N 2))))))\n"
+          "(DEFUN POLY (N ACC) (COND ((EQ N 0) ACC) "
+          "(T (POLY (- N 1) (+ ACC (- (* (* N N) 3) (* N 2)))))))\n", f);
+    fclose(f);
+
+    double t = now();
+    object_t *names = compile_file(l, path);
+
+    t = now() - t;
+
+    if(!object_isa(names, OBJECT_CONS)) {
+        printf("compiled fib  (compile-file failed)\n");
+        remove(path);
+        return;
+    }
+
+    object_t *form = lisp_read(l, call, strlen(call));
+    double c = now();
+    object_t *r = lisp_eval(l, form);
+
+    c = now() - c;
+
+    printf("fib    22     %8.1f ms compiled (%lld), build %.0f ms\n",
+           c * 1e3, (long long) ((object_integer_t *) r)->number, t * 1e3);
+
+    call = "(POLY 20000 0)";
+    form = lisp_read(l, call, strlen(call));
+    c = now();
+    r = lisp_eval(l, form);
+    c = now() - c;
+
+    printf("poly   20000  %8.1f ms compiled (%lld)\n", c * 1e3,
+           (long long) ((object_integer_t *) r)->number);
+
+    remove(path);
+    strcpy(so, path);
+    strcpy(strrchr(so, '.'), ".c");
+    remove(so);
+    strcpy(strrchr(so, '.'), ".so");
+    remove(so);
+}
+
+int main(int argc, char **argv) {
+    size_t mb = argc > 1 ? (size_t) atoi(argv[1]) : 16;
+    size_t len = mb * 1024 * 1024;
+    char *buf = bench_input(len);
+
+    len = strlen(buf);
+
+    bench_scan(buf, len);
+    bench_read(buf, len);
+    bench_hash();
+    bench_map();
+    bench_array(len / 16);
+    bench_struct();
+    bench_macro();
+    bench_inline();
+    bench_depth(400);
+    bench_depth(100000);
+    bench_prims();
+    bench_fib(0);
+    bench_fib(1);
+    bench_compiled();
+
+    free(buf);
+
+    return EXIT_SUCCESS;
+}
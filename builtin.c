@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 
@@ -6,6 +7,8 @@
 #include "logger.h"
 #include "lisp_eval.h"
 #include "stream.h"
+#include "scan.h"
+#include "hashtable.h"
 
 // Return true if OBJECT is anything other than a CONS
 object_t *atom(lisp_t * l, object_t * object) {
@@ -65,20 +68,27 @@ object_t *eq(lisp_t * l, object_t * a, object_t * b) {
 
     switch (a->type) {
     case OBJECT_CONS:
+    case OBJECT_VECTOR:
+    case OBJECT_HASHTABLE:
+    case OBJECT_ARRAY:
+    case OBJECT_MAP:
+    case OBJECT_STRUCT:
+    case OBJECT_LAZY:
+    case OBJECT_TRANSDUCER:
         return NULL;
     case OBJECT_INTEGER:
         if(((object_integer_t *) a)->number ==
-           ((object_integer_t *) a)->number) {
+           ((object_integer_t *) b)->number) {
 
             return l->t;
         }
 
         return NULL;
     case OBJECT_STRING:
-        if(0 ==
-           strncmp(((object_string_t *) a)->string,
-                   ((object_string_t *) a)->string,
-                   ((object_string_t *) a)->len)) {
+        if((((object_string_t *) a)->len == ((object_string_t *) b)->len)
+           && (0 == strncmp(((object_string_t *) a)->string,
+                            ((object_string_t *) b)->string,
+                            ((object_string_t *) a)->len))) {
 
             return l->t;
         }
@@ -103,6 +113,28 @@ object_t *eq(lisp_t * l, object_t * a, object_t * b) {
     return NULL;
 }
 
+/** Compare conses by structure, everything else with eq(). */
+object_t *equal(lisp_t * l, object_t * a, object_t * b) {
+    while(object_isa(a, OBJECT_CONS) && object_isa(b, OBJECT_CONS)) {
+        if(a == b)
+            return l->t;
+
+        if(!equal(l, car(a), car(b)))
+            return NULL;
+
+        a = cdr(a);
+        b = cdr(b);
+    }
+
+    return eq(l, a, b);
+}
+
+/* Lists are only worth indexing when they are long and searched often. */
+#define ASSOC_INDEX_MIN 16
+#define ASSOC_INDEX_HITS 8
+
+static object_t *assoc_slow(lisp_t *, object_t *, object_t *, object_t *);
+
 /** Associate symbol x with value in plist y.
  *
  * Lisp definition:
@@ -115,21 +147,119 @@ object_t *eq(lisp_t * l, object_t * a, object_t * b) {
  *
  *   (assoc 'b '((a 1) (b 2) (c 3)))
  *   (B 2)
+ *
+ * The first ASSOC_INDEX_MIN pairs are always searched directly. Past them,
+ * the list is looked up in a small cache by the identity of its head; once
+ * a list has been searched that far ASSOC_INDEX_HITS times, it gets a hash
+ * index mapping each key to the first pair with it, and later lookups cost
+ * O(1). An index is dropped when the head cell is modified or something is
+ * appended, and carried over when a pair is consed onto the front.
  */
 object_t *assoc(lisp_t * l, object_t * x, object_t * o) {
-    if(o == NULL)
-        return NULL;
+    object_t *head = o;
 
-    if(o->type != OBJECT_CONS)
-        PANIC("assoc: expected list");
+    for(size_t n = 0; o != NULL; o = cdr(o), n++) {
+        if(o->type != OBJECT_CONS)
+            PANIC("assoc: expected list");
 
-    if(atom(l, o))
-        return NULL;
+        if(n == ASSOC_INDEX_MIN)
+            return assoc_slow(l, x, head, o);
+
+        if(eq(l, x, car(car(o))))
+            return car(o);
+    }
+
+    return NULL;
+}
+
+static assoc_cache_t *assoc_cache(lisp_t * l, object_t * head) {
+    return &l->assoc_cache[hash_eq(head) & (ASSOC_CACHE_SZ - 1)];
+}
+
+static int assoc_cache_valid(assoc_cache_t * c, object_t * head) {
+    return (c->head == head) && (c->car == car(head))
+        && (c->cdr == cdr(head))
+        && ((c->tail == NULL) || (cdr(c->tail) == NULL));
+}
+
+static void assoc_cache_reset(assoc_cache_t * c, object_t * head) {
+    if(c->index != NULL) {
+        free(((object_hashtable_t *) c->index)->entries);
+        free(c->index);
+    }
+
+    c->head = head;
+    c->car = car(head);
+    c->cdr = cdr(head);
+    c->tail = NULL;
+    c->hits = 0;
+    c->index = NULL;
+}
+
+/** Index every pair of the list, the first one wins for repeated keys. */
+static void assoc_cache_index(lisp_t * l, assoc_cache_t * c) {
+    object_t *index = object_hashtable_new(HASHTABLE_EQ);
+    object_t *o = c->head;
 
-    if(eq(l, x, car(car(o))))
-        return car(o);
+    for(; o != NULL; o = cdr(o)) {
+        int found;
 
-    return assoc(l, x, cdr(o));
+        if(o->type != OBJECT_CONS)
+            PANIC("assoc: expected list");
+
+        hashtable_get(l, index, car(car(o)), &found);
+
+        if(!found)
+            hashtable_put(l, index, car(car(o)), car(o));
+
+        c->tail = o;
+    }
+
+    c->index = index;
+}
+
+/** Continue searching a long list at o, using or building its index. */
+static object_t *assoc_slow(lisp_t * l, object_t * x, object_t * head,
+                            object_t * o) {
+    assoc_cache_t *c = assoc_cache(l, head);
+
+    if(!assoc_cache_valid(c, head)) {
+        assoc_cache_t *next = assoc_cache(l, cdr(head));
+
+        if((c != next) && (next->index != NULL)
+           && assoc_cache_valid(next, cdr(head))) {
+
+            /* one pair consed onto an indexed list: take the index over */
+            assoc_cache_reset(c, head);
+
+            c->tail = next->tail;
+            c->index = next->index;
+            next->index = NULL;
+
+            assoc_cache_reset(next, NULL);
+
+            hashtable_put(l, c->index, car(car(head)), car(head));
+        }
+        else {
+            assoc_cache_reset(c, head);
+        }
+    }
+
+    if((c->index == NULL) && (++c->hits >= ASSOC_INDEX_HITS))
+        assoc_cache_index(l, c);
+
+    if(c->index != NULL)
+        return hashtable_get(l, c->index, x, NULL);
+
+    for(; o != NULL; o = cdr(o)) {
+        if(o->type != OBJECT_CONS)
+            PANIC("assoc: expected list");
+
+        if(eq(l, x, car(car(o))))
+            return car(o);
+    }
+
+    return NULL;
 }
 
 /** Construct plist from list of keys x and list of values y.
@@ -155,33 +285,99 @@ object_t *pair(lisp_t * l, object_t * k, object_t * v) {
     if((k->type != OBJECT_CONS) || (k->type != OBJECT_CONS))
         PANIC("pair: expected cons'");
 
-    if(atom(l, k) || atom(l, v))
-        return NULL;
+    object_t *list = NULL, *tail = NULL;
+
+    /* a NIL name ends the list, unless it comes first */
+    for(; !atom(l, k) && !atom(l, v); k = cdr(k), v = cdr(v)) {
+        object_t *head = NULL;
+
+        if(car(k) != NULL)
+            head = cons(car(k), cons(car(v), NULL));
+        else if(list != NULL)
+            break;
+
+        object_t *o = cons(head, NULL);
 
-    // TODO - make list(object_t *...) helper
-    object_t *head = cons(car(k), cons(car(v), NULL));
-    object_t *tail = pair(l, cdr(k), cdr(v));
+        if(list == NULL)
+            list = o;
+        else
+            ((object_cons_t *) tail)->cdr = o;
 
-    if(car(head) == NULL)
-        head = NULL;
+        tail = o;
 
-    if(car(tail) == NULL)
-        tail = NULL;
+        if((cdr(k) != NULL) && (cdr(v) != NULL)
+           && (cdr(k)->type != OBJECT_CONS))
+            PANIC("pair: expected cons'");
+    }
 
-    return cons(head, tail);
+    return list;
+}
+
+static int special_form(object_t * op, const char *name) {
+    return object_isa(op, OBJECT_SYMBOL)
+        && !strcmp(((object_symbol_t *) op)->name, name);
+}
+
+/* Is sym a free variable of x, the body of a lambda taking params? */
+static int free_in(lisp_t * l, object_t * sym, object_t * params,
+                   object_t * x) {
+    if(object_isa(x, OBJECT_SYMBOL)) {
+        if(!eq(l, x, sym))
+            return 0;
+
+        for(object_t * p = params; object_isa(p, OBJECT_CONS); p = cdr(p)) {
+            if(eq(l, car(p), x))
+                return 0;
+        }
+
+        return 1;
+    }
+
+    if(!object_isa(x, OBJECT_CONS) || special_form(car(x), "QUOTE"))
+        return 0;
+
+    for(; object_isa(x, OBJECT_CONS); x = cdr(x)) {
+        if(free_in(l, sym, params, car(x)))
+            return 1;
+    }
+
+    return 0;
 }
 
 object_t *label(lisp_t * l, object_t * sym, object_t * obj) {
     if(l->env == NULL)
         PANIC("no environment!");
 
-    if(lisp_env_resolv(l, l->env, sym))
+    object_t *old = lisp_env_resolv(l, l->env, sym);
+
+    if(old)
         WARN("label: redefining label!");
 
+    /* expansions made with a macro this binding replaces are stale now */
+    if(object_isa(obj, OBJECT_MACRO)
+       || object_isa(car(cdr(old)), OBJECT_MACRO))
+        hashtable_clear(l->macro_cache);
+
+    /* compiled lambdas may rely on the old binding, see jit_run() */
+    if(object_isa(obj, OBJECT_MACRO)
+       || object_isa(car(cdr(old)), OBJECT_FUNCTION))
+        l->prim_epoch++;
+
     object_t *kv = cons(sym, cons(obj, NULL));
 
     l->env->labels = cons(kv, l->env->labels);
 
+    /* the lambdas made in this frame before see the binding too, so local
+     * functions can call themselves and each other, see closure() */
+    for(object_t * c = l->env->closures; c != NULL; c = cdr(c)) {
+        object_lambda_t *f = (object_lambda_t *) car(c);
+
+        if(free_in(l, sym, f->args, f->expr)) {
+            f->closed = cons(kv, f->closed);
+            f->jit = NULL;      // compiled without it, see jit_run()
+        }
+    }
+
     return obj;
 }
 
@@ -190,11 +386,203 @@ object_t *lambda(object_t * args, object_t * expr) {
     return (object_t *) object_lambda_new(args, expr);
 }
 
+/* Add the bindings of the free variables of x that are made by frames
+ * other than the global one to closed. */
+static object_t *capture(lisp_t * l, object_t * params, object_t * x,
+                         object_t * closed) {
+    if(object_isa(x, OBJECT_SYMBOL)) {
+        for(object_t * p = params; object_isa(p, OBJECT_CONS); p = cdr(p)) {
+            if(eq(l, car(p), x))
+                return closed;
+        }
+
+        if(assoc(l, x, closed))
+            return closed;
+
+        for(lisp_env_t * e = l->env; e != l->global; e = e->outer) {
+            object_t *kv = assoc(l, x, e->labels);
+
+            if(kv != NULL)
+                return cons(kv, closed);
+        }
+
+        return closed;
+    }
+
+    if(!object_isa(x, OBJECT_CONS) || special_form(car(x), "QUOTE"))
+        return closed;
+
+    for(; object_isa(x, OBJECT_CONS); x = cdr(x))
+        closed = capture(l, params, car(x), closed);
+
+    return closed;
+}
+
+/** Construct a lambda that closes over the environment it is made in.
+ *
+ *  Flat closure conversion: the bindings its body uses from the frames of
+ *  the functions it is made in are collected once, into a single frame
+ *  that lisp_apply() puts next to the parameters. Variables are captured
+ *  with the value they have now; globals are still looked up at the call.
+ *  The lambda is remembered in its frame, for label() to add what is
+ *  LABELled there later.
+ */
+object_t *closure(lisp_t * l, object_t * args, object_t * expr) {
+    object_lambda_t *f = (object_lambda_t *) lambda(args, expr);
+
+    if(l->env != l->global) {
+        f->closed = capture(l, args, expr, NULL);
+        l->env->closures = cons((object_t *) f, l->env->closures);
+    }
+
+    return (object_t *) f;
+}
+
 /** Construct a macro object from an s-expression. */
 object_t *macro(object_t * args, object_t * expr) {
     return (object_t *) object_macro_new(args, expr);
 }
 
+/** Construct a vector holding the elements of list. */
+object_t *vector(object_t * list) {
+    size_t len = 0;
+
+    for(object_t * o = list; o != NULL; o = cdr(o))
+        len++;
+
+    object_t *v = object_vector_new(len, NULL);
+
+    for(size_t i = 0; i < len; i++, list = cdr(list))
+        ((object_vector_t *) v)->items[i] = car(list);
+
+    return v;
+}
+
+static object_t *struct_symbol(const char *prefix, object_t * name,
+                               const char *suffix) {
+    const char *n = ((object_symbol_t *) name)->name;
+    size_t len = strlen(prefix) + strlen(n) + strlen(suffix) + 1;
+    char s[len];
+
+    snprintf(s, len, "%s%s%s", prefix, n, suffix);
+
+    return object_symbol_new(s);
+}
+
+static object_struct_t *struct_arg(object_function_t * f, size_t argc,
+                                   object_t ** argv, size_t n) {
+    if(argc < n)
+        PANIC("struct: expected %zu arguments", n);
+
+    if(!object_isa(argv[0], OBJECT_STRUCT)
+       || (((object_struct_t *) argv[0])->type != f->data))
+        PANIC("struct: not a %s!",
+              ((object_symbol_t *) ((struct_type_t *) f->data)->name)->name);
+
+    return (object_struct_t *) argv[0];
+}
+
+static object_t *struct_make(lisp_t * l, object_function_t * f, size_t argc,
+                             object_t ** argv) {
+    struct_type_t *t = f->data;
+
+    if(argc > t->len)
+        return lisp_error(l, object_symbol_new("TOO-MANY-ARGUMENTS"));
+
+    object_struct_t *o = (object_struct_t *) object_struct_new(t);
+
+    memcpy(o->slots, argv, argc * sizeof(object_t *));
+
+    return (object_t *) o;
+}
+
+static object_t *struct_ref(lisp_t * l __attribute__ ((unused)),
+                            object_function_t * f, size_t argc,
+                            object_t ** argv) {
+    return struct_arg(f, argc, argv, 1)->slots[f->index];
+}
+
+static object_t *struct_set(lisp_t * l __attribute__ ((unused)),
+                            object_function_t * f, size_t argc,
+                            object_t ** argv) {
+    return struct_arg(f, argc, argv, 2)->slots[f->index] = argv[1];
+}
+
+static object_t *struct_p(lisp_t * l, object_function_t * f, size_t argc,
+                          object_t ** argv) {
+    if((argc > 0) && object_isa(argv[0], OBJECT_STRUCT)
+       && (((object_struct_t *) argv[0])->type == f->data))
+        return l->t;
+
+    return NULL;
+}
+
+/** Define a struct type, (DEFSTRUCT NAME SLOT...).
+ *
+ *  Labels MAKE-NAME, taking the slot values in order, the predicate
+ *  NAME-P and for every slot NAME-SLOT and SET-NAME-SLOT. The functions
+ *  carry their type and slot index, so an access is a type check and a
+ *  load from a fixed offset.
+ */
+static object_t *struct_function(void *sptr, struct_type_t * t, size_t i,
+                                 function_purity_t pure) {
+    object_t *f = object_sfunction_new(sptr, t, i);
+
+    ((object_function_t *) f)->pure = pure;
+
+    return f;
+}
+
+object_t *defstruct(lisp_t * l, object_t * name, object_t * slots) {
+    if(!object_isa(name, OBJECT_SYMBOL))
+        PANIC("defstruct: name is not a symbol!");
+
+    struct_type_t *t = calloc(1, sizeof(struct_type_t));
+
+    if(t == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for(object_t * o = slots; o != NULL; o = cdr(o))
+        t->len++;
+
+    t->name = name;
+    t->slots = calloc(t->len ? t->len : 1, sizeof(object_t *));
+
+    if(t->slots == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    label(l, struct_symbol("MAKE-", name, ""),
+          struct_function(struct_make, t, 0, FUNCTION_EFFECT_FREE));
+    label(l, struct_symbol("", name, "-P"),
+          struct_function(struct_p, t, 0, FUNCTION_PURE));
+
+    for(size_t i = 0; i < t->len; i++, slots = cdr(slots)) {
+        object_t *slot = car(slots);
+
+        if(!object_isa(slot, OBJECT_SYMBOL))
+            PANIC("defstruct: slot name is not a symbol!");
+
+        t->slots[i] = slot;
+
+        const char *sn = ((object_symbol_t *) slot)->name;
+        size_t len = strlen(sn) + 2;
+        char suffix[len];
+
+        snprintf(suffix, len, "-%s", sn);
+
+        label(l, struct_symbol("", name, suffix),
+              struct_function(struct_ref, t, i, FUNCTION_EFFECT_FREE));
+        label(l, struct_symbol("SET-", name, suffix),
+              object_sfunction_new(struct_set, t, i));
+    }
+
+    return name;
+}
+
 /** Read s-expression from stream.
  *
  *  read()'s algorithm is based on that described in
@@ -240,7 +628,8 @@ object_t *read(lisp_t * l, object_t * stream) {
             x, 0, 0
         };
 
-        if(!eq(l, car(car(rt)), object_symbol_new(x_str)))
+        /* compared by name, so dispatching allocates nothing */
+        if(strcmp(((object_symbol_t *) car(car(rt)))->name, x_str))
             continue;
 
         object_t *(*mreader) (lisp_t *, char, object_t *) =
@@ -272,18 +661,26 @@ object_t *read(lisp_t * l, object_t * stream) {
      */
 
     // TODO
-    static size_t token_sz = 256;
     size_t token_idx = 0;
-    char token[token_sz];
-
-    memset(token, 0, token_sz);
+    char *token = lisp_scratch(l, 256);
 
     token[token_idx++] = x;
 
-    while(!stream_eof(stream)) {
-        if(token_idx > token_sz)
-            PANIC("token overflow");
+    size_t avail;
+    const char *buf = stream_peek(stream, &avail);
+
+    if(buf != NULL) {           // memory stream, find the token's end in bulk
+        size_t n = scan_first_of(buf, avail, " )\n");
+
+        token = lisp_scratch(l, token_idx + n + 1);
+
+        memcpy(token + token_idx, buf, n);
+        token_idx += n;
 
+        stream_skip(stream, n);
+    }
+
+    while((buf == NULL) && !stream_eof(stream)) {
         x = stream_read_char(stream);
 
         if((x == ' ') || (x == ')') || (x == '\n')) {   // teminating characters
@@ -291,9 +688,12 @@ object_t *read(lisp_t * l, object_t * stream) {
             break;
         }
 
+        token = lisp_scratch(l, token_idx + 2);
         token[token_idx++] = x;
     };
 
+    token[token_idx] = 0;
+
     /* 8. At this point a token is being accumulated, and an even number of
      * multiple escape characters have been encountered.
      */
@@ -313,19 +713,29 @@ object_t *read(lisp_t * l, object_t * stream) {
         return NULL;
     }
 
+    return read_token(token, token_idx);
+}
+
+/** Interpret an accumulated token as an integer or a symbol.
+ *
+ *  token must be NUL-terminated at token[len].
+ */
+object_t *read_token(char *token, size_t len) {
+    size_t i = (len > 1) && ((token[0] == '-') || (token[0] == '+'));
+
     // create number object, if possible
-    for(size_t i = 0; (token_idx > i) && isdigit(token[i]); i++) {
-        if(i == token_idx - 1)
-            return object_integer_new(atoi(token));
+    for(; (len > i) && isdigit(token[i]); i++) {
+        if(i == len - 1)
+            return object_integer_new(strtoll(token, NULL, 10));
     }
 
     return (object_t *) object_symbol_new(token);
 }
 
-/** Expand macros in object_t
+/** Expand form as long as it is a macro call.
  *
- * TODO:
- *  * should macro expansion really happen before the reader returns?
+ *  labels lists the names bound around form as (NAME) pairs; they shadow
+ *  macros of the same name. Returns (FORM EXPANDED-P).
  */
 object_t *macroexpand(lisp_t * l, object_t * labels, object_t * form) {
     int expanded = 0;
@@ -393,6 +803,10 @@ object_t *macroexpand_1(lisp_t * l, object_t * labels, object_t * form) {
     if(form == NULL || atom(l, form) || car(form) == NULL)
         return cons(form, cons(expanded ? l->t : NULL, NULL));
 
+    // a local binding hides any macro of the same name
+    if(object_isa(car(form), OBJECT_SYMBOL) && assoc(l, car(form), labels))
+        return cons(form, cons(expanded ? l->t : NULL, NULL));
+
     // do we have a macro form?
     object_t *mpair = lisp_env_resolv(l, l->env, car(form));
     object_t *m = car(cdr(mpair));
@@ -400,9 +814,194 @@ object_t *macroexpand_1(lisp_t * l, object_t * labels, object_t * form) {
     if((mpair == NULL) || (m == NULL) || (m->type != OBJECT_MACRO))
         return cons(form, cons(expanded ? l->t : NULL, NULL));
 
-    // associate the arguments - TODO - old labels are ignored!
-    labels = pair(l, ((object_macro_t *) m)->args, cdr(form));
+    return cons(macro_apply(l, m, cdr(form)), cons(l->t, NULL));
+}
+
+/* Forms nest without recursing, as in mread_nested(): each list whose
+ * elements are being expanded has a frame on a stack of its own, so how
+ * deep code may nest is not bounded by the C stack. */
+
+typedef enum {
+    EXPAND_CALL,                // the list is the form itself
+    EXPAND_BODY,                // the list follows the second element
+    EXPAND_COND,                // the list holds the clauses
+    EXPAND_CLAUSE,              // the list is a clause
+} expand_kind_t;
+
+typedef struct {
+    expand_kind_t kind;
+    object_t *form;             // the form the list belongs to
+    object_t *labels;           // the names bound there
+    object_t *list;
+    object_t *cell;             // holds the element being expanded
+    object_t *from;             // the first cell not copied yet
+    object_t *head;             // the copy, up to the last changed element
+    object_t *tail;
+} expand_frame_t;
+
+typedef struct {
+    expand_frame_t *frame;
+    size_t top;
+    size_t sz;
+} expand_stack_t;
+
+static void expand_push(expand_stack_t * s, expand_kind_t kind,
+                        object_t * labels, object_t * form, object_t * list) {
+    if(s->top == s->sz) {
+        s->sz = s->sz ? 2 * s->sz : 16;
+
+        if((s->frame =
+            realloc(s->frame, s->sz * sizeof(expand_frame_t))) == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    expand_frame_t *f = &s->frame[s->top++];
+
+    f->kind = kind;
+    f->labels = labels;
+    f->form = form;
+    f->list = f->cell = f->from = list;
+    f->head = f->tail = NULL;
+}
+
+/* Start on form: returns 1 with its expansion in *o if no code is left in
+ * it, otherwise pushes the frame for the list of code it holds. */
+static int expand_open(lisp_t * l, expand_stack_t * s, object_t * labels,
+                       object_t * form, object_t ** o) {
+    form = car(macroexpand(l, labels, form));
+    *o = form;
+
+    if(atom(l, form))
+        return 1;
+
+    object_t *op = car(form);
+
+    if(special_form(op, "QUOTE") || special_form(op, "MACRO")
+       || special_form(op, "DEFSTRUCT") || special_form(op, "INLINE"))
+        return 1;
+
+    if(special_form(op, "LAMBDA")) {
+        object_t *inner = labels;
+
+        for(object_t * a = car(cdr(form)); object_isa(a, OBJECT_CONS);
+            a = cdr(a))
+            inner = cons(cons(car(a), NULL), inner);
+
+        expand_push(s, EXPAND_BODY, inner, form, cdr(cdr(form)));
+    }
+    else if(special_form(op, "LABEL"))
+        expand_push(s, EXPAND_BODY, labels, form, cdr(cdr(form)));
+    else if(special_form(op, "COND"))
+        expand_push(s, EXPAND_COND, labels, form, cdr(form));
+    else {
+        /* calls, and special forms taking plain expressions */
+        expand_push(s, EXPAND_CALL, labels, form, form);
+    }
+
+    return 0;
+}
+
+/* Take a, the expansion of the element in f->cell, and move on. */
+static void expand_take(expand_frame_t * f, object_t * a) {
+    object_t *c = f->cell;
+
+    /* copy the cells up to this one, the rest is shared until the next
+     * element changes */
+    if(a != car(c)) {
+        for(; f->from != cdr(c); f->from = cdr(f->from)) {
+            object_t *x = cons(f->from == c ? a : car(f->from), NULL);
+
+            if(f->head == NULL)
+                f->head = x;
+            else
+                ((object_cons_t *) f->tail)->cdr = x;
+
+            f->tail = x;
+        }
+    }
+
+    f->cell = cdr(c);
+}
+
+/* The expansion of the form whose list f has walked. */
+static object_t *expand_close(expand_frame_t * f) {
+    object_t *x = f->list;
+
+    if(f->head != NULL) {
+        ((object_cons_t *) f->tail)->cdr = f->from;
+        x = f->head;
+    }
+
+    switch (f->kind) {
+    case EXPAND_BODY:
+        if(x == f->list)
+            return f->form;
+
+        return cons(car(f->form), cons(car(cdr(f->form)), x));
+    case EXPAND_COND:
+        return x == f->list ? f->form : cons(car(f->form), x);
+    default:
+        return x;
+    }
+}
+
+/** Expand every macro call in form, at any depth.
+ *
+ *  The walk knows the special forms: quoted data, macro bodies and struct
+ *  definitions are left alone, only the value of a LABEL and the tests and
+ *  expressions of COND clauses are code, and the parameters of a LAMBDA
+ *  shadow macros in its body. Parts without macro calls are shared with
+ *  form, so a form without any is returned as it is.
+ */
+object_t *macroexpand_all(lisp_t * l, object_t * labels, object_t * form) {
+    expand_stack_t s = { NULL, 0, 0 };
+    object_t *o;
+    int done = expand_open(l, &s, labels, form, &o);
+
+    while(s.top > 0) {
+        expand_frame_t *f = &s.frame[s.top - 1];
+
+        if(done) {
+            expand_take(f, o);
+            done = 0;
+        }
+
+        if(object_isa(f->cell, OBJECT_CONS)) {
+            if(f->kind == EXPAND_COND)
+                expand_push(&s, EXPAND_CLAUSE, f->labels, NULL, car(f->cell));
+            else
+                done = expand_open(l, &s, f->labels, car(f->cell), &o);
+
+            continue;
+        }
+
+        o = expand_close(f);
+        s.top--;
+        done = 1;
+    }
+
+    free(s.frame);
+
+    return o;
+}
+
+/** Expand a call of macro m: its body with the argument forms substituted
+ *  for the parameters. */
+object_t *macro_apply(lisp_t * l, object_t * m, object_t * args) {
+    if(!object_isa(m, OBJECT_MACRO))
+        PANIC("macro_apply: not a macro!");
+
+    object_t *labels = pair(l, ((object_macro_t *) m)->args, args);
+    object_t *expr = ((object_macro_t *) m)->expr;
+
+    if(atom(l, expr)) {
+        object_t *kv = expr ? assoc(l, expr, labels) : NULL;
+
+        return kv ? car(cdr(kv)) : expr;
+    }
 
-    return macroexpand_hook(l, labels, ((object_macro_t *) m)->expr,
-                            (void *(*)()) macroexpand_hook);
+    return car(macroexpand_hook(l, labels, expr,
+                                (void *(*)()) macroexpand_hook));
 }
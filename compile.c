@@ -0,0 +1,811 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "compile.h"
+#include "lisp_read.h"
+#include "lisp_eval.h"
+#include "builtin.h"
+#include "logger.h"
+#include "stream.h"
+
+/* Ahead-of-time compilation of the functions a file defines into C.
+ *
+ * compile_file() loads the file like the interpreter would, then turns
+ * each top-level (LABEL NAME (LAMBDA ...)) whose body it can translate into
+ * a C function using the vector convention, see evfun(). The C goes into
+ * a file next to the source, which is built into a shared object with the
+ * system compiler and loaded, a new one each time; every name is then
+ * bound to its compiled function. Everything else keeps running in the
+ * interpreter, and compiled and interpreted code call each other through
+ * the usual bindings.
+ *
+ * Generated code includes compiled.h, so it is built against the headers
+ * of this tree, found at LIPS_INCLUDE_DIR or in $LIPS_INCLUDE. Constants
+ * and symbols are not written into the C: they stay objects of this
+ * process, handed over in one table when the shared object is loaded.
+ *
+ * What the generated code assumes:
+ *  - ATOM, EQ, CAR, CDR, CONS and two-argument arithmetic and comparisons
+ *    are the builtins, these are open-coded,
+ *  - calls between the functions compiled together are direct C calls,
+ *    so redefining one of them later only affects interpreted callers;
+ *    each still counts as a nested evaluation, see COMPILED_FUNCTION(),
+ *  - every other call and global variable is looked up when it runs.
+ */
+
+extern char **environ;
+
+#ifndef LIPS_INCLUDE_DIR
+#define LIPS_INCLUDE_DIR "."
+#endif
+
+typedef object_t *(*compiled_fn_t) (lisp_t *, size_t, object_t **);
+
+typedef struct {
+    lisp_t *l;
+    FILE *out;
+    object_t *defs;             // ((NAME lambda) ...), in order
+    object_t **k;               // constants and symbols used, see K[]
+    size_t nk;
+    size_t k_sz;
+    size_t tmp;                 // temporaries named so far
+} compiler_t;
+
+static void compile_expr(compiler_t *, object_t *, object_t *);
+
+static int compile_symbol_is(object_t * o, const char *name) {
+    return object_isa(o, OBJECT_SYMBOL)
+        && !strcmp(((object_symbol_t *) o)->name, name);
+}
+
+/* Index of x in the constant table, added if it is new. */
+static size_t compile_constant(compiler_t * c, object_t * x) {
+    for(size_t i = 0; i < c->nk; i++) {
+        if((c->k[i] == x) || (object_isa(x, OBJECT_SYMBOL)
+                              && eq(c->l, c->k[i], x)))
+            return i;
+    }
+
+    if(c->nk == c->k_sz) {
+        c->k_sz = c->k_sz ? c->k_sz * 2 : 16;
+        c->k = realloc(c->k, c->k_sz * sizeof(object_t *));
+
+        if(c->k == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    c->k[c->nk] = x;
+
+    return c->nk++;
+}
+
+/* Position of x in a list of symbols, -1 if it is not there. */
+static long compile_position(compiler_t * c, object_t * list, object_t * x) {
+    for(long i = 0; list != NULL; list = cdr(list), i++) {
+        if(eq(c->l, car(list), x))
+            return i;
+    }
+
+    return -1;
+}
+
+static long compile_def(compiler_t * c, object_t * name, object_t ** fn) {
+    long i = 0;
+
+    for(object_t * d = c->defs; d != NULL; d = cdr(d), i++) {
+        if(eq(c->l, car(car(d)), name)) {
+            *fn = car(cdr(car(d)));
+
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static size_t compile_length(object_t * list) {
+    size_t n = 0;
+
+    for(; object_isa(list, OBJECT_CONS); list = cdr(list))
+        n++;
+
+    return n;
+}
+
+/* Can the body x be translated? Quoted data aside, it must not make
+ * lambdas, bind names or evaluate code, the interpreter does that. */
+static int compilable(object_t * x) {
+    if(!object_isa(x, OBJECT_CONS))
+        return 1;
+
+    object_t *op = car(x);
+
+    if(compile_symbol_is(op, "QUOTE"))
+        return 1;
+
+    if(compile_symbol_is(op, "INLINE"))
+        return compilable(car(cdr(cdr(x))));
+
+    /* EVAL sees the variables of the frame it is called in, and compiled
+     * functions bind none */
+    if(compile_symbol_is(op, "LAMBDA") || compile_symbol_is(op, "LABEL")
+       || compile_symbol_is(op, "MACRO") || compile_symbol_is(op, "LOOP")
+       || compile_symbol_is(op, "READ") || compile_symbol_is(op, "DEFSTRUCT")
+       || compile_symbol_is(op, "EVAL"))
+        return 0;
+
+    if(compile_symbol_is(op, "COND")) {
+        for(object_t * cl = cdr(x); cl != NULL; cl = cdr(cl)) {
+            for(object_t * e = car(cl); e != NULL; e = cdr(e)) {
+                if(!compilable(car(e)))
+                    return 0;
+            }
+        }
+
+        return 1;
+    }
+
+    for(; x != NULL; x = cdr(x)) {
+        if(!object_isa(x, OBJECT_CONS) || !compilable(car(x)))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* Evaluate the arguments into temporaries, left to right as evlis()
+ * does; returns the number of the first. */
+static size_t compile_args(compiler_t * c, object_t * args, object_t * params) {
+    size_t first = c->tmp;
+
+    c->tmp += compile_length(args);
+
+    for(size_t i = first; args != NULL; args = cdr(args), i++) {
+        fprintf(c->out, "object_t *t%zu = ", i);
+        compile_expr(c, car(args), params);
+        fprintf(c->out, "; ");
+    }
+
+    return first;
+}
+
+static void compile_argv(compiler_t * c, size_t first, size_t n) {
+    if(n == 0) {
+        fprintf(c->out, "0, NULL");
+        return;
+    }
+
+    fprintf(c->out, "%zu, (object_t *[]) {", n);
+
+    for(size_t i = 0; i < n; i++)
+        fprintf(c->out, "%st%zu", i ? ", " : " ", first + i);
+
+    fprintf(c->out, " }");
+}
+
+/* Open-code a call of a builtin, returns 0 if op is not one of them. */
+static int compile_primitive(compiler_t * c, object_t * op, size_t first,
+                             size_t n) {
+    static const struct {
+        const char *name;
+        size_t argc;
+        const char *fmt;
+    } prims[] = {
+        { "CAR", 1, "car(t%zu)" },
+        { "CDR", 1, "cdr(t%zu)" },
+        { "ATOM", 1, "atom(l, t%zu)" },
+        { "CONS", 2, "cons(t%zu, t%zu)" },
+        { "EQ", 2, "eq(l, t%zu, t%zu)" },
+    };
+
+    for(size_t i = 0; i < sizeof(prims) / sizeof(prims[0]); i++) {
+        if(!compile_symbol_is(op, prims[i].name) || (prims[i].argc != n))
+            continue;
+
+        if(n == 1)
+            fprintf(c->out, prims[i].fmt, first);
+        else
+            fprintf(c->out, prims[i].fmt, first, first + 1);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static void compile_call(compiler_t * c, object_t * x, object_t * params) {
+    object_t *op = car(x);
+    object_t *args = cdr(x);
+    size_t n = compile_length(args);
+    object_t *fn = NULL;
+    long p = object_isa(op, OBJECT_SYMBOL)
+        ? compile_position(c, params, op) : -1;
+    long d = (p < 0) && object_isa(op, OBJECT_SYMBOL)
+        ? compile_def(c, op, &fn) : -1;
+
+    fprintf(c->out, "({ ");
+
+    /* a parameter may hold a macro, which expands the argument forms */
+    if(p >= 0) {
+        size_t r = c->tmp++;
+
+        fprintf(c->out, "object_t *t%zu; if(object_isa(p%ld, OBJECT_MACRO)) "
+                "t%zu = compiled_eval(l, K[%zu], K[%zu], (object_t *[]) {",
+                r, p, r, compile_constant(c, x), compile_constant(c, params));
+
+        for(size_t i = 0; i < compile_length(params); i++)
+            fprintf(c->out, "%sp%zu", i ? ", " : " ", i);
+
+        fprintf(c->out, " }); else { ");
+
+        size_t first = compile_args(c, args, params);
+
+        fprintf(c->out, "t%zu = lisp_call(l, p%ld, ", r, p);
+        compile_argv(c, first, n);
+        fprintf(c->out, "); } t%zu; })", r);
+
+        return;
+    }
+
+    /* the operator is evaluated first, as by lisp_eval() */
+    if(!object_isa(op, OBJECT_SYMBOL)) {
+        fprintf(c->out, "object_t *f = ");
+        compile_expr(c, op, params);
+        fprintf(c->out, "; ");
+    }
+
+    size_t first = compile_args(c, args, params);
+
+    if(!object_isa(op, OBJECT_SYMBOL)) {
+        fprintf(c->out, "lisp_call(l, f, ");
+        compile_argv(c, first, n);
+        fprintf(c->out, ")");
+    }
+    else if((d >= 0)
+            && (compile_length(((object_lambda_t *) fn)->args) == n)) {
+        fprintf(c->out, "f%ld(l, ", d);
+        compile_argv(c, first, n);
+        fprintf(c->out, ")");
+    }
+    else if((d >= 0) || !compile_primitive(c, op, first, n)) {
+        fprintf(c->out, "compiled_call(l, K[%zu], ", compile_constant(c, op));
+        compile_argv(c, first, n);
+        fprintf(c->out, ")");
+    }
+
+    fprintf(c->out, "; })");
+}
+
+/* Arithmetic keeps the results it passes on unboxed.
+ *
+ * compile_num() compiles an operand of open-coded arithmetic into three C
+ * expressions: whether it is an integer, its value if it is, and the
+ * object, NULL for a result that has not been boxed. What is known about
+ * an operand at compile time is used: an integer constant needs no check,
+ * a parameter is unpacked once on entry (see compile_function()), and a
+ * result of +, - or * is an integer unless the builtin had to be called.
+ * That happens when an operand is not an integer or the result overflows,
+ * with the operands boxed, so errors are signalled as by the interpreter
+ * and in the same order. Otherwise results are only boxed where they
+ * leave the arithmetic, see COMPILED_BOX(). */
+
+typedef enum {
+    COMPILE_OBJECT,             // anything, checked when it is used
+    COMPILE_FIXNUM,             // an integer constant
+} compile_type_t;
+
+typedef struct {
+    compile_type_t type;
+    char u[32];                 // is it an integer
+    char n[32];                 // its int64_t value, if so
+    char b[32];                 // the object, NULL if not boxed yet
+} compile_num_t;
+
+static const struct {
+    const char *name;
+    const char *builtin;        // of the vector convention, see compiled.h
+    const char *op;             // the C operator of a comparison, else
+    const char *overflow;       // the checked builtin
+} compile_ops[] = {
+    { "+", "compiled_add", NULL, "__builtin_add_overflow" },
+    { "-", "compiled_sub", NULL, "__builtin_sub_overflow" },
+    { "*", "compiled_mul", NULL, "__builtin_mul_overflow" },
+    { "<", "compiled_lt", "<", NULL },
+    { ">", "compiled_gt", ">", NULL },
+    { "=", "compiled_num_eq", "==", NULL },
+    { "<=", "compiled_le", "<=", NULL },
+    { ">=", "compiled_ge", ">=", NULL },
+};
+
+#define COMPILE_OPS (sizeof(compile_ops) / sizeof(compile_ops[0]))
+
+/* Index of x in compile_ops if it is a call that is open-coded, else -1. */
+static long compile_arith(compiler_t * c, object_t * x, object_t * params) {
+    object_t *fn, *op = car(x);
+
+    if(!object_isa(x, OBJECT_CONS) || !object_isa(op, OBJECT_SYMBOL)
+       || (compile_length(cdr(x)) != 2)
+       || (compile_position(c, params, op) >= 0)
+       || (compile_def(c, op, &fn) >= 0))
+        return -1;
+
+    for(size_t i = 0; i < COMPILE_OPS; i++) {
+        if(compile_symbol_is(op, compile_ops[i].name))
+            return i;
+    }
+
+    return -1;
+}
+
+/* Is the parameter p an operand of open-coded arithmetic in x? */
+static int compile_operand(compiler_t * c, object_t * x, object_t * params,
+                           object_t * p) {
+    if(!object_isa(x, OBJECT_CONS) || compile_symbol_is(car(x), "QUOTE"))
+        return 0;
+
+    if((compile_arith(c, x, params) >= 0)
+       && (eq(c->l, car(cdr(x)), p) || eq(c->l, car(cdr(cdr(x))), p)))
+        return 1;
+
+    for(; object_isa(x, OBJECT_CONS); x = cdr(x)) {
+        if(compile_operand(c, car(x), params, p))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void compile_num(compiler_t * c, object_t * x, object_t * params,
+                        compile_num_t * r) {
+    long i = compile_arith(c, x, params);
+    long p = object_isa(x, OBJECT_SYMBOL)
+        ? compile_position(c, params, x) : -1;
+    size_t t = c->tmp++;
+
+    r->type = COMPILE_OBJECT;
+    snprintf(r->u, sizeof(r->u), "u%zu", t);
+    snprintf(r->n, sizeof(r->n), "n%zu", t);
+    snprintf(r->b, sizeof(r->b), "b%zu", t);
+
+    if(object_isa(x, OBJECT_INTEGER)
+       && (((object_integer_t *) x)->number > INT64_MIN)) {
+        r->type = COMPILE_FIXNUM;
+        strcpy(r->u, "1");
+        snprintf(r->n, sizeof(r->n), "INT64_C(%lld)",
+                 (long long) ((object_integer_t *) x)->number);
+        snprintf(r->b, sizeof(r->b), "K[%zu]", compile_constant(c, x));
+    }
+    else if(p >= 0) {
+        snprintf(r->u, sizeof(r->u), "up%ld", p);
+        snprintf(r->n, sizeof(r->n), "np%ld", p);
+        snprintf(r->b, sizeof(r->b), "p%ld", p);
+    }
+    else if((i < 0) || (compile_ops[i].op != NULL)) {
+        fprintf(c->out, "object_t *b%zu = ", t);
+        compile_expr(c, x, params);
+        fprintf(c->out, "; COMPILED_UNBOX(b%zu, u%zu, n%zu); ", t, t, t);
+    }
+    else {
+        compile_num_t a, b;
+
+        compile_num(c, car(cdr(x)), params, &a);
+        compile_num(c, car(cdr(cdr(x))), params, &b);
+
+        fprintf(c->out, "int64_t n%zu = 0; int u%zu = ", t, t);
+
+        if(a.type != COMPILE_FIXNUM)
+            fprintf(c->out, "%s && ", a.u);
+
+        if(b.type != COMPILE_FIXNUM)
+            fprintf(c->out, "%s && ", b.u);
+
+        fprintf(c->out, "!%s(%s, %s, &n%zu); ", compile_ops[i].overflow,
+                a.n, b.n, t);
+        fprintf(c->out, "object_t *b%zu = u%zu ? NULL : %s(l, K[%zu], "
+                "COMPILED_BOX(%s, %s, %s), COMPILED_BOX(%s, %s, %s)); ",
+                t, t, compile_ops[i].builtin, compile_constant(c, car(x)),
+                a.u, a.n, a.b, b.u, b.n, b.b);
+    }
+}
+
+/* Open-coded arithmetic or comparison x, as an object or, if test is set,
+ * as a C truth value for COND. */
+static void compile_arith_expr(compiler_t * c, object_t * x,
+                               object_t * params, long i, int test) {
+    compile_num_t r;
+
+    fprintf(c->out, "({ ");
+
+    if(compile_ops[i].op == NULL) {
+        compile_num(c, x, params, &r);
+        fprintf(c->out, "COMPILED_BOX(%s, %s, %s)%s; })", r.u, r.n, r.b,
+                test ? " != NULL" : "");
+        return;
+    }
+
+    compile_num_t a, b;
+
+    compile_num(c, car(cdr(x)), params, &a);
+    compile_num(c, car(cdr(cdr(x))), params, &b);
+
+    fprintf(c->out, "%s && %s ? ", a.u, b.u);
+
+    if(test)
+        fprintf(c->out, "%s %s %s", a.n, compile_ops[i].op, b.n);
+    else
+        fprintf(c->out, "(%s %s %s ? l->t : NULL)", a.n, compile_ops[i].op,
+                b.n);
+
+    fprintf(c->out, " : %s(l, K[%zu], COMPILED_BOX(%s, %s, %s), "
+            "COMPILED_BOX(%s, %s, %s))%s; })", compile_ops[i].builtin,
+            compile_constant(c, car(x)), a.u, a.n, a.b, b.u, b.n, b.b,
+            test ? " != NULL" : "");
+}
+
+/* x as a C truth value. */
+static void compile_test(compiler_t * c, object_t * x, object_t * params) {
+    long i = compile_arith(c, x, params);
+
+    if(i >= 0) {
+        compile_arith_expr(c, x, params, i, 1);
+        return;
+    }
+
+    fprintf(c->out, "(");
+    compile_expr(c, x, params);
+    fprintf(c->out, ") != NULL");
+}
+
+static void compile_expr(compiler_t * c, object_t * x, object_t * params) {
+    long i;
+
+    if(x == NULL) {
+        fprintf(c->out, "NULL");
+        return;
+    }
+
+    switch (x->type) {
+    case OBJECT_SYMBOL:
+        if(compile_symbol_is(x, "NIL"))
+            fprintf(c->out, "NULL");
+        else if(eq(c->l, x, c->l->t))
+            fprintf(c->out, "l->t");
+        else if(compile_position(c, params, x) >= 0)
+            fprintf(c->out, "p%ld", compile_position(c, params, x));
+        else
+            fprintf(c->out, "compiled_global(l, K[%zu])",
+                    compile_constant(c, x));
+        return;
+    case OBJECT_CONS:
+        break;
+    default:
+        fprintf(c->out, "K[%zu]", compile_constant(c, x));
+        return;
+    }
+
+    object_t *op = car(x);
+
+    if(compile_symbol_is(op, "QUOTE")) {
+        object_t *value = car(cdr(x));
+
+        if(value == NULL)
+            fprintf(c->out, "NULL");
+        else
+            fprintf(c->out, "K[%zu]", compile_constant(c, value));
+    }
+    else if(compile_symbol_is(op, "INLINE")) {
+        /* the call, which is direct if it is to a function compiled here */
+        compile_expr(c, car(cdr(cdr(x))), params);
+    }
+    else if(compile_symbol_is(op, "COND")) {
+        /* a clause without expression yields NIL, as in evcond() */
+        fprintf(c->out, "(");
+
+        for(object_t * cl = cdr(x); cl != NULL; cl = cdr(cl)) {
+            compile_test(c, car(car(cl)), params);
+            fprintf(c->out, " ? ");
+            compile_expr(c, car(cdr(car(cl))), params);
+            fprintf(c->out, " : ");
+        }
+
+        fprintf(c->out, "NULL)");
+    }
+    else if(compile_symbol_is(op, "PRINT") || compile_symbol_is(op, "ERROR")) {
+        fprintf(c->out, "%s(l, ", compile_symbol_is(op, "PRINT")
+                ? "lisp_print" : "lisp_error");
+        compile_expr(c, car(cdr(x)), params);
+        fprintf(c->out, ")");
+    }
+    else if((i = compile_arith(c, x, params)) >= 0)
+        compile_arith_expr(c, x, params, i, 0);
+    else
+        compile_call(c, x, params);
+}
+
+static void compile_function(compiler_t * c, size_t i, object_t * fn) {
+    object_lambda_t *lamb = (object_lambda_t *) fn;
+    size_t n = compile_length(lamb->args);
+
+    fprintf(c->out, "static object_t *b%zu(lisp_t * l, size_t argc, "
+            "object_t ** argv) {\n", i);
+
+    /* missing arguments are NIL, extra ones ignored, as by pair() */
+    for(size_t j = 0; j < n; j++)
+        fprintf(c->out, "    object_t *p%zu = argc > %zu ? argv[%zu] : NULL;\n",
+                j, j, j);
+
+    object_t *p = lamb->args;
+
+    for(size_t j = 0; j < n; j++, p = cdr(p)) {
+        if(compile_operand(c, lamb->expr, lamb->args, car(p)))
+            fprintf(c->out, "    COMPILED_UNBOX(p%zu, up%zu, np%zu);\n",
+                    j, j, j);
+    }
+
+    fprintf(c->out, "    (void) l; (void) argc; (void) argv;\n    return ");
+    compile_expr(c, lamb->expr, lamb->args);
+    fprintf(c->out, ";\n}\n\nCOMPILED_FUNCTION(f%zu, b%zu)\n\n", i, i);
+}
+
+/* The function a top-level form defines, if it is one to compile. */
+static object_t *compile_candidate(object_t * form, object_t * value) {
+    if(!object_isa(form, OBJECT_CONS) || !compile_symbol_is(car(form), "LABEL")
+       || !object_isa(value, OBJECT_LAMBDA))
+        return NULL;
+
+    object_lambda_t *lamb = (object_lambda_t *) value;
+
+    if(lamb->closed != NULL)
+        return NULL;
+
+    for(object_t * a = lamb->args; a != NULL; a = cdr(a)) {
+        if(!object_isa(a, OBJECT_CONS) || !object_isa(car(a), OBJECT_SYMBOL))
+            return NULL;
+    }
+
+    if(!compilable(lamb->expr))
+        return NULL;
+
+    return cons(car(cdr(form)), cons(value, NULL));
+}
+
+/* Replace a trailing ".lips" of path by ext. */
+static char *compile_path(const char *path, const char *ext) {
+    size_t len = strlen(path);
+
+    if((len > 5) && !strcmp(path + len - 5, ".lips"))
+        len -= 5;
+
+    char *s = calloc(len + strlen(ext) + 3, sizeof(char));
+
+    if(s == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    /* dlopen() searches the library path for names without a slash */
+    snprintf(s, len + strlen(ext) + 3, "%s%.*s%s",
+             strchr(path, '/') ? "" : "./", (int) len, path, ext);
+
+    return s;
+}
+
+/* The compiler is run directly, not through a shell, so paths need no
+ * quoting; posix_spawnp() as unistd.h clashes with read() in builtin.h. */
+static int compile_build(const char *src, const char *so) {
+    const char *inc = getenv("LIPS_INCLUDE");
+    const char *cc = getenv("CC");
+
+    if(inc == NULL)
+        inc = LIPS_INCLUDE_DIR;
+
+    char include[strlen(inc) + 3];
+
+    snprintf(include, sizeof(include), "-I%s", inc);
+
+    char *argv[] = {
+        (char *) (cc ? cc : "gcc"), "-std=gnu99", "-O2", "-shared", "-fPIC",
+        include, "-o", (char *) so, (char *) src, NULL
+    };
+    pid_t pid;
+    int status;
+
+    TRACE("compile_build[%s, %s]", src, so);
+
+    if(posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ) != 0)
+        return 0;
+
+    if(waitpid(pid, &status, 0) != pid)
+        return 0;
+
+    return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+/** Load the file at path, compiling the functions it defines to C.
+ *
+ *  Returns the names of the compiled functions, signals FILE-ERROR if the
+ *  file cannot be read and COMPILE-ERROR if the C cannot be built. */
+object_t *compile_file(lisp_t * l, const char *path) {
+    FILE *f = fopen(path, "r");
+
+    if(f == NULL)
+        return lisp_error(l, object_symbol_new("FILE-ERROR"));
+
+    fclose(f);
+
+    compiler_t c = {.l = l };
+    object_t *stream = istream_file(path);
+    object_t *form, *candidates = NULL, *tail = NULL;
+
+    while(lisp_read_next(l, stream, &form)) {
+        object_t *def = compile_candidate(form, lisp_eval(l, form));
+
+        if(def != NULL)
+            candidates = cons(def, candidates);
+    }
+
+    stream_close(stream);
+
+    /* only definitions still in force, a later one may replace a name */
+    for(object_t * d = candidates; d != NULL; d = cdr(d)) {
+        object_t *name = car(car(d));
+
+        if(car(cdr(lisp_env_resolv(l, l->global, name))) != car(cdr(car(d))))
+            continue;
+
+        if(c.defs == NULL)
+            c.defs = tail = cons(car(d), NULL);
+        else
+            tail = ((object_cons_t *) tail)->cdr = cons(car(d), NULL);
+    }
+
+    if(c.defs == NULL)
+        return NULL;
+
+    /* dlopen() hands back a library already loaded from the same path, so
+     * each build gets a name of its own; it is removed once loaded */
+    static unsigned long builds;
+    char ext[32];
+
+    snprintf(ext, sizeof(ext), ".%lu.so", ++builds);
+
+    char *src = compile_path(path, ".c");
+    char *so = compile_path(path, ext);
+
+    if((c.out = fopen(src, "w")) == NULL) {
+        free(src);
+        free(so);
+
+        return lisp_error(l, object_symbol_new("FILE-ERROR"));
+    }
+
+    fprintf(c.out, "/* Generated from %s, see compile.c. */\n\n"
+            "#include \"compiled.h\"\n\nstatic object_t **K;\n\n", path);
+
+    size_t n = compile_length(c.defs);
+
+    for(size_t i = 0; i < n; i++)
+        fprintf(c.out, "static object_t *f%zu(lisp_t *, size_t, "
+                "object_t **);\n", i);
+
+    fprintf(c.out, "\n");
+
+    size_t i = 0;
+
+    for(object_t * d = c.defs; d != NULL; d = cdr(d), i++)
+        compile_function(&c, i, car(cdr(car(d))));
+
+    fprintf(c.out, "void lips_init(object_t ** k) {\n    K = k;\n}\n\n"
+            "object_t *(*const lips_functions[]) (lisp_t *, size_t, "
+            "object_t **) = {\n");
+
+    for(i = 0; i < n; i++)
+        fprintf(c.out, "    f%zu,\n", i);
+
+    fprintf(c.out, "};\n");
+    fclose(c.out);
+
+    void *dl = compile_build(src, so) ? dlopen(so, RTLD_NOW) : NULL;
+
+    remove(so);
+    free(src);
+    free(so);
+
+    if(dl == NULL) {
+        free(c.k);
+
+        return lisp_error(l, object_symbol_new("COMPILE-ERROR"));
+    }
+
+    void (*init) (object_t **) = (void (*)(object_t **)) dlsym(dl,
+                                                                 "lips_init");
+    compiled_fn_t *fns = dlsym(dl, "lips_functions");
+
+    if((init == NULL) || (fns == NULL)) {
+        dlclose(dl);
+        free(c.k);
+
+        return lisp_error(l, object_symbol_new("COMPILE-ERROR"));
+    }
+
+    /* the table is the compiled code's for as long as it is loaded */
+    init(c.k);
+
+    object_t *names = NULL;
+
+    i = 0;
+
+    for(object_t * d = c.defs; d != NULL; d = cdr(d), i++) {
+        label(l, car(car(d)), object_vfunction_new(fns[i]));
+        names = cons(car(car(d)), names);
+    }
+
+    return names;
+}
+
+/** Call what the global name s is bound to, for compiled code. */
+object_t *compiled_call(lisp_t * l, object_t * s, size_t argc,
+                        object_t ** argv) {
+    object_t *fpair = lisp_env_resolv(l, l->global, s);
+
+    if(fpair == NULL) {
+        ERROR("invalid operator!");
+
+        return NULL;
+    }
+
+    object_t *fn = car(cdr(fpair));
+
+    if(!object_isa(fn, OBJECT_FUNCTION) && !object_isa(fn, OBJECT_LAMBDA))
+        PANIC("compiled_call: %s is not a function!",
+              ((object_symbol_t *) s)->name);
+
+    return lisp_call(l, fn, argc, argv);
+}
+
+/** Evaluate form in a frame binding params to argv, as the body of a
+ *  lambda called on argv would, for calls compiled code leaves to the
+ *  interpreter: those of a macro held by a parameter. */
+object_t *compiled_eval(lisp_t * l, object_t * form, object_t * params,
+                        object_t ** argv) {
+    object_t *args = NULL, *tail = NULL;
+
+    for(object_t * p = params; p != NULL; p = cdr(p), argv++) {
+        object_t *o = cons(*argv, NULL);
+
+        if(args == NULL)
+            args = o;
+        else
+            ((object_cons_t *) tail)->cdr = o;
+
+        tail = o;
+    }
+
+    lisp_env_t *caller = l->env;
+
+    l->env = lisp_env_new(l->global, pair(l, params, args));
+
+    object_t *r = lisp_eval(l, form);
+
+    l->env = caller;
+
+    return r;
+}
+
+/** The value of the global variable s, for compiled code. */
+object_t *compiled_global(lisp_t * l, object_t * s) {
+    object_t *pair = lisp_env_resolv(l, l->global, s);
+
+    if(pair == NULL)
+        return lisp_error(l, object_symbol_new("UNBOUND-SYMBOL"));
+
+    return car(cdr(pair));
+}
@@ -0,0 +1,9 @@
+#ifndef __COMPILE_H
+#define __COMPILE_H
+
+#include "lisp.h"
+#include "object.h"
+
+object_t *compile_file(lisp_t *, const char *);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __COMPILED_H
+#define __COMPILED_H
+
+/* Included by the C that compile_file() generates, see compile.c. */
+
+#include <stdint.h>
+
+#include "lisp.h"
+#include "object.h"
+#include "builtin.h"
+#include "lisp_eval.h"
+#include "lisp_print.h"
+
+object_t *compiled_call(lisp_t *, object_t *, size_t, object_t **);
+object_t *compiled_global(lisp_t *, object_t *);
+object_t *compiled_eval(lisp_t *, object_t *, object_t *, object_t **);
+
+/* f is the function compiled to body, one more nested evaluation as in
+ * lisp_eval(): past MAX-DEPTH, with the stack running low, or when it is
+ * not called from Lisp, lisp_call_nested() has it signal STACK-OVERFLOW
+ * or run on a new stack segment. */
+#define COMPILED_FUNCTION(f, body) \
+static object_t *f(lisp_t * l, size_t argc, object_t ** argv) { \
+    if((l->depth == 0) || (l->depth >= l->max_depth) \
+       || ((char *) __builtin_frame_address(0) < l->stack_limit)) \
+        return lisp_call_nested(l, body, argc, argv); \
+    l->depth++; \
+    object_t *r = body(l, argc, argv); \
+    l->depth--; \
+    return r; \
+}
+
+#define COMPILED_INT(o) (((object_integer_t *) (o))->number)
+#define COMPILED_INTS(a, b) ((a) != NULL && (a)->type == OBJECT_INTEGER \
+    && (b) != NULL && (b)->type == OBJECT_INTEGER)
+
+/* Arithmetic operands are kept unboxed as u (is it an integer), n (its
+ * value) and b (the object, NULL until it is needed), see compile_num(). */
+#define COMPILED_UNBOX(b, u, n) \
+    int u = (b) != NULL && (b)->type == OBJECT_INTEGER; \
+    int64_t n = u ? COMPILED_INT(b) : 0
+#define COMPILED_BOX(u, n, b) ((u) && (b) == NULL ? object_integer_new(n) : (b))
+
+/* Two argument arithmetic on integers that fit, anything else (and
+ * overflow) is left to the builtin named s. */
+
+#define COMPILED_ARITH(name, builtin) \
+static inline object_t *name(lisp_t * l, object_t * s, object_t * a, \
+                             object_t * b) { \
+    int64_t r; \
+    if(COMPILED_INTS(a, b) \
+       && !builtin(COMPILED_INT(a), COMPILED_INT(b), &r)) \
+        return object_integer_new(r); \
+    return compiled_call(l, s, 2, (object_t *[]) { a, b }); \
+}
+
+#define COMPILED_COMPARE(name, op) \
+static inline object_t *name(lisp_t * l, object_t * s, object_t * a, \
+                             object_t * b) { \
+    if(COMPILED_INTS(a, b)) \
+        return COMPILED_INT(a) op COMPILED_INT(b) ? l->t : NULL; \
+    return compiled_call(l, s, 2, (object_t *[]) { a, b }); \
+}
+
+COMPILED_ARITH(compiled_add, __builtin_add_overflow)
+COMPILED_ARITH(compiled_sub, __builtin_sub_overflow)
+COMPILED_ARITH(compiled_mul, __builtin_mul_overflow)
+COMPILED_COMPARE(compiled_lt, <)
+COMPILED_COMPARE(compiled_gt, >)
+COMPILED_COMPARE(compiled_num_eq, ==)
+COMPILED_COMPARE(compiled_le, <=)
+COMPILED_COMPARE(compiled_ge, >=)
+
+#endif
@@ -0,0 +1,323 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hamt.h"
+#include "hashtable.h"
+#include "builtin.h"
+#include "logger.h"
+
+/* Persistent maps are hash array mapped tries: every level consumes 5 bits
+ * of the key's hash, and a node only stores the slots present in its 32
+ * bit bitmap, so slot i lives at popcount(bitmap & (bit(i) - 1)). Updates
+ * copy the nodes on the path to the changed slot and share all others, so
+ * an update costs O(log32 n) time and space and never disturbs older
+ * versions. Keys whose hashes agree in all bits end up in a collision node,
+ * which is searched linearly. */
+
+#define HAMT_BITS 5
+#define HAMT_MASK ((1UL << HAMT_BITS) - 1)
+#define HAMT_HASH_BITS (8 * sizeof(unsigned long))
+
+static hamt_node_t *hamt_insert(lisp_t *, object_map_t *, hamt_node_t *,
+                                unsigned, hamt_entry_t *, int *);
+static hamt_node_t *hamt_delete(lisp_t *, object_map_t *, hamt_node_t *,
+                                unsigned, unsigned long, object_t *, int *);
+
+static hamt_node_t *hamt_node_new(uint32_t bitmap, size_t len) {
+    hamt_node_t *n =
+        calloc(1, sizeof(hamt_node_t) + len * sizeof(hamt_entry_t));
+
+    if(n == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    n->bitmap = bitmap;
+    n->len = len;
+
+    return n;
+}
+
+static hamt_node_t *hamt_node_copy(hamt_node_t * n) {
+    hamt_node_t *r = hamt_node_new(n->bitmap, n->len);
+
+    memcpy(r->slots, n->slots, n->len * sizeof(hamt_entry_t));
+
+    return r;
+}
+
+/** Copy n without slot idx, NULL if nothing would remain. */
+static hamt_node_t *hamt_node_without(hamt_node_t * n, uint32_t bit,
+                                      size_t idx) {
+    if(n->len == 1)
+        return NULL;
+
+    hamt_node_t *r = hamt_node_new(n->bitmap & ~bit, n->len - 1);
+
+    memcpy(r->slots, n->slots, idx * sizeof(hamt_entry_t));
+    memcpy(r->slots + idx, n->slots + idx + 1,
+           (n->len - idx - 1) * sizeof(hamt_entry_t));
+
+    return r;
+}
+
+static uint32_t hamt_bit(unsigned long hash, unsigned shift) {
+    return 1U << ((hash >> shift) & HAMT_MASK);
+}
+
+static size_t hamt_index(hamt_node_t * n, uint32_t bit) {
+    return __builtin_popcount(n->bitmap & (bit - 1));
+}
+
+static unsigned long hamt_hash(object_map_t * m, object_t * key) {
+    return m->test == HASHTABLE_EQ ? hash_eq(key) : hash_equal(key);
+}
+
+static int hamt_same(lisp_t * l, object_map_t * m, object_t * a,
+                     object_t * b) {
+    return (m->test == HASHTABLE_EQ ? eq(l, a, b) : equal(l, a, b)) != NULL;
+}
+
+/** Look up key, setting *found (if not NULL) to whether it is present. */
+object_t *hamt_get(lisp_t * l, object_t * o, object_t * key, int *found) {
+    if(!object_isa(o, OBJECT_MAP))
+        PANIC("hamt_get: not a map!");
+
+    object_map_t *m = (object_map_t *) o;
+    unsigned long hash = hamt_hash(m, key);
+    hamt_node_t *n = m->root;
+
+    for(unsigned shift = 0; n != NULL; shift += HAMT_BITS) {
+        hamt_entry_t *e = NULL;
+
+        if(shift >= HAMT_HASH_BITS) {
+            for(size_t i = 0; (e == NULL) && (i < n->len); i++) {
+                if(hamt_same(l, m, n->slots[i].key, key))
+                    e = &n->slots[i];
+            }
+        }
+        else {
+            uint32_t bit = hamt_bit(hash, shift);
+
+            if(n->bitmap & bit)
+                e = &n->slots[hamt_index(n, bit)];
+        }
+
+        if(e == NULL)
+            break;
+
+        if(e->node != NULL) {
+            n = e->node;
+            continue;
+        }
+
+        if((e->hash == hash) && hamt_same(l, m, e->key, key)) {
+            if(found != NULL)
+                *found = 1;
+
+            return e->value;
+        }
+
+        break;
+    }
+
+    if(found != NULL)
+        *found = 0;
+
+    return NULL;
+}
+
+/** Return a new map with key bound to value, sharing structure with o. */
+object_t *hamt_put(lisp_t * l, object_t * o, object_t * key,
+                   object_t * value) {
+    if(!object_isa(o, OBJECT_MAP))
+        PANIC("hamt_put: not a map!");
+
+    object_map_t *m = (object_map_t *) o;
+    hamt_entry_t kv =
+        { .hash = hamt_hash(m, key), .key = key, .value = value };
+    int added = 0;
+    hamt_node_t *root = hamt_insert(l, m, m->root, 0, &kv, &added);
+
+    if(root == m->root)
+        return o;
+
+    return object_map_new(m->test, root, m->count + added);
+}
+
+/** Return a new map without key, o itself if key is not present. */
+object_t *hamt_remove(lisp_t * l, object_t * o, object_t * key) {
+    if(!object_isa(o, OBJECT_MAP))
+        PANIC("hamt_remove: not a map!");
+
+    object_map_t *m = (object_map_t *) o;
+    int removed = 0;
+    hamt_node_t *root =
+        hamt_delete(l, m, m->root, 0, hamt_hash(m, key), key, &removed);
+
+    if(!removed)
+        return o;
+
+    return object_map_new(m->test, root, m->count - 1);
+}
+
+static object_t *hamt_node_alist(hamt_node_t * n, object_t * tail) {
+    for(size_t i = 0; (n != NULL) && (i < n->len); i++) {
+        hamt_entry_t *e = &n->slots[i];
+
+        if(e->node != NULL)
+            tail = hamt_node_alist(e->node, tail);
+        else
+            tail = cons(cons(e->key, cons(e->value, NULL)), tail);
+    }
+
+    return tail;
+}
+
+/** List the entries of a map as ((key value) ...), in no particular order. */
+object_t *hamt_alist(object_t * o) {
+    if(!object_isa(o, OBJECT_MAP))
+        PANIC("hamt_alist: not a map!");
+
+    return hamt_node_alist(((object_map_t *) o)->root, NULL);
+}
+
+static hamt_node_t *hamt_insert(lisp_t * l, object_map_t * m,
+                                hamt_node_t * n, unsigned shift,
+                                hamt_entry_t * kv, int *added) {
+    hamt_node_t *r;
+
+    if(n == NULL) {
+        *added = 1;
+
+        r = hamt_node_new(shift >= HAMT_HASH_BITS ? 0 :
+                          hamt_bit(kv->hash, shift), 1);
+        r->slots[0] = *kv;
+
+        return r;
+    }
+
+    if(shift >= HAMT_HASH_BITS) {
+        for(size_t i = 0; i < n->len; i++) {
+            if(!hamt_same(l, m, n->slots[i].key, kv->key))
+                continue;
+
+            if(n->slots[i].value == kv->value)
+                return n;
+
+            r = hamt_node_copy(n);
+            r->slots[i].value = kv->value;
+
+            return r;
+        }
+
+        *added = 1;
+
+        r = hamt_node_new(0, n->len + 1);
+        memcpy(r->slots, n->slots, n->len * sizeof(hamt_entry_t));
+        r->slots[n->len] = *kv;
+
+        return r;
+    }
+
+    uint32_t bit = hamt_bit(kv->hash, shift);
+    size_t idx = hamt_index(n, bit);
+
+    if(!(n->bitmap & bit)) {
+        *added = 1;
+
+        r = hamt_node_new(n->bitmap | bit, n->len + 1);
+        memcpy(r->slots, n->slots, idx * sizeof(hamt_entry_t));
+        r->slots[idx] = *kv;
+        memcpy(r->slots + idx + 1, n->slots + idx,
+               (n->len - idx) * sizeof(hamt_entry_t));
+
+        return r;
+    }
+
+    hamt_entry_t *e = &n->slots[idx];
+    hamt_entry_t s = *e;
+
+    if(e->node != NULL) {
+        s.node = hamt_insert(l, m, e->node, shift + HAMT_BITS, kv, added);
+
+        if(s.node == e->node)
+            return n;
+    }
+    else if((e->hash == kv->hash) && hamt_same(l, m, e->key, kv->key)) {
+        if(e->value == kv->value)
+            return n;
+
+        s.value = kv->value;
+    }
+    else {
+        /* two keys share this slot now: push both one level down */
+        int pushed = 0;
+
+        s.node = hamt_insert(l, m, NULL, shift + HAMT_BITS, e, &pushed);
+        s.node = hamt_insert(l, m, s.node, shift + HAMT_BITS, kv, added);
+        s.hash = 0;
+        s.key = s.value = NULL;
+    }
+
+    r = hamt_node_copy(n);
+    r->slots[idx] = s;
+
+    return r;
+}
+
+static hamt_node_t *hamt_delete(lisp_t * l, object_map_t * m,
+                                hamt_node_t * n, unsigned shift,
+                                unsigned long hash, object_t * key,
+                                int *removed) {
+    if(n == NULL)
+        return NULL;
+
+    if(shift >= HAMT_HASH_BITS) {
+        for(size_t i = 0; i < n->len; i++) {
+            if(hamt_same(l, m, n->slots[i].key, key)) {
+                *removed = 1;
+
+                return hamt_node_without(n, 0, i);
+            }
+        }
+
+        return n;
+    }
+
+    uint32_t bit = hamt_bit(hash, shift);
+    size_t idx = hamt_index(n, bit);
+
+    if(!(n->bitmap & bit))
+        return n;
+
+    hamt_entry_t *e = &n->slots[idx];
+
+    if(e->node == NULL) {
+        if((e->hash != hash) || !hamt_same(l, m, e->key, key))
+            return n;
+
+        *removed = 1;
+
+        return hamt_node_without(n, bit, idx);
+    }
+
+    hamt_node_t *c =
+        hamt_delete(l, m, e->node, shift + HAMT_BITS, hash, key, removed);
+
+    if(c == e->node)
+        return n;
+
+    if(c == NULL)
+        return hamt_node_without(n, bit, idx);
+
+    hamt_node_t *r = hamt_node_copy(n);
+
+    /* a subtrie left with a single entry is pulled back up */
+    if((c->len == 1) && (c->slots[0].node == NULL))
+        r->slots[idx] = c->slots[0];
+    else
+        r->slots[idx].node = c;
+
+    return r;
+}
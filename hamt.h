@@ -0,0 +1,12 @@
+#ifndef __HAMT_H
+#define __HAMT_H
+
+#include "lisp.h"
+#include "object.h"
+
+object_t *hamt_get(lisp_t *, object_t *, object_t *, int *);
+object_t *hamt_put(lisp_t *, object_t *, object_t *, object_t *);
+object_t *hamt_remove(lisp_t *, object_t *, object_t *);
+object_t *hamt_alist(object_t *);
+
+#endif
@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hashtable.h"
+#include "builtin.h"
+#include "logger.h"
+
+static hashtable_entry_t *hashtable_find(lisp_t *, object_hashtable_t *,
+                                         object_t *, unsigned long);
+static void hashtable_resize(object_hashtable_t *, size_t);
+
+static unsigned long hash_mix(unsigned long h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdUL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+static unsigned long hash_bytes(const char *s, size_t len) {
+    unsigned long h = 14695981039346656037UL;   // FNV-1a
+
+    for(size_t i = 0; i < len; i++) {
+        h ^= (unsigned char) s[i];
+        h *= 1099511628211UL;
+    }
+
+    return h;
+}
+
+/** Hash consistent with eq(): atoms by value, everything else by identity. */
+unsigned long hash_eq(object_t * o) {
+    if(o == NULL)
+        return 0;
+
+    switch (o->type) {
+    case OBJECT_INTEGER:
+        return hash_mix(((object_integer_t *) o)->number);
+    case OBJECT_STRING:
+        return hash_bytes(((object_string_t *) o)->string,
+                          ((object_string_t *) o)->len);
+    case OBJECT_SYMBOL:
+        return hash_bytes(((object_symbol_t *) o)->name,
+                          strlen(((object_symbol_t *) o)->name));
+    default:
+        return hash_mix((uintptr_t) o);
+    }
+}
+
+/** Hash consistent with equal(): conses by structure. */
+unsigned long hash_equal(object_t * o) {
+    unsigned long h = 0;
+
+    while(object_isa(o, OBJECT_CONS)) {
+        h = hash_mix(h * 31 + hash_equal(car(o)));
+        o = cdr(o);
+    }
+
+    return hash_mix(h * 31 + hash_eq(o));
+}
+
+/** Look up key, setting *found (if not NULL) to whether it is present. */
+object_t *hashtable_get(lisp_t * l, object_t * o, object_t * key, int *found) {
+    if(!object_isa(o, OBJECT_HASHTABLE))
+        PANIC("hashtable_get: not a hash table!");
+
+    object_hashtable_t *h = (object_hashtable_t *) o;
+    unsigned long hash = h->test == HASHTABLE_EQ
+        ? hash_eq(key) : hash_equal(key);
+    hashtable_entry_t *e = hashtable_find(l, h, key, hash);
+
+    if(found != NULL)
+        *found = (e->state == HASHTABLE_ENTRY_FULL);
+
+    return e->state == HASHTABLE_ENTRY_FULL ? e->value : NULL;
+}
+
+object_t *hashtable_put(lisp_t * l, object_t * o, object_t * key,
+                        object_t * value) {
+
+    if(!object_isa(o, OBJECT_HASHTABLE))
+        PANIC("hashtable_put: not a hash table!");
+
+    object_hashtable_t *h = (object_hashtable_t *) o;
+
+    /* keep at least half of the slots empty, so probe sequences end;
+     * if mostly deleted entries are in the way, just clean them up */
+    if(2 * (h->used + 1) > h->sz) {
+        if(4 * (h->count + 1) > h->sz)
+            hashtable_resize(h, h->sz * 2);
+        else
+            hashtable_resize(h, h->sz);
+    }
+
+    unsigned long hash = h->test == HASHTABLE_EQ
+        ? hash_eq(key) : hash_equal(key);
+    hashtable_entry_t *e = hashtable_find(l, h, key, hash);
+
+    if(e->state != HASHTABLE_ENTRY_FULL) {
+        if(e->state == HASHTABLE_ENTRY_EMPTY)
+            h->used++;
+
+        h->count++;
+        e->state = HASHTABLE_ENTRY_FULL;
+        e->hash = hash;
+        e->key = key;
+    }
+
+    return e->value = value;
+}
+
+/** Remove key, returns 1 if it was present. */
+int hashtable_remove(lisp_t * l, object_t * o, object_t * key) {
+    if(!object_isa(o, OBJECT_HASHTABLE))
+        PANIC("hashtable_remove: not a hash table!");
+
+    object_hashtable_t *h = (object_hashtable_t *) o;
+    unsigned long hash = h->test == HASHTABLE_EQ
+        ? hash_eq(key) : hash_equal(key);
+    hashtable_entry_t *e = hashtable_find(l, h, key, hash);
+
+    if(e->state != HASHTABLE_ENTRY_FULL)
+        return 0;
+
+    e->state = HASHTABLE_ENTRY_DELETED;
+    e->key = e->value = NULL;
+    h->count--;
+
+    return 1;
+}
+
+void hashtable_clear(object_t * o) {
+    if(!object_isa(o, OBJECT_HASHTABLE))
+        PANIC("hashtable_clear: not a hash table!");
+
+    object_hashtable_t *h = (object_hashtable_t *) o;
+
+    for(size_t i = 0; i < h->sz; i++)
+        h->entries[i].state = HASHTABLE_ENTRY_EMPTY;
+
+    h->count = h->used = 0;
+}
+
+/** Find the entry of key, or the slot it should be inserted into.
+ *
+ *  Linear probing; deleted entries are skipped, but the first one seen is
+ *  reused for an insert.
+ */
+static hashtable_entry_t *hashtable_find(lisp_t * l, object_hashtable_t * h,
+                                         object_t * key, unsigned long hash) {
+    size_t mask = h->sz - 1;
+    hashtable_entry_t *tomb = NULL;
+
+    for(size_t i = hash & mask;; i = (i + 1) & mask) {
+        hashtable_entry_t *e = &h->entries[i];
+
+        switch (e->state) {
+        case HASHTABLE_ENTRY_EMPTY:
+            return tomb ? tomb : e;
+        case HASHTABLE_ENTRY_DELETED:
+            if(tomb == NULL)
+                tomb = e;
+
+            break;
+        case HASHTABLE_ENTRY_FULL:
+            if(e->hash != hash)
+                break;
+
+            if(h->test == HASHTABLE_EQ ? eq(l, e->key, key)
+               : equal(l, e->key, key))
+                return e;
+
+            break;
+        }
+    }
+}
+
+static void hashtable_resize(object_hashtable_t * h, size_t sz) {
+    hashtable_entry_t *old = h->entries;
+    size_t old_sz = h->sz;
+
+    h->entries = calloc(sz, sizeof(hashtable_entry_t));
+
+    if(h->entries == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    h->sz = sz;
+    h->used = h->count;
+
+    for(size_t i = 0; i < old_sz; i++) {
+        if(old[i].state != HASHTABLE_ENTRY_FULL)
+            continue;
+
+        size_t j = old[i].hash & (sz - 1);
+
+        while(h->entries[j].state != HASHTABLE_ENTRY_EMPTY)
+            j = (j + 1) & (sz - 1);
+
+        h->entries[j] = old[i];
+    }
+
+    free(old);
+}
@@ -0,0 +1,15 @@
+#ifndef __HASHTABLE_H
+#define __HASHTABLE_H
+
+#include "lisp.h"
+#include "object.h"
+
+unsigned long hash_eq(object_t *);
+unsigned long hash_equal(object_t *);
+
+object_t *hashtable_get(lisp_t *, object_t *, object_t *, int *);
+object_t *hashtable_put(lisp_t *, object_t *, object_t *, object_t *);
+int hashtable_remove(lisp_t *, object_t *, object_t *);
+void hashtable_clear(object_t *);
+
+#endif
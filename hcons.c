@@ -0,0 +1,126 @@
+#include <stdlib.h>
+
+#include "hcons.h"
+#include "hashtable.h"
+#include "builtin.h"
+#include "logger.h"
+
+/* Hash-consing: hcons() returns the one cons of a lisp_t with a given car
+ * and cdr, so lists built from the bottom up with it are shared whenever
+ * they are EQUAL, and EQ tells them apart in O(1). Atoms are compared by
+ * value as with EQ, conses by identity, which is enough as their parts are
+ * canonical already. The cells are shared by everything built from them
+ * and must never be modified. */
+
+static void hcons_grow(lisp_t *);
+static object_t *hcons_spine(lisp_t *, object_t *, int);
+
+static unsigned long hcons_hash(object_t * car, object_t * cdr) {
+    return hash_eq(car) * 0x9e3779b97f4a7c15UL ^ hash_eq(cdr);
+}
+
+static int hcons_same(lisp_t * l, object_t * a, object_t * b) {
+    if(a == b)
+        return 1;
+
+    if((a == NULL) || (b == NULL) || (a->type != b->type))
+        return 0;
+
+    switch (a->type) {
+    case OBJECT_INTEGER:
+    case OBJECT_STRING:
+    case OBJECT_SYMBOL:
+        return eq(l, a, b) != NULL;
+    default:
+        return 0;
+    }
+}
+
+/** Return the canonical cons of car and cdr, creating it if needed. */
+object_t *hcons(lisp_t * l, object_t * car, object_t * cdr) {
+    if(2 * (l->hcons_count + 1) > l->hcons_sz)
+        hcons_grow(l);
+
+    size_t mask = l->hcons_sz - 1;
+
+    for(size_t i = hcons_hash(car, cdr) & mask;; i = (i + 1) & mask) {
+        object_cons_t *c = (object_cons_t *) l->hcons[i];
+
+        if(c == NULL) {
+            l->hcons_count++;
+
+            return l->hcons[i] = object_cons_new(car, cdr);
+        }
+
+        if(hcons_same(l, c->car, car) && hcons_same(l, c->cdr, cdr))
+            return (object_t *) c;
+    }
+}
+
+/** Canonical copy of a list whose elements are canonical already. */
+object_t *hcons_list(lisp_t * l, object_t * list) {
+    return hcons_spine(l, list, 0);
+}
+
+/** Canonical copy of a whole structure. */
+object_t *hcons_tree(lisp_t * l, object_t * o) {
+    return hcons_spine(l, o, 1);
+}
+
+/* the spine is collected into an array and rebuilt from its end, so long
+ * lists do not recurse; only nesting (with deep set) does */
+static object_t *hcons_spine(lisp_t * l, object_t * o, int deep) {
+    size_t n = 0;
+
+    for(object_t * c = o; object_isa(c, OBJECT_CONS); c = cdr(c))
+        n++;
+
+    if(n == 0)
+        return o;
+
+    object_t **items = calloc(n, sizeof(object_t *));
+
+    if(items == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for(size_t i = 0; i < n; i++, o = cdr(o))
+        items[i] = deep ? hcons_spine(l, car(o), 1) : car(o);
+
+    while(n > 0)
+        o = hcons(l, items[--n], o);
+
+    free(items);
+
+    return o;
+}
+
+static void hcons_grow(lisp_t * l) {
+    object_t **old = l->hcons;
+    size_t old_sz = l->hcons_sz;
+
+    l->hcons_sz = old_sz ? old_sz * 2 : 1024;
+    l->hcons = calloc(l->hcons_sz, sizeof(object_t *));
+
+    if(l->hcons == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for(size_t i = 0; i < old_sz; i++) {
+        object_cons_t *c = (object_cons_t *) old[i];
+
+        if(c == NULL)
+            continue;
+
+        size_t j = hcons_hash(c->car, c->cdr) & (l->hcons_sz - 1);
+
+        while(l->hcons[j] != NULL)
+            j = (j + 1) & (l->hcons_sz - 1);
+
+        l->hcons[j] = (object_t *) c;
+    }
+
+    free(old);
+}
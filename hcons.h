@@ -0,0 +1,11 @@
+#ifndef __HCONS_H
+#define __HCONS_H
+
+#include "lisp.h"
+#include "object.h"
+
+object_t *hcons(lisp_t *, object_t *, object_t *);
+object_t *hcons_list(lisp_t *, object_t *);
+object_t *hcons_tree(lisp_t *, object_t *);
+
+#endif
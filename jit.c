@@ -0,0 +1,595 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+#include "compiled.h"
+#include "logger.h"
+
+/* A baseline compiler from lambdas to x86-64 machine code.
+ *
+ * jit_run() counts the calls of each lambda and has jit_compile() translate
+ * the body once it gets hot. The code is stitched together from a fixed
+ * template per kind of node: a parameter is a load from the argument
+ * vector, a constant an immediate, COND a chain of tests and jumps, and a
+ * call evaluates its arguments into slots on the machine stack and hands
+ * them to compiled_call(), see compile.c, which resolves the operator like
+ * lisp_eval() would. Nothing is dispatched on at run time any more.
+ *
+ * CAR, CDR, ATOM and EQ are done in line and CONS and two argument
+ * arithmetic and comparisons by a direct call. That is only right while
+ * these names are bound to the builtins jit_init() found, so each of these
+ * templates first compares l->prim_epoch, which label() bumps whenever a
+ * builtin is rebound, with the epoch the code was made for, and makes the
+ * generic call if they differ. jit_run() drops code made for an older
+ * epoch: the lambda is interpreted again until it is hot again.
+ *
+ * rbx holds l and r12 the argument vector for the whole body, and every
+ * value ends up in rax. */
+
+typedef enum {
+    JIT_CAR,
+    JIT_CDR,
+    JIT_ATOM,
+    JIT_EQ,                     // in line if the same object, else helper
+    JIT_HELPER,
+} jit_op_t;
+
+/** A builtin that compiled code does not call through its name. */
+typedef struct {
+    const char *name;
+    size_t argc;
+    jit_op_t op;
+    object_t *(*helper) (lisp_t *, object_t *, object_t **);
+} jit_prim_t;
+
+static object_t *jit_eq(lisp_t * l, object_t * s, object_t ** argv) {
+    s = s;
+    return eq(l, argv[0], argv[1]);
+}
+
+static object_t *jit_cons(lisp_t * l, object_t * s, object_t ** argv) {
+    l = l;
+    s = s;
+    return cons(argv[0], argv[1]);
+}
+
+#define JIT_ARITH(name, compiled) \
+static object_t *name(lisp_t * l, object_t * s, object_t ** argv) { \
+    return compiled(l, s, argv[0], argv[1]); \
+}
+
+JIT_ARITH(jit_add, compiled_add)
+JIT_ARITH(jit_sub, compiled_sub)
+JIT_ARITH(jit_mul, compiled_mul)
+JIT_ARITH(jit_lt, compiled_lt)
+JIT_ARITH(jit_gt, compiled_gt)
+JIT_ARITH(jit_num_eq, compiled_num_eq)
+JIT_ARITH(jit_le, compiled_le)
+JIT_ARITH(jit_ge, compiled_ge)
+
+static const jit_prim_t prims[] = {
+    {"CAR", 1, JIT_CAR, NULL},
+    {"CDR", 1, JIT_CDR, NULL},
+    {"ATOM", 1, JIT_ATOM, NULL},
+    {"EQ", 2, JIT_EQ, jit_eq},
+    {"CONS", 2, JIT_HELPER, jit_cons},
+    {"+", 2, JIT_HELPER, jit_add},
+    {"-", 2, JIT_HELPER, jit_sub},
+    {"*", 2, JIT_HELPER, jit_mul},
+    {"<", 2, JIT_HELPER, jit_lt},
+    {">", 2, JIT_HELPER, jit_gt},
+    {"=", 2, JIT_HELPER, jit_num_eq},
+    {"<=", 2, JIT_HELPER, jit_le},
+    {">=", 2, JIT_HELPER, jit_ge},
+};
+
+#define JIT_PRIMS (sizeof(prims) / sizeof(prims[0]))
+
+/** Remember the builtins the names in prims are bound to, in order. */
+void jit_init(lisp_t * l) {
+    l->jit_builtins = NULL;
+
+    for(size_t i = JIT_PRIMS; i > 0; i--) {
+        object_t *sym = object_symbol_new((char *) prims[i - 1].name);
+        object_t *pair = lisp_env_resolv(l, l->global, sym);
+
+        l->jit_builtins = cons(car(cdr(pair)), l->jit_builtins);
+    }
+}
+
+/** Run lamb on argv through its machine code, compiling it when it gets
+ *  hot. Return 0 if lamb is to be interpreted instead, else 1 with the
+ *  result in *r. */
+int jit_run(lisp_t * l, object_lambda_t * lamb, size_t argc,
+            object_t ** argv, object_t ** r) {
+    jit_code_t *c = lamb->jit;
+
+    if(!l->jit)
+        return 0;
+
+    /* a builtin was rebound since: the code may still be running further
+     * up the stack, so it is forgotten but not unmapped */
+    if((c != NULL) && (c->epoch != l->prim_epoch)) {
+        lamb->jit = c = NULL;
+        lamb->calls = 0;
+    }
+
+    if(c == NULL) {
+        if((++lamb->calls != JIT_THRESHOLD) || !jit_compile(l, lamb))
+            return 0;
+
+        c = lamb->jit;
+    }
+
+    if(argc != c->argc)
+        return 0;
+
+    *r = c->fn(l, argv);
+
+    return 1;
+}
+
+#if defined(__x86_64__)
+
+typedef struct {
+    lisp_t *l;
+    object_t *params;
+    unsigned epoch;
+    unsigned char *buf;
+    size_t len;
+    size_t sz;
+    int failed;                 // the body has a form we cannot compile
+} jit_t;
+
+#define JZ "\x0F\x84"
+#define JNE "\x0F\x85"
+#define JMP "\xE9"
+
+#define EMIT(j, code) emit(j, code, sizeof(code) - 1)
+#define JUMP(j, op) jit_jump(j, op, sizeof(op) - 1)
+
+/* movabs r11, fn; call r11 */
+#define CALL(j, fn) do { \
+    EMIT(j, "\x49\xBB"); \
+    emit64(j, (uintptr_t) (fn)); \
+    EMIT(j, "\x41\xFF\xD3"); \
+    } while(0)
+
+static void jit_expr(jit_t *, object_t *);
+
+static void emit(jit_t * j, const void *code, size_t n) {
+    if(j->len + n > j->sz) {
+        j->sz = 2 * (j->len + n);
+        j->buf = realloc(j->buf, j->sz);
+
+        if(j->buf == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memcpy(j->buf + j->len, code, n);
+    j->len += n;
+}
+
+static void emit8(jit_t * j, uint8_t v) {
+    emit(j, &v, 1);
+}
+
+static void emit32(jit_t * j, uint32_t v) {
+    emit(j, &v, 4);
+}
+
+static void emit64(jit_t * j, uint64_t v) {
+    emit(j, &v, 8);
+}
+
+/** Emit a jump, returning where its displacement goes for jit_land(). */
+static size_t jit_jump(jit_t * j, const char *op, size_t n) {
+    emit(j, op, n);
+    emit32(j, 0);
+
+    return j->len - 4;
+}
+
+/** Make the jump whose displacement is at at go to the current end. */
+static void jit_land(jit_t * j, size_t at) {
+    uint32_t rel = j->len - (at + 4);
+
+    memcpy(j->buf + at, &rel, 4);
+}
+
+static int jit_is(object_t * o, const char *name) {
+    return object_isa(o, OBJECT_SYMBOL)
+        && !strcmp(((object_symbol_t *) o)->name, name);
+}
+
+static int jit_param(jit_t * j, object_t * sym) {
+    int i = 0;
+
+    for(object_t * p = j->params; p != NULL; p = cdr(p), i++) {
+        if(eq(j->l, car(p), sym))
+            return i;
+    }
+
+    return -1;
+}
+
+/** The entry in prims for op, if op is still bound to that builtin. */
+static const jit_prim_t *jit_prim(jit_t * j, object_t * op) {
+    object_t *fn = car(cdr(lisp_env_resolv(j->l, j->l->global, op)));
+    object_t *b = j->l->jit_builtins;
+
+    for(size_t i = 0; i < JIT_PRIMS; i++, b = cdr(b)) {
+        if(jit_is(op, prims[i].name))
+            return (fn != NULL) && (car(b) == fn) ? &prims[i] : NULL;
+    }
+
+    return NULL;
+}
+
+static void jit_constant(jit_t * j, object_t * x) {
+    if(x == NULL) {
+        EMIT(j, "\x31\xC0");    // xor eax, eax
+        return;
+    }
+
+    EMIT(j, "\x48\xB8");        // movabs rax, x
+    emit64(j, (uintptr_t) x);
+}
+
+static void jit_symbol(jit_t * j, object_t * x) {
+    int i;
+
+    if(jit_is(x, "T")) {
+        EMIT(j, "\x48\x8B\x83");        // mov rax, [rbx + t]
+        emit32(j, offsetof(lisp_t, t));
+    }
+    else if((i = jit_param(j, x)) >= 0) {
+        EMIT(j, "\x49\x8B\x84\x24");    // mov rax, [r12 + 8i]
+        emit32(j, 8 * i);
+    }
+    else if(jit_is(x, "NIL"))
+        jit_constant(j, NULL);
+    else {
+        EMIT(j, "\x48\x89\xDF\x48\xBE");        // mov rdi, rbx; movabs rsi, x
+        emit64(j, (uintptr_t) x);
+        CALL(j, compiled_global);
+    }
+}
+
+/** Evaluate args into slots at rsp. An even number of slots is reserved,
+ *  to keep rsp aligned for calls; return it for jit_release(). */
+static size_t jit_args(jit_t * j, object_t * args, size_t *argc) {
+    size_t n = 0;
+
+    for(object_t * a = args; a != NULL; a = cdr(a))
+        n++;
+
+    size_t slots = (n + 1) & ~(size_t) 1;
+
+    if(slots > 0) {
+        EMIT(j, "\x48\x81\xEC");        // sub rsp, 8 * slots
+        emit32(j, 8 * slots);
+    }
+
+    for(size_t i = 0; i < n; i++, args = cdr(args)) {
+        jit_expr(j, car(args));
+        EMIT(j, "\x48\x89\x84\x24");    // mov [rsp + 8i], rax
+        emit32(j, 8 * i);
+    }
+
+    *argc = n;
+
+    return slots;
+}
+
+static void jit_release(jit_t * j, size_t slots) {
+    if(slots > 0) {
+        EMIT(j, "\x48\x81\xC4");        // add rsp, 8 * slots
+        emit32(j, 8 * slots);
+    }
+}
+
+/** Call fn(l, rsi, argc, argv) on the slots, rsi being set already. */
+static void jit_generic(jit_t * j, size_t argc, void *fn) {
+    EMIT(j, "\x48\x89\xDF\xBA");        // mov rdi, rbx; mov edx, argc
+    emit32(j, argc);
+    EMIT(j, "\x48\x89\xE1");    // mov rcx, rsp
+    CALL(j, fn);
+}
+
+/** Emit the template of prim, called as op on the slots. */
+static void jit_open(jit_t * j, const jit_prim_t * prim, object_t * op) {
+    size_t done[3], nd = 0, other, nil;
+
+    EMIT(j, "\x81\xBB");        // cmp dword [rbx + prim_epoch], epoch
+    emit32(j, offsetof(lisp_t, prim_epoch));
+    emit32(j, j->epoch);
+
+    size_t slow = JUMP(j, JNE);
+
+    switch (prim->op) {
+    case JIT_CAR:
+    case JIT_CDR:
+        EMIT(j, "\x48\x8B\x04\x24\x48\x85\xC0");        // mov rax, [rsp]; test
+        done[nd++] = JUMP(j, JZ);
+        EMIT(j, "\x83\x38");    // cmp dword [rax], OBJECT_CONS
+        emit8(j, OBJECT_CONS);
+        other = JUMP(j, JNE);
+        EMIT(j, "\x48\x8B\x40");        // mov rax, [rax + car or cdr]
+        emit8(j, prim->op == JIT_CAR ? offsetof(object_cons_t, car)
+              : offsetof(object_cons_t, cdr));
+        done[nd++] = JUMP(j, JMP);
+        jit_land(j, other);
+        jit_constant(j, NULL);
+        done[nd++] = JUMP(j, JMP);
+        break;
+    case JIT_ATOM:
+        EMIT(j, "\x48\x8B\x04\x24\x48\x85\xC0");        // mov rax, [rsp]; test
+        nil = JUMP(j, JZ);
+        EMIT(j, "\x83\x38");    // cmp dword [rax], OBJECT_CONS
+        emit8(j, OBJECT_CONS);
+        other = JUMP(j, JNE);
+        jit_constant(j, NULL);
+        done[nd++] = JUMP(j, JMP);
+        jit_land(j, nil);
+        jit_land(j, other);
+        EMIT(j, "\x48\x8B\x83");        // mov rax, [rbx + t]
+        emit32(j, offsetof(lisp_t, t));
+        done[nd++] = JUMP(j, JMP);
+        break;
+    case JIT_EQ:
+        EMIT(j, "\x48\x8B\x04\x24");    // mov rax, [rsp]
+        EMIT(j, "\x48\x3B\x44\x24\x08");        // cmp rax, [rsp + 8]
+        other = JUMP(j, JNE);
+        EMIT(j, "\x48\x8B\x83");        // mov rax, [rbx + t]
+        emit32(j, offsetof(lisp_t, t));
+        done[nd++] = JUMP(j, JMP);
+        jit_land(j, other);
+        /* FALLTHROUGH */
+    case JIT_HELPER:
+        EMIT(j, "\x48\x89\xDF\x48\xBE");        // mov rdi, rbx; movabs rsi, op
+        emit64(j, (uintptr_t) op);
+        EMIT(j, "\x48\x89\xE2");        // mov rdx, rsp
+        CALL(j, prim->helper);
+        done[nd++] = JUMP(j, JMP);
+        break;
+    }
+
+    jit_land(j, slow);
+    EMIT(j, "\x48\xBE");        // movabs rsi, op
+    emit64(j, (uintptr_t) op);
+    jit_generic(j, prim->argc, compiled_call);
+
+    while(nd > 0)
+        jit_land(j, done[--nd]);
+}
+
+/** The call x of what the symbol op names, as lisp_eval() would make it. */
+static void jit_call(jit_t * j, object_t * x) {
+    object_t *op = car(x), *args = cdr(x);
+    int p = jit_param(j, op);
+    const jit_prim_t *prim = NULL;
+    size_t argc, done = 0, nil, other;
+
+    if(p < 0) {
+        object_t *fn = car(cdr(lisp_env_resolv(j->l, j->l->global, op)));
+
+        /* macros expand the forms, EVAL would need the frame */
+        if(object_isa(fn, OBJECT_MACRO) || jit_is(op, "EVAL")) {
+            j->failed = 1;
+            return;
+        }
+
+        prim = jit_prim(j, op);
+    }
+    else {
+        /* a parameter holding a macro has the call interpreted, as the
+         * macro expands the argument forms */
+        EMIT(j, "\x49\x8B\x84\x24");    // mov rax, [r12 + 8p]
+        emit32(j, 8 * p);
+        EMIT(j, "\x48\x85\xC0");        // test rax, rax
+        nil = JUMP(j, JZ);
+        EMIT(j, "\x83\x38");    // cmp dword [rax], OBJECT_MACRO
+        emit8(j, OBJECT_MACRO);
+        other = JUMP(j, JNE);
+        EMIT(j, "\x48\x89\xDF\x48\xBE");        // mov rdi, rbx; movabs rsi, x
+        emit64(j, (uintptr_t) x);
+        EMIT(j, "\x48\xBA");    // movabs rdx, params
+        emit64(j, (uintptr_t) j->params);
+        EMIT(j, "\x4C\x89\xE1");    // mov rcx, r12
+        CALL(j, compiled_eval);
+        done = JUMP(j, JMP);
+        jit_land(j, nil);
+        jit_land(j, other);
+    }
+
+    size_t slots = jit_args(j, args, &argc);
+
+    if(p >= 0) {
+        EMIT(j, "\x49\x8B\xB4\x24");    // mov rsi, [r12 + 8p]
+        emit32(j, 8 * p);
+        jit_generic(j, argc, lisp_call);
+    }
+    else if((prim != NULL) && (prim->argc == argc))
+        jit_open(j, prim, op);
+    else {
+        EMIT(j, "\x48\xBE");    // movabs rsi, op
+        emit64(j, (uintptr_t) op);
+        jit_generic(j, argc, compiled_call);
+    }
+
+    jit_release(j, slots);
+
+    if(p >= 0)
+        jit_land(j, done);
+}
+
+static void jit_cond(jit_t * j, object_t * clauses) {
+    size_t n = 0;
+
+    for(object_t * cl = clauses; cl != NULL; cl = cdr(cl))
+        n++;
+
+    size_t done[n ? n : 1];
+
+    for(size_t i = 0; i < n; i++, clauses = cdr(clauses)) {
+        jit_expr(j, car(car(clauses)));
+        EMIT(j, "\x48\x85\xC0");        // test rax, rax
+
+        size_t next = JUMP(j, JZ);
+
+        jit_expr(j, car(cdr(car(clauses))));
+        done[i] = JUMP(j, JMP);
+        jit_land(j, next);
+    }
+
+    jit_constant(j, NULL);
+
+    for(size_t i = 0; i < n; i++)
+        jit_land(j, done[i]);
+}
+
+static void jit_form(jit_t * j, object_t * x) {
+    object_t *op = car(x);
+
+    if(jit_is(op, "INLINE"))
+        jit_expr(j, car(cdr(cdr(x))));  // the call, see evinline()
+    else if(jit_is(op, "QUOTE"))
+        jit_constant(j, car(cdr(x)));
+    else if(jit_is(op, "COND"))
+        jit_cond(j, cdr(x));
+    else if(jit_is(op, "PRINT") || jit_is(op, "ERROR")) {
+        jit_expr(j, car(cdr(x)));
+        EMIT(j, "\x48\x89\xC6\x48\x89\xDF");    // mov rsi, rax; mov rdi, rbx
+
+        if(jit_is(op, "PRINT"))
+            CALL(j, lisp_print);
+        else
+            CALL(j, lisp_error);
+    }
+    else if(jit_is(op, "LAMBDA") || jit_is(op, "MACRO")
+            || jit_is(op, "LABEL") || jit_is(op, "LOOP")
+            || jit_is(op, "READ") || jit_is(op, "DEFSTRUCT"))
+        j->failed = 1;
+    else if(object_isa(op, OBJECT_SYMBOL))
+        jit_call(j, x);
+    else if(object_isa(op, OBJECT_FUNCTION) || object_isa(op, OBJECT_LAMBDA)) {
+        size_t argc, slots = jit_args(j, cdr(x), &argc);
+
+        EMIT(j, "\x48\xBE");    // movabs rsi, op
+        emit64(j, (uintptr_t) op);
+        jit_generic(j, argc, lisp_call);
+        jit_release(j, slots);
+    }
+    else
+        j->failed = 1;
+}
+
+static void jit_expr(jit_t * j, object_t * x) {
+    if(x == NULL) {
+        jit_constant(j, NULL);
+        return;
+    }
+
+    switch (x->type) {
+    case OBJECT_SYMBOL:
+        jit_symbol(j, x);
+        return;
+    case OBJECT_CONS:
+        jit_form(j, x);
+        return;
+    case OBJECT_INTEGER:
+    case OBJECT_STRING:
+    case OBJECT_VECTOR:
+    case OBJECT_HASHTABLE:
+    case OBJECT_ARRAY:
+    case OBJECT_MAP:
+    case OBJECT_STRUCT:
+    case OBJECT_LAZY:
+    case OBJECT_TRANSDUCER:
+        jit_constant(j, x);
+        return;
+    case OBJECT_ERROR:
+    case OBJECT_FUNCTION:
+    case OBJECT_LAMBDA:
+    case OBJECT_MACRO:
+    case OBJECT_STREAM:
+        j->failed = 1;          // lisp_eval() would panic
+        return;
+    }
+}
+
+/** Translate lamb into machine code, return 0 if its body has forms that
+ *  are only interpreted, see jit_form(). */
+int jit_compile(lisp_t * l, object_lambda_t * lamb) {
+    jit_t j = {.l = l,.params = lamb->args,.epoch = l->prim_epoch };
+    size_t argc = 0;
+
+    if(lamb->closed != NULL)
+        return 0;
+
+    for(object_t * p = lamb->args; p != NULL; p = cdr(p), argc++) {
+        if(!object_isa(p, OBJECT_CONS) || !object_isa(car(p), OBJECT_SYMBOL))
+            return 0;
+    }
+
+    /* push rbp; mov rbp, rsp; push rbx; push r12; mov rbx, rdi; mov r12, rsi */
+    EMIT(&j, "\x55\x48\x89\xE5\x53\x41\x54\x48\x89\xFB\x49\x89\xF4");
+    jit_expr(&j, lamb->expr);
+    EMIT(&j, "\x41\x5C\x5B\x5D\xC3");   // pop r12; pop rbx; pop rbp; ret
+
+    void *code = MAP_FAILED;
+
+    if(!j.failed)
+        code = mmap(NULL, j.len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(code != MAP_FAILED) {
+        memcpy(code, j.buf, j.len);
+
+        if(mprotect(code, j.len, PROT_READ | PROT_EXEC)) {
+            munmap(code, j.len);
+            code = MAP_FAILED;
+        }
+    }
+
+    free(j.buf);
+
+    if(code == MAP_FAILED)
+        return 0;
+
+    jit_code_t *c = calloc(1, sizeof(jit_code_t));
+
+    if(c == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    c->fn = (jit_fn_t) code;
+    c->sz = j.len;
+    c->argc = argc;
+    c->epoch = j.epoch;
+
+    lamb->jit = c;
+
+    return 1;
+}
+
+#else
+
+int jit_compile(lisp_t * l, object_lambda_t * lamb) {
+    l = l;
+    lamb = lamb;
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef __JIT_H
+#define __JIT_H
+
+#include "lisp.h"
+#include "object.h"
+
+#define JIT_THRESHOLD 100       // calls before a lambda is compiled
+
+typedef struct jit_code_t jit_code_t;
+typedef object_t *(*jit_fn_t) (lisp_t *, object_t **);
+
+/** Machine code made for a lambda, see jit_compile(). */
+struct jit_code_t {
+    jit_fn_t fn;                // called with the argument vector
+    size_t sz;                  // bytes mapped at fn
+    size_t argc;
+    unsigned epoch;             // l->prim_epoch the code was made for
+};
+
+void jit_init(lisp_t *);
+int jit_compile(lisp_t *, object_lambda_t *);
+int jit_run(lisp_t *, object_lambda_t *, size_t, object_t **, object_t **);
+
+#endif
@@ -0,0 +1,627 @@
+#include "kernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNEL_X86
+#include <immintrin.h>
+#endif
+
+static const kernel_ops_t *kernel_impl = NULL;
+
+/** Return the loops for the widest instruction set the CPU supports.
+ *
+ *  The choice is made on first use. Operations without a useful vector
+ *  form on a given instruction set (64 bit multiplies, 64 bit compares
+ *  before AVX2) keep the scalar loop in its table.
+ */
+const kernel_ops_t *kernel_ops(void) {
+    if(kernel_impl == NULL)
+        kernel_select(kernel_best());
+
+    return kernel_impl;
+}
+
+/* scalar loops, also used for the tails of the vector ones; the unsigned
+ * casts make wrapping around well-defined */
+
+static void add_i32_scalar(int32_t * r, const int32_t * a, const int32_t * b,
+                           size_t n) {
+    for(size_t i = 0; i < n; i++)
+        r[i] = (int32_t) ((uint32_t) a[i] + (uint32_t) b[i]);
+}
+
+static void mul_i32_scalar(int32_t * r, const int32_t * a, const int32_t * b,
+                           size_t n) {
+    for(size_t i = 0; i < n; i++)
+        r[i] = (int32_t) ((uint32_t) a[i] * (uint32_t) b[i]);
+}
+
+static int64_t sum_i32_scalar(const int32_t * a, size_t n) {
+    uint64_t s = 0;
+
+    for(size_t i = 0; i < n; i++)
+        s += (uint64_t) (int64_t) a[i];
+
+    return (int64_t) s;
+}
+
+static int32_t min_i32_scalar(const int32_t * a, size_t n) {
+    int32_t m = a[0];
+
+    for(size_t i = 1; i < n; i++) {
+        if(a[i] < m)
+            m = a[i];
+    }
+
+    return m;
+}
+
+static int32_t max_i32_scalar(const int32_t * a, size_t n) {
+    int32_t m = a[0];
+
+    for(size_t i = 1; i < n; i++) {
+        if(a[i] > m)
+            m = a[i];
+    }
+
+    return m;
+}
+
+static int64_t dot_i32_scalar(const int32_t * a, const int32_t * b, size_t n) {
+    uint64_t s = 0;
+
+    for(size_t i = 0; i < n; i++)
+        s += (uint64_t) ((int64_t) a[i] * b[i]);
+
+    return (int64_t) s;
+}
+
+static void prefix_sum_i32_scalar(int32_t * r, const int32_t * a, size_t n) {
+    uint32_t s = 0;
+
+    for(size_t i = 0; i < n; i++)
+        r[i] = (int32_t) (s += (uint32_t) a[i]);
+}
+
+static void add_i64_scalar(int64_t * r, const int64_t * a, const int64_t * b,
+                           size_t n) {
+    for(size_t i = 0; i < n; i++)
+        r[i] = (int64_t) ((uint64_t) a[i] + (uint64_t) b[i]);
+}
+
+static void mul_i64_scalar(int64_t * r, const int64_t * a, const int64_t * b,
+                           size_t n) {
+    for(size_t i = 0; i < n; i++)
+        r[i] = (int64_t) ((uint64_t) a[i] * (uint64_t) b[i]);
+}
+
+static int64_t sum_i64_scalar(const int64_t * a, size_t n) {
+    uint64_t s = 0;
+
+    for(size_t i = 0; i < n; i++)
+        s += (uint64_t) a[i];
+
+    return (int64_t) s;
+}
+
+static int64_t min_i64_scalar(const int64_t * a, size_t n) {
+    int64_t m = a[0];
+
+    for(size_t i = 1; i < n; i++) {
+        if(a[i] < m)
+            m = a[i];
+    }
+
+    return m;
+}
+
+static int64_t max_i64_scalar(const int64_t * a, size_t n) {
+    int64_t m = a[0];
+
+    for(size_t i = 1; i < n; i++) {
+        if(a[i] > m)
+            m = a[i];
+    }
+
+    return m;
+}
+
+static int64_t dot_i64_scalar(const int64_t * a, const int64_t * b, size_t n) {
+    uint64_t s = 0;
+
+    for(size_t i = 0; i < n; i++)
+        s += (uint64_t) a[i] * (uint64_t) b[i];
+
+    return (int64_t) s;
+}
+
+static void prefix_sum_i64_scalar(int64_t * r, const int64_t * a, size_t n) {
+    uint64_t s = 0;
+
+    for(size_t i = 0; i < n; i++)
+        r[i] = (int64_t) (s += (uint64_t) a[i]);
+}
+
+static const kernel_ops_t kernel_scalar = {
+    .add_i32 = add_i32_scalar,
+    .mul_i32 = mul_i32_scalar,
+    .sum_i32 = sum_i32_scalar,
+    .min_i32 = min_i32_scalar,
+    .max_i32 = max_i32_scalar,
+    .dot_i32 = dot_i32_scalar,
+    .prefix_sum_i32 = prefix_sum_i32_scalar,
+    .add_i64 = add_i64_scalar,
+    .mul_i64 = mul_i64_scalar,
+    .sum_i64 = sum_i64_scalar,
+    .min_i64 = min_i64_scalar,
+    .max_i64 = max_i64_scalar,
+    .dot_i64 = dot_i64_scalar,
+    .prefix_sum_i64 = prefix_sum_i64_scalar,
+};
+
+#ifdef KERNEL_X86
+
+#define LOAD128(p) _mm_loadu_si128((const __m128i *) (p))
+#define LOAD256(p) _mm256_loadu_si256((const __m256i *) (p))
+
+__attribute__ ((target("sse4.1")))
+static int64_t hsum_i64_sse41(__m128i v) {
+    int64_t t[2];
+
+    _mm_storeu_si128((__m128i *) t, v);
+
+    return (int64_t) ((uint64_t) t[0] + (uint64_t) t[1]);
+}
+
+__attribute__ ((target("sse4.1")))
+static void add_i32_sse41(int32_t * r, const int32_t * a, const int32_t * b,
+                          size_t n) {
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+        _mm_storeu_si128((__m128i *) (r + i),
+                         _mm_add_epi32(LOAD128(a + i), LOAD128(b + i)));
+
+    add_i32_scalar(r + i, a + i, b + i, n - i);
+}
+
+__attribute__ ((target("sse4.1")))
+static void mul_i32_sse41(int32_t * r, const int32_t * a, const int32_t * b,
+                          size_t n) {
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+        _mm_storeu_si128((__m128i *) (r + i),
+                         _mm_mullo_epi32(LOAD128(a + i), LOAD128(b + i)));
+
+    mul_i32_scalar(r + i, a + i, b + i, n - i);
+}
+
+__attribute__ ((target("sse4.1")))
+static int64_t sum_i32_sse41(const int32_t * a, size_t n) {
+    __m128i s = _mm_setzero_si128();
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4) {
+        __m128i x = LOAD128(a + i);
+
+        s = _mm_add_epi64(s, _mm_cvtepi32_epi64(x));
+        s = _mm_add_epi64(s, _mm_cvtepi32_epi64(_mm_srli_si128(x, 8)));
+    }
+
+    return (int64_t) ((uint64_t) hsum_i64_sse41(s) +
+                      (uint64_t) sum_i32_scalar(a + i, n - i));
+}
+
+__attribute__ ((target("sse4.1")))
+static int32_t min_i32_sse41(const int32_t * a, size_t n) {
+    if(n < 4)
+        return min_i32_scalar(a, n);
+
+    __m128i m = LOAD128(a);
+    int32_t t[4];
+    size_t i = 4;
+
+    for(; i + 4 <= n; i += 4)
+        m = _mm_min_epi32(m, LOAD128(a + i));
+
+    _mm_storeu_si128((__m128i *) t, m);
+
+    int32_t r = min_i32_scalar(t, 4);
+
+    for(; i < n; i++) {
+        if(a[i] < r)
+            r = a[i];
+    }
+
+    return r;
+}
+
+__attribute__ ((target("sse4.1")))
+static int32_t max_i32_sse41(const int32_t * a, size_t n) {
+    if(n < 4)
+        return max_i32_scalar(a, n);
+
+    __m128i m = LOAD128(a);
+    int32_t t[4];
+    size_t i = 4;
+
+    for(; i + 4 <= n; i += 4)
+        m = _mm_max_epi32(m, LOAD128(a + i));
+
+    _mm_storeu_si128((__m128i *) t, m);
+
+    int32_t r = max_i32_scalar(t, 4);
+
+    for(; i < n; i++) {
+        if(a[i] > r)
+            r = a[i];
+    }
+
+    return r;
+}
+
+/* _mm_mul_epi32 multiplies the even lanes into 64 bit products, shifting
+ * each 64 bit lane right by 32 brings the odd lanes into position */
+__attribute__ ((target("sse4.1")))
+static int64_t dot_i32_sse41(const int32_t * a, const int32_t * b, size_t n) {
+    __m128i s = _mm_setzero_si128();
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4) {
+        __m128i x = LOAD128(a + i);
+        __m128i y = LOAD128(b + i);
+
+        s = _mm_add_epi64(s, _mm_mul_epi32(x, y));
+        s = _mm_add_epi64(s, _mm_mul_epi32(_mm_srli_epi64(x, 32),
+                                           _mm_srli_epi64(y, 32)));
+    }
+
+    return (int64_t) ((uint64_t) hsum_i64_sse41(s) +
+                      (uint64_t) dot_i32_scalar(a + i, b + i, n - i));
+}
+
+/* in-register scan: add the vector shifted by one and then two lanes, plus
+ * the running total broadcast from the previous block's last lane */
+__attribute__ ((target("sse4.1")))
+static void prefix_sum_i32_sse41(int32_t * r, const int32_t * a, size_t n) {
+    __m128i carry = _mm_setzero_si128();
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4) {
+        __m128i x = LOAD128(a + i);
+
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi32(x, carry);
+
+        _mm_storeu_si128((__m128i *) (r + i), x);
+
+        carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+
+    uint32_t s = (uint32_t) _mm_cvtsi128_si32(carry);
+
+    for(; i < n; i++)
+        r[i] = (int32_t) (s += (uint32_t) a[i]);
+}
+
+__attribute__ ((target("sse4.1")))
+static void add_i64_sse41(int64_t * r, const int64_t * a, const int64_t * b,
+                          size_t n) {
+    size_t i = 0;
+
+    for(; i + 2 <= n; i += 2)
+        _mm_storeu_si128((__m128i *) (r + i),
+                         _mm_add_epi64(LOAD128(a + i), LOAD128(b + i)));
+
+    add_i64_scalar(r + i, a + i, b + i, n - i);
+}
+
+__attribute__ ((target("sse4.1")))
+static int64_t sum_i64_sse41(const int64_t * a, size_t n) {
+    __m128i s = _mm_setzero_si128();
+    size_t i = 0;
+
+    for(; i + 2 <= n; i += 2)
+        s = _mm_add_epi64(s, LOAD128(a + i));
+
+    return (int64_t) ((uint64_t) hsum_i64_sse41(s) +
+                      (uint64_t) sum_i64_scalar(a + i, n - i));
+}
+
+__attribute__ ((target("sse4.1")))
+static void prefix_sum_i64_sse41(int64_t * r, const int64_t * a, size_t n) {
+    __m128i carry = _mm_setzero_si128();
+    int64_t t[2] = { 0, 0 };
+    size_t i = 0;
+
+    for(; i + 2 <= n; i += 2) {
+        __m128i x = LOAD128(a + i);
+
+        x = _mm_add_epi64(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi64(x, carry);
+
+        _mm_storeu_si128((__m128i *) (r + i), x);
+
+        carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 2, 3, 2));
+    }
+
+    _mm_storeu_si128((__m128i *) t, carry);
+
+    uint64_t s = (uint64_t) t[0];
+
+    for(; i < n; i++)
+        r[i] = (int64_t) (s += (uint64_t) a[i]);
+}
+
+static const kernel_ops_t kernel_sse41 = {
+    .add_i32 = add_i32_sse41,
+    .mul_i32 = mul_i32_sse41,
+    .sum_i32 = sum_i32_sse41,
+    .min_i32 = min_i32_sse41,
+    .max_i32 = max_i32_sse41,
+    .dot_i32 = dot_i32_sse41,
+    .prefix_sum_i32 = prefix_sum_i32_sse41,
+    .add_i64 = add_i64_sse41,
+    .mul_i64 = mul_i64_scalar,
+    .sum_i64 = sum_i64_sse41,
+    .min_i64 = min_i64_scalar,
+    .max_i64 = max_i64_scalar,
+    .dot_i64 = dot_i64_scalar,
+    .prefix_sum_i64 = prefix_sum_i64_sse41,
+};
+
+__attribute__ ((target("avx2")))
+static int64_t hsum_i64_avx2(__m256i v) {
+    int64_t t[4];
+
+    _mm256_storeu_si256((__m256i *) t, v);
+
+    return (int64_t) ((uint64_t) t[0] + (uint64_t) t[1] +
+                      (uint64_t) t[2] + (uint64_t) t[3]);
+}
+
+__attribute__ ((target("avx2")))
+static void add_i32_avx2(int32_t * r, const int32_t * a, const int32_t * b,
+                         size_t n) {
+    size_t i = 0;
+
+    for(; i + 8 <= n; i += 8)
+        _mm256_storeu_si256((__m256i *) (r + i),
+                            _mm256_add_epi32(LOAD256(a + i), LOAD256(b + i)));
+
+    add_i32_scalar(r + i, a + i, b + i, n - i);
+}
+
+__attribute__ ((target("avx2")))
+static void mul_i32_avx2(int32_t * r, const int32_t * a, const int32_t * b,
+                         size_t n) {
+    size_t i = 0;
+
+    for(; i + 8 <= n; i += 8)
+        _mm256_storeu_si256((__m256i *) (r + i),
+                            _mm256_mullo_epi32(LOAD256(a + i),
+                                               LOAD256(b + i)));
+
+    mul_i32_scalar(r + i, a + i, b + i, n - i);
+}
+
+__attribute__ ((target("avx2")))
+static int64_t sum_i32_avx2(const int32_t * a, size_t n) {
+    __m256i s = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for(; i + 8 <= n; i += 8) {
+        __m256i x = LOAD256(a + i);
+
+        s = _mm256_add_epi64(s,
+                             _mm256_cvtepi32_epi64(_mm256_castsi256_si128
+                                                   (x)));
+        s = _mm256_add_epi64(s,
+                             _mm256_cvtepi32_epi64(_mm256_extracti128_si256
+                                                   (x, 1)));
+    }
+
+    return (int64_t) ((uint64_t) hsum_i64_avx2(s) +
+                      (uint64_t) sum_i32_scalar(a + i, n - i));
+}
+
+__attribute__ ((target("avx2")))
+static int32_t min_i32_avx2(const int32_t * a, size_t n) {
+    if(n < 8)
+        return min_i32_scalar(a, n);
+
+    __m256i m = LOAD256(a);
+    int32_t t[8];
+    size_t i = 8;
+
+    for(; i + 8 <= n; i += 8)
+        m = _mm256_min_epi32(m, LOAD256(a + i));
+
+    _mm256_storeu_si256((__m256i *) t, m);
+
+    int32_t r = min_i32_scalar(t, 8);
+
+    for(; i < n; i++) {
+        if(a[i] < r)
+            r = a[i];
+    }
+
+    return r;
+}
+
+__attribute__ ((target("avx2")))
+static int32_t max_i32_avx2(const int32_t * a, size_t n) {
+    if(n < 8)
+        return max_i32_scalar(a, n);
+
+    __m256i m = LOAD256(a);
+    int32_t t[8];
+    size_t i = 8;
+
+    for(; i + 8 <= n; i += 8)
+        m = _mm256_max_epi32(m, LOAD256(a + i));
+
+    _mm256_storeu_si256((__m256i *) t, m);
+
+    int32_t r = max_i32_scalar(t, 8);
+
+    for(; i < n; i++) {
+        if(a[i] > r)
+            r = a[i];
+    }
+
+    return r;
+}
+
+__attribute__ ((target("avx2")))
+static int64_t dot_i32_avx2(const int32_t * a, const int32_t * b, size_t n) {
+    __m256i s = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for(; i + 8 <= n; i += 8) {
+        __m256i x = LOAD256(a + i);
+        __m256i y = LOAD256(b + i);
+
+        s = _mm256_add_epi64(s, _mm256_mul_epi32(x, y));
+        s = _mm256_add_epi64(s, _mm256_mul_epi32(_mm256_srli_epi64(x, 32),
+                                                 _mm256_srli_epi64(y, 32)));
+    }
+
+    return (int64_t) ((uint64_t) hsum_i64_avx2(s) +
+                      (uint64_t) dot_i32_scalar(a + i, b + i, n - i));
+}
+
+__attribute__ ((target("avx2")))
+static void add_i64_avx2(int64_t * r, const int64_t * a, const int64_t * b,
+                         size_t n) {
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+        _mm256_storeu_si256((__m256i *) (r + i),
+                            _mm256_add_epi64(LOAD256(a + i), LOAD256(b + i)));
+
+    add_i64_scalar(r + i, a + i, b + i, n - i);
+}
+
+__attribute__ ((target("avx2")))
+static int64_t sum_i64_avx2(const int64_t * a, size_t n) {
+    __m256i s = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+        s = _mm256_add_epi64(s, LOAD256(a + i));
+
+    return (int64_t) ((uint64_t) hsum_i64_avx2(s) +
+                      (uint64_t) sum_i64_scalar(a + i, n - i));
+}
+
+__attribute__ ((target("avx2")))
+static int64_t min_i64_avx2(const int64_t * a, size_t n) {
+    if(n < 4)
+        return min_i64_scalar(a, n);
+
+    __m256i m = LOAD256(a);
+    int64_t t[4];
+    size_t i = 4;
+
+    for(; i + 4 <= n; i += 4) {
+        __m256i x = LOAD256(a + i);
+
+        m = _mm256_blendv_epi8(m, x, _mm256_cmpgt_epi64(m, x));
+    }
+
+    _mm256_storeu_si256((__m256i *) t, m);
+
+    int64_t r = min_i64_scalar(t, 4);
+
+    for(; i < n; i++) {
+        if(a[i] < r)
+            r = a[i];
+    }
+
+    return r;
+}
+
+__attribute__ ((target("avx2")))
+static int64_t max_i64_avx2(const int64_t * a, size_t n) {
+    if(n < 4)
+        return max_i64_scalar(a, n);
+
+    __m256i m = LOAD256(a);
+    int64_t t[4];
+    size_t i = 4;
+
+    for(; i + 4 <= n; i += 4) {
+        __m256i x = LOAD256(a + i);
+
+        m = _mm256_blendv_epi8(m, x, _mm256_cmpgt_epi64(x, m));
+    }
+
+    _mm256_storeu_si256((__m256i *) t, m);
+
+    int64_t r = max_i64_scalar(t, 4);
+
+    for(; i < n; i++) {
+        if(a[i] > r)
+            r = a[i];
+    }
+
+    return r;
+}
+
+/* the scans are latency bound on the carry, 256 bit registers would only
+ * add lane crossing shuffles; AVX2 reuses the SSE4.1 loops for them */
+static const kernel_ops_t kernel_avx2 = {
+    .add_i32 = add_i32_avx2,
+    .mul_i32 = mul_i32_avx2,
+    .sum_i32 = sum_i32_avx2,
+    .min_i32 = min_i32_avx2,
+    .max_i32 = max_i32_avx2,
+    .dot_i32 = dot_i32_avx2,
+    .prefix_sum_i32 = prefix_sum_i32_sse41,
+    .add_i64 = add_i64_avx2,
+    .mul_i64 = mul_i64_scalar,
+    .sum_i64 = sum_i64_avx2,
+    .min_i64 = min_i64_avx2,
+    .max_i64 = max_i64_avx2,
+    .dot_i64 = dot_i64_scalar,
+    .prefix_sum_i64 = prefix_sum_i64_sse41,
+};
+
+#endif // KERNEL_X86
+
+/** Return the widest instruction set the running CPU supports. */
+kernel_isa_t kernel_best(void) {
+#ifdef KERNEL_X86
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("avx2"))
+        return KERNEL_AVX2;
+
+    if(__builtin_cpu_supports("sse4.1"))
+        return KERNEL_SSE41;
+#endif
+
+    return KERNEL_SCALAR;
+}
+
+/** Force an instruction set, e.g. to benchmark against the scalar code. */
+void kernel_select(kernel_isa_t isa) {
+    switch (isa) {
+#ifdef KERNEL_X86
+    case KERNEL_AVX2:
+        kernel_impl = &kernel_avx2;
+        return;
+    case KERNEL_SSE41:
+        kernel_impl = &kernel_sse41;
+        return;
+#else
+    case KERNEL_AVX2:
+    case KERNEL_SSE41:
+#endif
+    case KERNEL_SCALAR:
+        kernel_impl = &kernel_scalar;
+        return;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef __KERNEL_H
+#define __KERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    KERNEL_SCALAR,
+    KERNEL_SSE41,
+    KERNEL_AVX2,
+} kernel_isa_t;
+
+/** Loops over unboxed integer arrays, one table per instruction set.
+ *
+ *  Element-wise results wrap around like C unsigned arithmetic. Sums and
+ *  dot products of INT32 data are accumulated in 64 bits. min and max
+ *  must not be called with n == 0.
+ */
+typedef struct {
+    void (*add_i32) (int32_t *, const int32_t *, const int32_t *, size_t);
+    void (*mul_i32) (int32_t *, const int32_t *, const int32_t *, size_t);
+    int64_t(*sum_i32) (const int32_t *, size_t);
+    int32_t(*min_i32) (const int32_t *, size_t);
+    int32_t(*max_i32) (const int32_t *, size_t);
+    int64_t(*dot_i32) (const int32_t *, const int32_t *, size_t);
+    void (*prefix_sum_i32) (int32_t *, const int32_t *, size_t);
+
+    void (*add_i64) (int64_t *, const int64_t *, const int64_t *, size_t);
+    void (*mul_i64) (int64_t *, const int64_t *, const int64_t *, size_t);
+    int64_t(*sum_i64) (const int64_t *, size_t);
+    int64_t(*min_i64) (const int64_t *, size_t);
+    int64_t(*max_i64) (const int64_t *, size_t);
+    int64_t(*dot_i64) (const int64_t *, const int64_t *, size_t);
+    void (*prefix_sum_i64) (int64_t *, const int64_t *, size_t);
+} kernel_ops_t;
+
+const kernel_ops_t *kernel_ops(void);
+
+kernel_isa_t kernel_best(void);
+void kernel_select(kernel_isa_t);
+
+#endif
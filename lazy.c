@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lazy.h"
+#include "lisp_eval.h"
+#include "lisp_read.h"
+#include "builtin.h"
+#include "logger.h"
+#include "stream.h"
+#include "scan.h"
+
+/* A lazy sequence is a generator: it keeps only what it needs to produce
+ * its next element (the rest of a list, an open stream, the sequence it
+ * transforms) and produces every element exactly once, when asked. A
+ * pipeline of them therefore holds one element at a time, however long
+ * its input is. Reading an element consumes it. */
+
+static int list_next(lisp_t *, object_lazy_t *, object_t **);
+static int map_next(lisp_t *, object_lazy_t *, object_t **);
+static int filter_next(lisp_t *, object_lazy_t *, object_t **);
+static int take_next(lisp_t *, object_lazy_t *, object_t **);
+static int lines_next(lisp_t *, object_lazy_t *, object_t **);
+static int forms_next(lisp_t *, object_lazy_t *, object_t **);
+
+/** Return o as a lazy sequence, lists are read from the front. */
+object_t *lazy_seq(lisp_t * l __attribute__ ((unused)), object_t * o) {
+    if(object_isa(o, OBJECT_LAZY))
+        return o;
+
+    if((o != NULL) && !object_isa(o, OBJECT_CONS))
+        PANIC("lazy_seq: not a list or lazy sequence!");
+
+    return object_lazy_new(list_next, o, NULL, 0);
+}
+
+object_t *lazy_map(lisp_t * l, object_t * fn, object_t * seq) {
+    return object_lazy_new(map_next, lazy_seq(l, seq), fn, 0);
+}
+
+object_t *lazy_filter(lisp_t * l, object_t * fn, object_t * seq) {
+    return object_lazy_new(filter_next, lazy_seq(l, seq), fn, 0);
+}
+
+object_t *lazy_take(lisp_t * l, size_t n, object_t * seq) {
+    return object_lazy_new(take_next, lazy_seq(l, seq), NULL, n);
+}
+
+/** Lines of stream as strings, without their newlines. */
+object_t *lazy_lines(object_t * stream, int close) {
+    object_lazy_t *z =
+        (object_lazy_t *) object_lazy_new(lines_next, stream, NULL, 0);
+
+    z->close = close;
+
+    return (object_t *) z;
+}
+
+/** Top-level forms of stream, read but not evaluated. */
+object_t *lazy_forms(object_t * stream, int close) {
+    object_lazy_t *z =
+        (object_lazy_t *) object_lazy_new(forms_next, stream, NULL, 0);
+
+    z->close = close;
+
+    return (object_t *) z;
+}
+
+/** Produce the next element in *o, returns 0 if there is none left. */
+int lazy_next(lisp_t * l, object_t * seq, object_t ** o) {
+    if(!object_isa(seq, OBJECT_LAZY))
+        PANIC("lazy_next: not a lazy sequence!");
+
+    object_lazy_t *z = (object_lazy_t *) seq;
+
+    if(z->done)
+        return 0;
+
+    if(z->next(l, z, o))
+        return 1;
+
+    z->done = 1;
+
+    /* sources opened for the sequence are closed once it is exhausted */
+    if(z->close)
+        stream_close(z->src);
+
+    *o = NULL;
+
+    return 0;
+}
+
+static int list_next(lisp_t * l __attribute__ ((unused)),
+                     object_lazy_t * z, object_t ** o) {
+    if(z->src == NULL)
+        return 0;
+
+    *o = car(z->src);
+    z->src = cdr(z->src);
+
+    return 1;
+}
+
+static int map_next(lisp_t * l, object_lazy_t * z, object_t ** o) {
+    object_t *x;
+
+    if(!lazy_next(l, z->src, &x))
+        return 0;
+
+    *o = lisp_call(l, z->fn, 1, &x);
+
+    return 1;
+}
+
+static int filter_next(lisp_t * l, object_lazy_t * z, object_t ** o) {
+    while(lazy_next(l, z->src, o)) {
+        if(lisp_call(l, z->fn, 1, o) != NULL)
+            return 1;
+    }
+
+    return 0;
+}
+
+static int take_next(lisp_t * l, object_lazy_t * z, object_t ** o) {
+    if(z->n == 0)
+        return 0;
+
+    z->n--;
+
+    return lazy_next(l, z->src, o);
+}
+
+static int lines_next(lisp_t * l, object_lazy_t * z, object_t ** o) {
+    object_t *stream = z->src;
+
+    if(stream_eof(stream))
+        return 0;
+
+    size_t len = 0, avail;
+    char *line = lisp_scratch(l, 256);
+    const char *buf = stream_peek(stream, &avail);
+
+    if(buf != NULL) {           // memory stream, find the newline in bulk
+        len = scan_first_of(buf, avail, "\n");
+        line = lisp_scratch(l, len + 1);
+
+        memcpy(line, buf, len);
+        stream_skip(stream, len < avail ? len + 1 : len);
+    }
+
+    while((buf == NULL) && !stream_eof(stream)) {
+        char x = stream_read_char(stream);
+
+        if(x == '\n')
+            break;
+
+        line = lisp_scratch(l, len + 1);
+        line[len++] = x;
+    }
+
+    char *s = calloc(len + 1, sizeof(char));
+
+    if(s == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(s, line, len);
+
+    *o = object_string_new(s, len);
+
+    return 1;
+}
+
+static int forms_next(lisp_t * l, object_lazy_t * z, object_t ** o) {
+    return lisp_read_datum(l, z->src, o);
+}
@@ -0,0 +1,16 @@
+#ifndef __LAZY_H
+#define __LAZY_H
+
+#include "lisp.h"
+#include "object.h"
+
+object_t *lazy_seq(lisp_t *, object_t *);
+object_t *lazy_map(lisp_t *, object_t *, object_t *);
+object_t *lazy_filter(lisp_t *, object_t *, object_t *);
+object_t *lazy_take(lisp_t *, size_t, object_t *);
+object_t *lazy_lines(object_t *, int);
+object_t *lazy_forms(object_t *, int);
+
+int lazy_next(lisp_t *, object_t *, object_t **);
+
+#endif
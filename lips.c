@@ -4,44 +4,18 @@
 #include "lisp.h"
 #include "lisp_eval.h"
 #include "lisp_read.h"
+#include "stream.h"
 
 void eval_file(lisp_t *lisp, char *filename) {
-    FILE *repl_file = fopen(filename, "r");
-
     fprintf(stderr, "%s ...\n", filename);
 
-    if(repl_file == NULL) {
-        perror("fopen");
-        exit(EXIT_FAILURE);
-    }
-
-    fseek(repl_file, 0L, SEEK_END);
-    size_t bufsz = ftell(repl_file);
-
-    fseek(repl_file, 0L, SEEK_SET);
-
-    char *buf = (char *) calloc(bufsz + 1, sizeof(char));
-
-    if(buf == NULL) {
-        perror("calloc");
-        exit(EXIT_FAILURE);
-    }
-
-    fread(buf, sizeof(char), bufsz, repl_file);
-    fclose(repl_file);
-
-    size_t i = 0;
-    char pprev = 0, prev = 0;
-
-    while(i < bufsz) {
-        if(prev == 0 || (pprev == '\n' && prev == '\n' && buf[i] != '\n'))
-            lisp_eval(lisp, lisp_read(lisp, buf + i, bufsz - i));
+    object_t *stream = istream_file(filename);
+    object_t *form = NULL;
 
-        pprev = prev;
-        prev = buf[i++];
-    }
+    while(lisp_read_next(lisp, stream, &form))
+        lisp_eval(lisp, form);
 
-    free(buf);
+    stream_close(stream);
 }
 
 int main(int argc, char **argv) {
@@ -12,6 +12,15 @@
 #include "builtin.h"
 #include "lisp_print.h"
 #include "lisp_read.h"
+#include "lisp_load.h"
+#include "hashtable.h"
+#include "kernel.h"
+#include "hamt.h"
+#include "hcons.h"
+#include "lazy.h"
+#include "transduce.h"
+#include "compile.h"
+#include "jit.h"
 
 lisp_env_t *lisp_env_new(lisp_env_t * outer, object_t * labels) {
     lisp_env_t *env = calloc(1, sizeof(lisp_env_t));
@@ -30,19 +39,14 @@ lisp_env_t *lisp_env_pop(lisp_env_t * env) {
 }
 
 object_t *lisp_env_resolv(lisp_t * l, lisp_env_t * env, object_t * x) {
-    if(env == NULL)
-        return NULL;
-
-    object_t *pairi = env->labels;
+    for(; env != NULL; env = env->outer) {
+        object_t *pair = assoc(l, x, env->labels);
 
-    while(pairi) {
-        if(eq(l, car(car(pairi)), x))
-            return car(pairi);
-
-        pairi = cdr(pairi);
+        if(pair != NULL)
+            return pair;
     }
 
-    return lisp_env_resolv(l, env->outer, x);
+    return NULL;
 }
 
 object_t *atom_fw(lisp_t * l, object_t * args) {
@@ -141,6 +145,792 @@ object_t *format_fw(lisp_t * l, object_t * args) {
     return format(l, car(args), cdr(args));
 }
 
+object_t *load_data_fw(lisp_t * l, object_t * args) {
+    object_t *path = car(args);
+    object_t *nthreads = car(cdr(args));
+
+    if(!object_isa(path, OBJECT_STRING))
+        PANIC("load_data: path is not a string!");
+
+    if((nthreads != NULL) && !object_isa(nthreads, OBJECT_INTEGER))
+        PANIC("load_data: thread count is not an integer!");
+
+    object_string_t *ps = (object_string_t *) path;
+    char *s = calloc(ps->len + 1, sizeof(char));
+
+    if(s == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(s, ps->string, ps->len);
+
+    size_t n = nthreads ? ((object_integer_t *) nthreads)->number : 0;
+    object_t *r = lisp_load_data(l, s, n);
+
+    free(s);
+
+    return r;
+}
+
+object_t *compile_file_fw(lisp_t * l, object_t * args) {
+    object_t *path = car(args);
+
+    if(!object_isa(path, OBJECT_STRING))
+        PANIC("compile_file: path is not a string!");
+
+    object_string_t *ps = (object_string_t *) path;
+    char s[ps->len + 1];
+
+    memcpy(s, ps->string, ps->len);
+    s[ps->len] = '\0';
+
+    return compile_file(l, s);
+}
+
+object_t *hcons_fw(lisp_t * l, object_t * args) {
+    return hcons(l, car(args), car(cdr(args)));
+}
+
+/** Turn the reader's hash-consing on or off, returns the previous mode. */
+object_t *hcons_read_fw(lisp_t * l, object_t * args) {
+    object_t *old = l->hcons_read ? l->t : NULL;
+
+    l->hcons_read = (car(args) != NULL);
+
+    return old;
+}
+
+/** Turn the optimizer on or off, returns the previous mode. */
+object_t *optimize_fw(lisp_t * l, object_t * args) {
+    object_t *old = l->optimize ? l->t : NULL;
+
+    l->optimize = (car(args) != NULL);
+
+    return old;
+}
+
+/** (JIT NIL) leaves every lambda to the interpreter, (JIT T) compiles hot
+ *  ones again; return the previous setting. */
+object_t *jit_fw(lisp_t * l, object_t * args) {
+    object_t *old = l->jit ? l->t : NULL;
+
+    l->jit = (car(args) != NULL);
+
+    return old;
+}
+
+/** Set how deep evaluations may nest, return the previous limit. */
+object_t *max_depth_fw(lisp_t * l, object_t * args) {
+    object_t *old = object_integer_new(l->max_depth);
+
+    if(args == NULL)
+        return old;
+
+    if(!object_isa(car(args), OBJECT_INTEGER)
+       || (((object_integer_t *) car(args))->number < 1))
+        PANIC("max_depth: expected a positive integer!");
+
+    l->max_depth = ((object_integer_t *) car(args))->number;
+
+    return old;
+}
+
+/** Return and forget what the optimizer did, oldest first. */
+object_t *opt_report_fw(lisp_t * l, object_t * args) {
+    object_t *r = NULL;
+
+    args = args;
+
+    for(object_t * o = l->opt_report; o != NULL; o = cdr(o))
+        r = cons(car(o), r);
+
+    l->opt_report = NULL;
+
+    return r;
+}
+
+object_t *make_vector_fw(lisp_t * l, object_t * args) {
+    object_t *n = car(args);
+
+    l = l;
+
+    if(!object_isa(n, OBJECT_INTEGER) || (((object_integer_t *) n)->number < 0))
+        PANIC("make_vector: size is not a non-negative integer!");
+
+    return object_vector_new(((object_integer_t *) n)->number, car(cdr(args)));
+}
+
+/** Resolve an index into vector v, NULL if it is out of range. */
+static object_t **vector_slot(object_t * v, object_t * i) {
+    if(!object_isa(v, OBJECT_VECTOR))
+        PANIC("vector_slot: not a vector!");
+
+    if(!object_isa(i, OBJECT_INTEGER))
+        PANIC("vector_slot: index is not an integer!");
+
+    int64_t n = ((object_integer_t *) i)->number;
+
+    if((n < 0) || ((uint64_t) n >= ((object_vector_t *) v)->len))
+        return NULL;
+
+    return &((object_vector_t *) v)->items[n];
+}
+
+object_t *vref_fw(lisp_t * l, object_t * args) {
+    object_t **slot = vector_slot(car(args), car(cdr(args)));
+
+    if(slot == NULL)
+        return lisp_error(l, object_symbol_new("INDEX-OUT-OF-RANGE"));
+
+    return *slot;
+}
+
+object_t *vset_fw(lisp_t * l, object_t * args) {
+    object_t **slot = vector_slot(car(args), car(cdr(args)));
+
+    if(slot == NULL)
+        return lisp_error(l, object_symbol_new("INDEX-OUT-OF-RANGE"));
+
+    return *slot = car(cdr(cdr(args)));
+}
+
+object_t *vlength_fw(lisp_t * l, object_t * args) {
+    object_t *v = car(args);
+
+    l = l;
+
+    if(!object_isa(v, OBJECT_VECTOR))
+        PANIC("vlength: not a vector!");
+
+    return object_integer_new(((object_vector_t *) v)->len);
+}
+
+/** Parse the key test of a hash table or map, EQ if not given. */
+static hashtable_test_t hash_test(lisp_t * l, object_t * test) {
+    if((test == NULL) || eq(l, test, object_symbol_new("EQ")))
+        return HASHTABLE_EQ;
+
+    if(!eq(l, test, object_symbol_new("EQUAL")))
+        PANIC("hash_test: test must be EQ or EQUAL!");
+
+    return HASHTABLE_EQUAL;
+}
+
+object_t *make_hash_table_fw(lisp_t * l, object_t * args) {
+    return object_hashtable_new(hash_test(l, car(args)));
+}
+
+object_t *gethash_fw(lisp_t * l, object_t * args) {
+    int found;
+    object_t *v = hashtable_get(l, car(cdr(args)), car(args), &found);
+
+    return found ? v : car(cdr(cdr(args)));
+}
+
+object_t *puthash_fw(lisp_t * l, object_t * args) {
+    return hashtable_put(l, car(cdr(cdr(args))), car(args), car(cdr(args)));
+}
+
+object_t *remhash_fw(lisp_t * l, object_t * args) {
+    return hashtable_remove(l, car(cdr(args)), car(args)) ? l->t : NULL;
+}
+
+object_t *hash_table_count_fw(lisp_t * l, object_t * args) {
+    object_t *h = car(args);
+
+    l = l;
+
+    if(!object_isa(h, OBJECT_HASHTABLE))
+        PANIC("hash_table_count: not a hash table!");
+
+    return object_integer_new(((object_hashtable_t *) h)->count);
+}
+
+/** Call fn with the key and value of every entry in a hash table.
+ *
+ *  fn may change the table: the keys are taken before the first call, so
+ *  keys it adds are not visited and keys it removes are skipped, and each
+ *  key is passed the value it has when its turn comes.
+ */
+object_t *maphash_fw(lisp_t * l, object_t * args) {
+    object_t *fn = car(args);
+    object_t *h = car(cdr(args));
+
+    if(!object_isa(h, OBJECT_HASHTABLE))
+        PANIC("maphash: not a hash table!");
+
+    object_hashtable_t *t = (object_hashtable_t *) h;
+    object_t **keys = calloc(t->count ? t->count : 1, sizeof(object_t *));
+    size_t n = 0;
+
+    if(keys == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for(size_t i = 0; i < t->sz; i++) {
+        if(t->entries[i].state == HASHTABLE_ENTRY_FULL)
+            keys[n++] = t->entries[i].key;
+    }
+
+    for(size_t i = 0; i < n; i++) {
+        int found;
+        object_t *v = hashtable_get(l, h, keys[i], &found);
+
+        if(found)
+            lisp_apply(l, fn, cons(keys[i], cons(v, NULL)));
+    }
+
+    free(keys);
+
+    return NULL;
+}
+
+object_t *make_map_fw(lisp_t * l, object_t * args) {
+    return object_map_new(hash_test(l, car(args)), NULL, 0);
+}
+
+object_t *map_get_fw(lisp_t * l, object_t * args) {
+    int found;
+    object_t *v = hamt_get(l, car(cdr(args)), car(args), &found);
+
+    return found ? v : car(cdr(cdr(args)));
+}
+
+object_t *map_put_fw(lisp_t * l, object_t * args) {
+    return hamt_put(l, car(cdr(cdr(args))), car(args), car(cdr(args)));
+}
+
+object_t *map_remove_fw(lisp_t * l, object_t * args) {
+    return hamt_remove(l, car(cdr(args)), car(args));
+}
+
+object_t *map_count_fw(lisp_t * l, object_t * args) {
+    object_t *m = car(args);
+
+    l = l;
+
+    if(!object_isa(m, OBJECT_MAP))
+        PANIC("map_count: not a map!");
+
+    return object_integer_new(((object_map_t *) m)->count);
+}
+
+object_t *map_alist_fw(lisp_t * l, object_t * args) {
+    l = l;
+
+    return hamt_alist(car(args));
+}
+
+/** Open a path for LINES and FORMS, streams are used as they are. NULL
+ *  if the file cannot be read, for the caller to signal FILE-ERROR. */
+static object_t *lazy_source(object_t * o, int *opened) {
+    if(object_isa(o, OBJECT_STREAM)) {
+        *opened = 0;
+
+        return o;
+    }
+
+    if(!object_isa(o, OBJECT_STRING))
+        PANIC("lazy_source: not a path or stream!");
+
+    object_string_t *ps = (object_string_t *) o;
+    char path[ps->len + 1];
+
+    memcpy(path, ps->string, ps->len);
+    path[ps->len] = '\0';
+    *opened = 1;
+
+    return istream_open(path);
+}
+
+object_t *lines_fw(lisp_t * l, object_t * args) {
+    int opened;
+    object_t *stream = lazy_source(car(args), &opened);
+
+    if(stream == NULL)
+        return lisp_error(l, object_symbol_new("FILE-ERROR"));
+
+    return lazy_lines(stream, opened);
+}
+
+object_t *forms_fw(lisp_t * l, object_t * args) {
+    int opened;
+    object_t *stream = lazy_source(car(args), &opened);
+
+    if(stream == NULL)
+        return lisp_error(l, object_symbol_new("FILE-ERROR"));
+
+    return lazy_forms(stream, opened);
+}
+
+object_t *lazy_map_fw(lisp_t * l, object_t * args) {
+    return lazy_map(l, car(args), car(cdr(args)));
+}
+
+object_t *lazy_filter_fw(lisp_t * l, object_t * args) {
+    return lazy_filter(l, car(args), car(cdr(args)));
+}
+
+object_t *take_fw(lisp_t * l, object_t * args) {
+    object_t *n = car(args);
+
+    if(!object_isa(n, OBJECT_INTEGER))
+        PANIC("take: count is not an integer!");
+
+    if(((object_integer_t *) n)->number < 0)
+        return lisp_error(l, object_symbol_new("VALUE-OUT-OF-RANGE"));
+
+    return lazy_take(l, ((object_integer_t *) n)->number, car(cdr(args)));
+}
+
+/** (LAZY-REDUCE F INIT SEQ), folds SEQ one element at a time. */
+object_t *lazy_reduce_fw(lisp_t * l, object_t * args) {
+    object_t *fn = car(args);
+    object_t *acc = car(cdr(args));
+    object_t *seq = lazy_seq(l, car(cdr(cdr(args))));
+    object_t *x;
+
+    while(lazy_next(l, seq, &x)) {
+        object_t *argv[2] = { acc, x };
+
+        acc = lisp_call(l, fn, 2, argv);
+    }
+
+    return acc;
+}
+
+/** Collect what is left of a lazy sequence into a list. */
+object_t *force_fw(lisp_t * l, object_t * args) {
+    object_t *seq = lazy_seq(l, car(args));
+    object_t *list = NULL, *tail = NULL, *x;
+
+    while(lazy_next(l, seq, &x)) {
+        if(list == NULL)
+            list = tail = cons(x, NULL);
+        else
+            tail = ((object_cons_t *) tail)->cdr = cons(x, NULL);
+    }
+
+    return list;
+}
+
+/** (MAPCAR F LIST), or with one argument, (MAP F), a mapping transducer. */
+object_t *mapcar_fw(lisp_t * l, object_t * args) {
+    object_t *xf = transducer(TRANSDUCER_MAP, car(args));
+
+    if(cdr(args) == NULL)
+        return xf;
+
+    return transduce_list(l, xf, car(cdr(args)));
+}
+
+/** (FILTER P LIST), or with one argument a filtering transducer. */
+object_t *filter_fw(lisp_t * l, object_t * args) {
+    object_t *xf = transducer(TRANSDUCER_FILTER, car(args));
+
+    if(cdr(args) == NULL)
+        return xf;
+
+    return transduce_list(l, xf, car(cdr(args)));
+}
+
+/** (REDUCE F INIT LIST), F is called as (F ACC X). */
+object_t *reduce_fw(lisp_t * l, object_t * args) {
+    return transduce(l, transducer_comp(NULL), car(args), car(cdr(args)),
+                     car(cdr(cdr(args))));
+}
+
+object_t *comp_fw(lisp_t * l, object_t * args) {
+    l = l;
+
+    return transducer_comp(args);
+}
+
+/** (TRANSDUCE XF F INIT LIST), REDUCE over what comes out of XF. */
+object_t *transduce_fw(lisp_t * l, object_t * args) {
+    return transduce(l, car(args), car(cdr(args)), car(cdr(cdr(args))),
+                     car(cdr(cdr(cdr(args)))));
+}
+
+/** Parse an array element type, INT32 or INT64. */
+static array_type_t array_type(lisp_t * l, object_t * name) {
+    if(eq(l, name, object_symbol_new("INT32")))
+        return ARRAY_INT32;
+
+    if(!eq(l, name, object_symbol_new("INT64")))
+        PANIC("array_type: element type must be INT32 or INT64!");
+
+    return ARRAY_INT64;
+}
+
+/** Store integer v at index i, returns 0 if it does not fit the type. */
+static int array_store(object_array_t * a, size_t i, object_t * v) {
+    if(!object_isa(v, OBJECT_INTEGER))
+        PANIC("array_store: element is not an integer!");
+
+    int64_t n = ((object_integer_t *) v)->number;
+
+    if(a->type == ARRAY_INT64) {
+        ((int64_t *) a->data)[i] = n;
+        return 1;
+    }
+
+    if((n < INT32_MIN) || (n > INT32_MAX))
+        return 0;
+
+    ((int32_t *) a->data)[i] = (int32_t) n;
+
+    return 1;
+}
+
+static int64_t array_load(object_array_t * a, size_t i) {
+    if(a->type == ARRAY_INT32)
+        return ((int32_t *) a->data)[i];
+
+    return ((int64_t *) a->data)[i];
+}
+
+/** (MAKE-ARRAY type size) or (MAKE-ARRAY type list) */
+object_t *make_array_fw(lisp_t * l, object_t * args) {
+    array_type_t type = array_type(l, car(args));
+    object_t *init = car(cdr(args));
+
+    if(object_isa(init, OBJECT_INTEGER)) {
+        if(((object_integer_t *) init)->number < 0)
+            PANIC("make_array: size is negative!");
+
+        return object_array_new(type, ((object_integer_t *) init)->number);
+    }
+
+    size_t n = 0;
+
+    for(object_t * o = init; o != NULL; o = cdr(o))
+        n++;
+
+    object_t *a = object_array_new(type, n);
+
+    for(size_t i = 0; init != NULL; init = cdr(init), i++) {
+        if(!array_store((object_array_t *) a, i, car(init)))
+            return lisp_error(l, object_symbol_new("VALUE-OUT-OF-RANGE"));
+    }
+
+    return a;
+}
+
+/** Resolve an index into array a, returns 0 if it is out of range. */
+static int array_index(object_t * a, object_t * i, size_t *n) {
+    if(!object_isa(a, OBJECT_ARRAY))
+        PANIC("array_index: not an array!");
+
+    if(!object_isa(i, OBJECT_INTEGER))
+        PANIC("array_index: index is not an integer!");
+
+    int64_t k = ((object_integer_t *) i)->number;
+
+    if((k < 0) || ((uint64_t) k >= ((object_array_t *) a)->len))
+        return 0;
+
+    *n = k;
+
+    return 1;
+}
+
+object_t *aref_fw(lisp_t * l, object_t * args) {
+    size_t i;
+
+    if(!array_index(car(args), car(cdr(args)), &i))
+        return lisp_error(l, object_symbol_new("INDEX-OUT-OF-RANGE"));
+
+    return object_integer_new(array_load((object_array_t *) car(args), i));
+}
+
+object_t *aset_fw(lisp_t * l, object_t * args) {
+    object_t *v = car(cdr(cdr(args)));
+    size_t i;
+
+    if(!array_index(car(args), car(cdr(args)), &i))
+        return lisp_error(l, object_symbol_new("INDEX-OUT-OF-RANGE"));
+
+    if(!array_store((object_array_t *) car(args), i, v))
+        return lisp_error(l, object_symbol_new("VALUE-OUT-OF-RANGE"));
+
+    return v;
+}
+
+object_t *alength_fw(lisp_t * l, object_t * args) {
+    object_t *a = car(args);
+
+    l = l;
+
+    if(!object_isa(a, OBJECT_ARRAY))
+        PANIC("alength: not an array!");
+
+    return object_integer_new(((object_array_t *) a)->len);
+}
+
+/** Check that args are two arrays of the same type and length. */
+static int array_pair(object_t * args, object_array_t ** a,
+                      object_array_t ** b) {
+    if(!object_isa(car(args), OBJECT_ARRAY)
+       || !object_isa(car(cdr(args)), OBJECT_ARRAY))
+        PANIC("array_pair: not an array!");
+
+    *a = (object_array_t *) car(args);
+    *b = (object_array_t *) car(cdr(args));
+
+    if((*a)->type != (*b)->type)
+        PANIC("array_pair: arrays have different element types!");
+
+    return (*a)->len == (*b)->len;
+}
+
+/** Apply an element-wise kernel to two arrays into a new one. */
+static object_t *array_map2(lisp_t * l, object_t * args,
+                            void (*op_i32) (int32_t *, const int32_t *,
+                                            const int32_t *, size_t),
+                            void (*op_i64) (int64_t *, const int64_t *,
+                                            const int64_t *, size_t)) {
+    object_array_t *a, *b;
+
+    if(!array_pair(args, &a, &b))
+        return lisp_error(l, object_symbol_new("LENGTH-MISMATCH"));
+
+    object_array_t *r = (object_array_t *) object_array_new(a->type, a->len);
+
+    if(a->type == ARRAY_INT32)
+        op_i32(r->data, a->data, b->data, a->len);
+    else
+        op_i64(r->data, a->data, b->data, a->len);
+
+    return (object_t *) r;
+}
+
+object_t *array_add_fw(lisp_t * l, object_t * args) {
+    const kernel_ops_t *k = kernel_ops();
+
+    return array_map2(l, args, k->add_i32, k->add_i64);
+}
+
+object_t *array_mul_fw(lisp_t * l, object_t * args) {
+    const kernel_ops_t *k = kernel_ops();
+
+    return array_map2(l, args, k->mul_i32, k->mul_i64);
+}
+
+object_t *array_sum_fw(lisp_t * l, object_t * args) {
+    object_array_t *a = (object_array_t *) car(args);
+    const kernel_ops_t *k = kernel_ops();
+
+    l = l;
+
+    if(!object_isa(car(args), OBJECT_ARRAY))
+        PANIC("array_sum: not an array!");
+
+    if(a->type == ARRAY_INT32)
+        return object_integer_new(k->sum_i32(a->data, a->len));
+
+    return object_integer_new(k->sum_i64(a->data, a->len));
+}
+
+/** Smallest or largest element, NIL for an empty array. */
+static object_t *array_extremum(object_t * args, int max) {
+    object_array_t *a = (object_array_t *) car(args);
+    const kernel_ops_t *k = kernel_ops();
+
+    if(!object_isa(car(args), OBJECT_ARRAY))
+        PANIC("array_extremum: not an array!");
+
+    if(a->len == 0)
+        return NULL;
+
+    if(a->type == ARRAY_INT32)
+        return object_integer_new(max ? k->max_i32(a->data, a->len)
+                                  : k->min_i32(a->data, a->len));
+
+    return object_integer_new(max ? k->max_i64(a->data, a->len)
+                              : k->min_i64(a->data, a->len));
+}
+
+object_t *array_min_fw(lisp_t * l, object_t * args) {
+    l = l;
+
+    return array_extremum(args, 0);
+}
+
+object_t *array_max_fw(lisp_t * l, object_t * args) {
+    l = l;
+
+    return array_extremum(args, 1);
+}
+
+object_t *array_dot_fw(lisp_t * l, object_t * args) {
+    const kernel_ops_t *k = kernel_ops();
+    object_array_t *a, *b;
+
+    if(!array_pair(args, &a, &b))
+        return lisp_error(l, object_symbol_new("LENGTH-MISMATCH"));
+
+    if(a->type == ARRAY_INT32)
+        return object_integer_new(k->dot_i32(a->data, b->data, a->len));
+
+    return object_integer_new(k->dot_i64(a->data, b->data, a->len));
+}
+
+object_t *array_prefix_sum_fw(lisp_t * l, object_t * args) {
+    object_array_t *a = (object_array_t *) car(args);
+    const kernel_ops_t *k = kernel_ops();
+
+    l = l;
+
+    if(!object_isa(car(args), OBJECT_ARRAY))
+        PANIC("array_prefix_sum: not an array!");
+
+    object_array_t *r = (object_array_t *) object_array_new(a->type, a->len);
+
+    if(a->type == ARRAY_INT32)
+        k->prefix_sum_i32(r->data, a->data, a->len);
+    else
+        k->prefix_sum_i64(r->data, a->data, a->len);
+
+    return (object_t *) r;
+}
+
+/** Fetch an integer argument of an arithmetic builtin. */
+static int64_t fixnum(object_t * o) {
+    if(!object_isa(o, OBJECT_INTEGER))
+        PANIC("fixnum: argument is not an integer!");
+
+    return ((object_integer_t *) o)->number;
+}
+
+/* The arithmetic builtins use the vector convention, see evfun(). Integers
+ * are 64 bit; a result that does not fit signals ARITHMETIC-OVERFLOW. */
+
+object_t *add_fw(lisp_t * l, size_t argc, object_t ** argv) {
+    int64_t r = 0;
+
+    for(size_t i = 0; i < argc; i++) {
+        if(__builtin_add_overflow(r, fixnum(argv[i]), &r))
+            return lisp_error(l, object_symbol_new("ARITHMETIC-OVERFLOW"));
+    }
+
+    return object_integer_new(r);
+}
+
+object_t *sub_fw(lisp_t * l, size_t argc, object_t ** argv) {
+    if(argc == 0)
+        PANIC("sub: at least one argument expected!");
+
+    int64_t r = fixnum(argv[0]);
+
+    if((argc == 1) && __builtin_sub_overflow(0, r, &r))
+        return lisp_error(l, object_symbol_new("ARITHMETIC-OVERFLOW"));
+
+    for(size_t i = 1; i < argc; i++) {
+        if(__builtin_sub_overflow(r, fixnum(argv[i]), &r))
+            return lisp_error(l, object_symbol_new("ARITHMETIC-OVERFLOW"));
+    }
+
+    return object_integer_new(r);
+}
+
+object_t *mul_fw(lisp_t * l, size_t argc, object_t ** argv) {
+    int64_t r = 1;
+
+    for(size_t i = 0; i < argc; i++) {
+        if(__builtin_mul_overflow(r, fixnum(argv[i]), &r))
+            return lisp_error(l, object_symbol_new("ARITHMETIC-OVERFLOW"));
+    }
+
+    return object_integer_new(r);
+}
+
+/** Integer division, truncating towards zero; (/ x) is (/ 1 x). */
+object_t *div_fw(lisp_t * l, size_t argc, object_t ** argv) {
+    if(argc == 0)
+        PANIC("div: at least one argument expected!");
+
+    int64_t r = argc == 1 ? 1 : fixnum(argv[0]);
+
+    for(size_t i = argc == 1 ? 0 : 1; i < argc; i++) {
+        int64_t d = fixnum(argv[i]);
+
+        if(d == 0)
+            return lisp_error(l, object_symbol_new("DIVISION-BY-ZERO"));
+
+        if((r == INT64_MIN) && (d == -1))
+            return lisp_error(l, object_symbol_new("ARITHMETIC-OVERFLOW"));
+
+        r /= d;
+    }
+
+    return object_integer_new(r);
+}
+
+/** Modulus, taking the sign of the divisor. */
+object_t *mod_fw(lisp_t * l, size_t argc, object_t ** argv) {
+    if(argc != 2)
+        PANIC("mod: two arguments expected!");
+
+    int64_t a = fixnum(argv[0]);
+    int64_t b = fixnum(argv[1]);
+
+    if(b == 0)
+        return lisp_error(l, object_symbol_new("DIVISION-BY-ZERO"));
+
+    if(b == -1)
+        return object_integer_new(0);
+
+    int64_t r = a % b;
+
+    if((r != 0) && ((r < 0) != (b < 0)))
+        r += b;
+
+    return object_integer_new(r);
+}
+
+/** T if every argument compares to the next one as wanted. */
+static object_t *compare(lisp_t * l, size_t argc, object_t ** argv,
+                         int want_lt, int want_eq, int want_gt) {
+    if(argc == 0)
+        PANIC("compare: at least one argument expected!");
+
+    int64_t a = fixnum(argv[0]);
+
+    for(size_t i = 1; i < argc; i++) {
+        int64_t b = fixnum(argv[i]);
+
+        if(!(a < b ? want_lt : a > b ? want_gt : want_eq))
+            return NULL;
+
+        a = b;
+    }
+
+    return l->t;
+}
+
+object_t *lt_fw(lisp_t * l, size_t argc, object_t ** argv) {
+    return compare(l, argc, argv, 1, 0, 0);
+}
+
+object_t *gt_fw(lisp_t * l, size_t argc, object_t ** argv) {
+    return compare(l, argc, argv, 0, 0, 1);
+}
+
+object_t *num_eq_fw(lisp_t * l, size_t argc, object_t ** argv) {
+    return compare(l, argc, argv, 0, 1, 0);
+}
+
+object_t *le_fw(lisp_t * l, size_t argc, object_t ** argv) {
+    return compare(l, argc, argv, 1, 1, 0);
+}
+
+object_t *ge_fw(lisp_t * l, size_t argc, object_t ** argv) {
+    return compare(l, argc, argv, 0, 1, 1);
+}
+
 #define MAKE_FUNCTION(lisp, name, fptr) do { \
     object_t *f = object_function_new(fptr); \
     object_t *s = object_symbol_new(name); \
@@ -148,6 +938,25 @@ object_t *format_fw(lisp_t * l, object_t * args) {
     lisp->env->labels = cons(kv, lisp->env->labels); \
     } while(0);
 
+#define MAKE_VFUNCTION(lisp, name, vptr) do { \
+    object_t *f = object_vfunction_new(vptr); \
+    object_t *s = object_symbol_new(name); \
+    object_t *kv = cons(s, cons(f, NULL)); \
+    lisp->env->labels = cons(kv, lisp->env->labels); \
+    } while(0);
+
+#define MAKE_PURE(lisp, name, purity) do { \
+    object_t *f = car(cdr(lisp_env_resolv(lisp, lisp->env, \
+                                          object_symbol_new(name)))); \
+    ((object_function_t *) f)->pure = purity; \
+    } while(0);
+
+#define MAKE_PRIM(lisp, name, p) do { \
+    object_t *f = car(cdr(lisp_env_resolv(lisp, lisp->env, \
+                                          object_symbol_new(name)))); \
+    ((object_function_t *) f)->prim = p; \
+    } while(0);
+
 #define MAKE_BUILTIN(lisp, name, sexpr) do { \
     object_t *obj = lisp_read(lisp, sexpr, strlen(sexpr)); \
     if(NULL == lisp_eval(lisp, obj)) \
@@ -160,10 +969,15 @@ object_t *format_fw(lisp_t * l, object_t * args) {
 lisp_t *lisp_new() {
     lisp_t *l = calloc(1, sizeof(lisp_t));
 
-    l->env = lisp_env_new(NULL, NULL);
+    l->env = l->global = lisp_env_new(NULL, NULL);
     l->readtable = readtable_new();
 
     l->t = object_symbol_new("T");
+    l->macro_cache = object_hashtable_new(HASHTABLE_EQ);
+    l->optimize = 1;
+    l->jit = 1;
+    l->prims_epoch = ~0U;       // not worked out yet
+    l->max_depth = MAX_DEPTH;
 
     object_t *nil = object_symbol_new("NIL");
 
@@ -184,13 +998,121 @@ lisp_t *lisp_new() {
     MAKE_FUNCTION(l, "PAIR", pair_fw);
     MAKE_FUNCTION(l, "ASSOC", assoc_fw);
     MAKE_FUNCTION(l, "FORMAT", format_fw);
+    MAKE_FUNCTION(l, "LOAD-DATA", load_data_fw);
+    MAKE_FUNCTION(l, "COMPILE-FILE", compile_file_fw);
+
+    MAKE_FUNCTION(l, "HCONS", hcons_fw);
+    MAKE_FUNCTION(l, "HCONS-READ", hcons_read_fw);
+
+    MAKE_FUNCTION(l, "MAKE-VECTOR", make_vector_fw);
+    MAKE_FUNCTION(l, "VREF", vref_fw);
+    MAKE_FUNCTION(l, "VSET", vset_fw);
+    MAKE_FUNCTION(l, "VLENGTH", vlength_fw);
+
+    MAKE_FUNCTION(l, "MAKE-HASH-TABLE", make_hash_table_fw);
+    MAKE_FUNCTION(l, "GETHASH", gethash_fw);
+    MAKE_FUNCTION(l, "PUTHASH", puthash_fw);
+    MAKE_FUNCTION(l, "REMHASH", remhash_fw);
+    MAKE_FUNCTION(l, "HASH-TABLE-COUNT", hash_table_count_fw);
+    MAKE_FUNCTION(l, "MAPHASH", maphash_fw);
+
+    MAKE_FUNCTION(l, "MAKE-MAP", make_map_fw);
+    MAKE_FUNCTION(l, "MAP-GET", map_get_fw);
+    MAKE_FUNCTION(l, "MAP-PUT", map_put_fw);
+    MAKE_FUNCTION(l, "MAP-REMOVE", map_remove_fw);
+    MAKE_FUNCTION(l, "MAP-COUNT", map_count_fw);
+    MAKE_FUNCTION(l, "MAP-ALIST", map_alist_fw);
+
+    MAKE_FUNCTION(l, "LINES", lines_fw);
+    MAKE_FUNCTION(l, "FORMS", forms_fw);
+    MAKE_FUNCTION(l, "LAZY-MAP", lazy_map_fw);
+    MAKE_FUNCTION(l, "LAZY-FILTER", lazy_filter_fw);
+    MAKE_FUNCTION(l, "TAKE", take_fw);
+    MAKE_FUNCTION(l, "LAZY-REDUCE", lazy_reduce_fw);
+    MAKE_FUNCTION(l, "FORCE", force_fw);
+
+    MAKE_FUNCTION(l, "MAPCAR", mapcar_fw);
+    MAKE_FUNCTION(l, "MAP", mapcar_fw);
+    MAKE_FUNCTION(l, "FILTER", filter_fw);
+    MAKE_FUNCTION(l, "REDUCE", reduce_fw);
+    MAKE_FUNCTION(l, "COMP", comp_fw);
+    MAKE_FUNCTION(l, "TRANSDUCE", transduce_fw);
+
+    MAKE_FUNCTION(l, "MAKE-ARRAY", make_array_fw);
+    MAKE_FUNCTION(l, "AREF", aref_fw);
+    MAKE_FUNCTION(l, "ASET", aset_fw);
+    MAKE_FUNCTION(l, "ALENGTH", alength_fw);
+    MAKE_FUNCTION(l, "ARRAY-ADD", array_add_fw);
+    MAKE_FUNCTION(l, "ARRAY-MUL", array_mul_fw);
+    MAKE_FUNCTION(l, "ARRAY-SUM", array_sum_fw);
+    MAKE_FUNCTION(l, "ARRAY-MIN", array_min_fw);
+    MAKE_FUNCTION(l, "ARRAY-MAX", array_max_fw);
+    MAKE_FUNCTION(l, "ARRAY-DOT", array_dot_fw);
+    MAKE_FUNCTION(l, "ARRAY-PREFIX-SUM", array_prefix_sum_fw);
+
+    MAKE_VFUNCTION(l, "+", add_fw);
+    MAKE_VFUNCTION(l, "-", sub_fw);
+    MAKE_VFUNCTION(l, "*", mul_fw);
+    MAKE_VFUNCTION(l, "/", div_fw);
+    MAKE_VFUNCTION(l, "MOD", mod_fw);
+    MAKE_VFUNCTION(l, "<", lt_fw);
+    MAKE_VFUNCTION(l, ">", gt_fw);
+    MAKE_VFUNCTION(l, "=", num_eq_fw);
+    MAKE_VFUNCTION(l, "<=", le_fw);
+    MAKE_VFUNCTION(l, ">=", ge_fw);
+
+    MAKE_FUNCTION(l, "OPTIMIZE", optimize_fw);
+    MAKE_FUNCTION(l, "OPT-REPORT", opt_report_fw);
+    MAKE_FUNCTION(l, "JIT", jit_fw);
+    MAKE_FUNCTION(l, "MAX-DEPTH", max_depth_fw);
+
+    MAKE_PURE(l, "CONS", FUNCTION_EFFECT_FREE);
+    MAKE_PURE(l, "HCONS", FUNCTION_EFFECT_FREE);
+    MAKE_PURE(l, "VREF", FUNCTION_EFFECT_FREE);
+    MAKE_PURE(l, "VLENGTH", FUNCTION_EFFECT_FREE);
+    MAKE_PURE(l, "GETHASH", FUNCTION_EFFECT_FREE);
+    MAKE_PURE(l, "HASH-TABLE-COUNT", FUNCTION_EFFECT_FREE);
+    MAKE_PURE(l, "MAP-GET", FUNCTION_EFFECT_FREE);
+    MAKE_PURE(l, "MAP-PUT", FUNCTION_EFFECT_FREE);
+    MAKE_PURE(l, "MAP-COUNT", FUNCTION_EFFECT_FREE);
+    MAKE_PURE(l, "AREF", FUNCTION_EFFECT_FREE);
+    MAKE_PURE(l, "ALENGTH", FUNCTION_EFFECT_FREE);
+
+    /* MOD is left out: it panics unless given exactly two arguments */
+    MAKE_PURE(l, "ATOM", FUNCTION_PURE);
+    MAKE_PURE(l, "EQ", FUNCTION_PURE);
+    MAKE_PURE(l, "CAR", FUNCTION_PURE);
+    MAKE_PURE(l, "CDR", FUNCTION_PURE);
+    MAKE_PURE(l, "+", FUNCTION_PURE_INTEGERS);
+    MAKE_PURE(l, "-", FUNCTION_PURE_INTEGERS);
+    MAKE_PURE(l, "*", FUNCTION_PURE_INTEGERS);
+    MAKE_PURE(l, "/", FUNCTION_PURE_INTEGERS);
+    MAKE_PURE(l, "<", FUNCTION_PURE_INTEGERS);
+    MAKE_PURE(l, ">", FUNCTION_PURE_INTEGERS);
+    MAKE_PURE(l, "=", FUNCTION_PURE_INTEGERS);
+    MAKE_PURE(l, "<=", FUNCTION_PURE_INTEGERS);
+    MAKE_PURE(l, ">=", FUNCTION_PURE_INTEGERS);
+
+    MAKE_PRIM(l, "CAR", PRIM_CAR);
+    MAKE_PRIM(l, "CDR", PRIM_CDR);
+    MAKE_PRIM(l, "CONS", PRIM_CONS);
+    MAKE_PRIM(l, "EQ", PRIM_EQ);
+    MAKE_PRIM(l, "ATOM", PRIM_ATOM);
 
     MAKE_BUILTIN(l, "DEFUN", SEXPR_DEFUN);
 
+    jit_init(l);
+
     return l;
 }
 
 object_t *lisp_error(lisp_t * l, object_t * sym) {
+    /* the optimizer trying a call gives up on it instead */
+    if(l->opt_folding) {
+        l->opt_failed = 1;
+        return NULL;
+    }
+
     object_t *handpair =
         lisp_env_resolv(l, l->env, object_symbol_new("*ERROR-HANDLER*"));
 
@@ -213,3 +1135,31 @@ object_t *lisp_error(lisp_t * l, object_t * sym) {
 
     return r;
 }
+
+/** Return the scratch buffer, grown to hold at least sz bytes.
+ *
+ *  The buffer is reused by every read, and grows geometrically so that
+ *  accumulating n bytes costs O(n). Growing may move it: callers must use
+ *  the returned pointer and keep offsets, not pointers, into it.
+ */
+char *lisp_scratch(lisp_t * l, size_t sz) {
+    if(sz <= l->scratch_sz)
+        return l->scratch;
+
+    size_t scratch_sz = l->scratch_sz ? l->scratch_sz : 256;
+
+    while(scratch_sz < sz)
+        scratch_sz *= 2;
+
+    char *scratch = realloc(l->scratch, scratch_sz);
+
+    if(scratch == NULL) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+
+    l->scratch = scratch;
+    l->scratch_sz = scratch_sz;
+
+    return scratch;
+}
@@ -6,17 +6,65 @@
 
 typedef struct lisp_t lisp_t;
 typedef struct lisp_env_t lisp_env_t;
+typedef struct assoc_cache_t assoc_cache_t;
+typedef struct eval_segment_t eval_segment_t;
+
+#define ASSOC_CACHE_SZ 64       // lists tracked at once, a power of two
+#define MAX_DEPTH 1000000       // nested evaluations, see lisp_eval()
 
 struct lisp_env_t {
     object_t *labels;
+    object_t *closures;         // lambdas made in this frame, see closure()
     lisp_env_t *outer;
 };
 
+/** What assoc() knows about one long list, see assoc(). */
+struct assoc_cache_t {
+    object_t *head;
+    object_t *car;              // head's fields when the entry was made,
+    object_t *cdr;              // to notice the cell being modified
+    object_t *tail;             // last cell once indexed, to notice appends
+    size_t hits;
+    object_t *index;            // hash table of key -> first pair, or NULL
+};
+
 struct lisp_t {
     lisp_env_t *env;
+    lisp_env_t *global;         // outermost frame, below every function's
     object_t *readtable;
 
     object_t *t;
+
+    char *scratch;              // reader buffer, see lisp_scratch()
+    size_t scratch_sz;
+
+    assoc_cache_t assoc_cache[ASSOC_CACHE_SZ];
+
+    object_t **hcons;           // canonical conses, see hcons()
+    size_t hcons_sz;
+    size_t hcons_count;
+    int hcons_read;             // the reader builds lists with hcons()
+
+    object_t *macro_cache;      // call form -> expansion, see evmacr()
+
+    int optimize;               // the reader runs lisp_optimize()
+    int opt_folding;            // errors are recorded in opt_failed instead
+    int opt_failed;             // of being signalled, see lisp_error()
+    object_t *opt_report;       // what lisp_optimize() did, newest first
+
+    int jit;                    // hot lambdas are compiled, see jit.c
+    unsigned prim_epoch;        // bumped whenever a builtin is rebound
+    object_t *jit_builtins;     // what the names compiled code open-codes
+                                // were bound to, see jit_init()
+    unsigned prims_epoch;       // prim_epoch when prims was worked out
+    unsigned prims;             // bit p set while PRIM p is bound to its
+                                // builtin, see evprim()
+
+    size_t depth;               // evaluations in progress
+    size_t max_depth;           // deeper ones signal STACK-OVERFLOW
+    char *stack_limit;          // evaluation moves to a new stack segment
+    eval_segment_t *segment;    // below this, see eval_segment()
+    eval_segment_t *segments;
 };
 
 lisp_t *lisp_new();
@@ -27,4 +75,6 @@ object_t *lisp_env_resolv(lisp_t *, lisp_env_t *, object_t *);
 
 object_t *lisp_error(lisp_t *, object_t *);
 
+char *lisp_scratch(lisp_t *, size_t);
+
 #endif
@@ -1,4 +1,10 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
 
 #include "object.h"
 #include "logger.h"
@@ -8,17 +14,89 @@
 #include "lisp_read.h"
 #include "builtin.h"
 #include "stream.h"
-
+#include "hashtable.h"
+#include "jit.h"
+
+/* Deep evaluations do not run out of C stack: once the stack at hand is
+ * down to its last EVAL_STACK_SLACK bytes, lisp_eval() carries on on a
+ * stack segment of its own, mapped on first use and kept for the next
+ * time evaluation gets this deep. Segments are reserved, not committed, so
+ * only the pages actually used take memory. Evaluation starts out on the
+ * caller's stack, of which it uses at most EVAL_STACK_NATIVE bytes. */
+
+#define EVAL_STACK_NATIVE (1 << 20)
+#define EVAL_STACK_SEGMENT (64 << 20)
+#define EVAL_STACK_SLACK (1 << 20)      // for builtins, between evaluations
+#define EVAL_STACK_GUARD 4096
+
+struct eval_segment_t {
+    char *stack;                // EVAL_STACK_SEGMENT bytes
+    ucontext_t start;           // the segment's context before it is run
+    ucontext_t ctx;
+    ucontext_t back;            // where to return to once done
+    lisp_t *l;
+    object_t *exp;
+    object_t *(*fn) (lisp_t *, size_t, object_t **);   // else exp
+    size_t argc;
+    object_t **argv;
+    object_t *r;
+    eval_segment_t *outer;      // the segment evaluation moved from
+    eval_segment_t *next;       // the one it moves to from here
+};
+
+static object_t *eval(lisp_t *, object_t *);
+static object_t *eval_segment(lisp_t *, object_t *,
+                              object_t * (*)(lisp_t *, size_t, object_t **),
+                              size_t, object_t **);
 static object_t *evatom(lisp_t *, object_t *);
-static object_t *evfun(lisp_t *, object_t *);
-static object_t *evmacr(lisp_t *, object_t *);
-static object_t *evlamb(lisp_t *, object_t *);
+static object_t *evfun(lisp_t *, object_t *, object_t *);
+static object_t *evmacr(lisp_t *, object_t *, object_t *);
+static object_t *evlamb(lisp_t *, object_t *, object_t *);
+static object_t *call_lambda(lisp_t *, object_t *, size_t, object_t **);
+static object_t *apply_vector(lisp_t *, object_function_t *, object_t *);
 static object_t *evread(lisp_t *);
 static object_t *evloop(lisp_t *, object_t *);
 static object_t *evcond(lisp_t *, object_t *);
+static object_t *evinline(lisp_t *, object_t *);
 static object_t *evlis(lisp_t *, object_t *);
+static function_prim_t evprim(lisp_t *, object_t *, object_t *);
+static object_t *evprimcall(lisp_t *, function_prim_t, object_t *);
+
+static int is_symbol(object_t * o, const char *name) {
+    return object_isa(o, OBJECT_SYMBOL)
+        && !strcmp(((object_symbol_t *) o)->name, name);
+}
+
+/** Is the C stack down to where evaluation should move to a new segment?
+ *  The outermost evaluation marks how far it may go on the caller's. */
+static int eval_stack_low(lisp_t * l) {
+    char here;
+
+    if(l->depth == 0)
+        l->stack_limit = (char *) ((uintptr_t) & here - EVAL_STACK_NATIVE);
+
+    return (uintptr_t) & here < (uintptr_t) l->stack_limit;
+}
+
+/** Signal STACK-OVERFLOW; the error handler runs without the limit. */
+static object_t *eval_overflow(lisp_t * l) {
+    size_t max_depth = l->max_depth;
+
+    l->max_depth = SIZE_MAX;
 
-/** Evaluate a LISP form.  */
+    object_t *r = lisp_error(l, object_symbol_new("STACK-OVERFLOW"));
+
+    l->max_depth = max_depth;
+
+    return r;
+}
+
+/** Evaluate a LISP form.
+ *
+ *  Forms may nest up to l->max_depth evaluations deep (see MAX-DEPTH),
+ *  deeper ones signal STACK-OVERFLOW. The error handler runs without the
+ *  limit, and what it returns is the value of the form.
+ */
 object_t *lisp_eval(lisp_t * l, object_t * exp) {
     if(exp == NULL)
         return NULL;
@@ -26,47 +104,160 @@ object_t *lisp_eval(lisp_t * l, object_t * exp) {
     if(atom(l, exp))
         return evatom(l, exp);
 
+    if(l->depth >= l->max_depth)
+        return eval_overflow(l);
+
+    int low = eval_stack_low(l);
+
+    l->depth++;
+
+    object_t *r = low ? eval_segment(l, exp, NULL, 0, NULL) : eval(l, exp);
+
+    l->depth--;
+
+    return r;
+}
+
+/** Call fn, a function of the vector convention, on argv as one more
+ *  nested evaluation: it counts against MAX-DEPTH and moves to a new stack
+ *  segment when the stack runs low, as in lisp_eval(). For compiled code,
+ *  whose calls bypass lisp_eval(). */
+object_t *lisp_call_nested(lisp_t * l,
+                           object_t * (*fn) (lisp_t *, size_t, object_t **),
+                           size_t argc, object_t ** argv) {
+    if(l->depth >= l->max_depth)
+        return eval_overflow(l);
+
+    int low = eval_stack_low(l);
+
+    l->depth++;
+
+    object_t *r = low ? eval_segment(l, NULL, fn, argc, argv)
+        : fn(l, argc, argv);
+
+    l->depth--;
+
+    return r;
+}
+
+static void eval_run(unsigned hi, unsigned lo) {
+    eval_segment_t *s =
+        (eval_segment_t *) (((uintptr_t) hi << 16 << 16) | lo);
+
+    s->r = s->fn ? s->fn(s->l, s->argc, s->argv) : eval(s->l, s->exp);
+}
+
+/** Evaluate the form exp, or call fn on argv if given, on the next stack
+ *  segment, see lisp_eval(). */
+static object_t *eval_segment(lisp_t * l, object_t * exp,
+                              object_t * (*fn) (lisp_t *, size_t,
+                                                object_t **), size_t argc,
+                              object_t ** argv) {
+    eval_segment_t **next = l->segment ? &l->segment->next : &l->segments;
+    eval_segment_t *volatile s = *next;
+
+    if(s == NULL) {
+        if((s = calloc(1, sizeof(eval_segment_t))) == NULL) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+
+        s->stack = mmap(NULL, EVAL_STACK_SEGMENT, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+        /* the lowest page faults, should the slack ever not do */
+        if((s->stack == MAP_FAILED)
+           || (mprotect(s->stack, EVAL_STACK_GUARD, PROT_NONE) != 0)) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+
+        if(getcontext(&s->start) != 0) {
+            perror("getcontext");
+            exit(EXIT_FAILURE);
+        }
+
+        s->start.uc_stack.ss_sp = s->stack;
+        s->start.uc_stack.ss_size = EVAL_STACK_SEGMENT;
+        s->start.uc_link = &s->back;
+
+        *next = s;
+    }
+
+    char *stack_limit = l->stack_limit;
+    uintptr_t p = (uintptr_t) s;
+
+    s->l = l;
+    s->exp = exp;
+    s->fn = fn;
+    s->argc = argc;
+    s->argv = argv;
+    s->outer = l->segment;
+    s->ctx = s->start;
+    makecontext(&s->ctx, (void (*)(void)) eval_run, 2,
+                (unsigned) (p >> 16 >> 16), (unsigned) p);
+
+    l->segment = s;
+    l->stack_limit = s->stack + EVAL_STACK_SLACK;
+
+    if(swapcontext(&s->back, &s->ctx) != 0) {
+        perror("swapcontext");
+        exit(EXIT_FAILURE);
+    }
+
+    l->segment = s->outer;
+    l->stack_limit = stack_limit;
+
+    return s->r;
+}
+
+static object_t *eval(lisp_t * l, object_t * exp) {
     if(atom(l, car(exp))) {
         object_t *op = car(exp);
 
         if(op == NULL)
             PANIC("operator is nil");
 
-        if(eq(l, op, object_symbol_new("QUOTE"))) {
-            return car(cdr(exp));
-        }
-        else if(eq(l, op, object_symbol_new("LAMBDA"))) {
-            return lambda(car(cdr(exp)), car(cdr(cdr(exp))));
-        }
-        else if(eq(l, op, object_symbol_new("MACRO"))) {
-            return macro(car(cdr(exp)), car(cdr(cdr(exp))));
-        }
-        else if(eq(l, op, object_symbol_new("ERROR"))) {
-            return lisp_error(l, lisp_eval(l, car(cdr(exp))));
-        }
-        else if(eq(l, op, object_symbol_new("LABEL"))) {
-            return label(l, car(cdr(exp)), lisp_eval(l, car(cdr(cdr(exp)))));
-        }
-        else if(eq(l, op, object_symbol_new("COND"))) {
-            return evcond(l, cdr(exp));
-        }
-        else if(eq(l, op, object_symbol_new("PRINT"))) {
-            return lisp_print(l, lisp_eval(l, car(cdr(exp))));
-        }
-        else if(eq(l, op, object_symbol_new("LOOP"))) {
-            return evloop(l, car(cdr(exp)));
-        }
-        else if(eq(l, op, object_symbol_new("READ"))) {
-            return evread(l);
+        if(object_isa(op, OBJECT_SYMBOL)) {
+            /* told apart by name, without allocating: these are hot */
+            if(is_symbol(op, "INLINE"))
+                return evinline(l, cdr(exp));
+
+            function_prim_t p = evprim(l, op, cdr(exp));
+
+            if(p != PRIM_NONE)
+                return evprimcall(l, p, cdr(exp));
+
+            if(is_symbol(op, "QUOTE"))
+                return car(cdr(exp));
+            else if(is_symbol(op, "LAMBDA"))
+                return closure(l, car(cdr(exp)), car(cdr(cdr(exp))));
+            else if(is_symbol(op, "MACRO"))
+                return macro(car(cdr(exp)), car(cdr(cdr(exp))));
+            else if(is_symbol(op, "ERROR"))
+                return lisp_error(l, lisp_eval(l, car(cdr(exp))));
+            else if(is_symbol(op, "LABEL"))
+                return label(l, car(cdr(exp)),
+                             lisp_eval(l, car(cdr(cdr(exp)))));
+            else if(is_symbol(op, "COND"))
+                return evcond(l, cdr(exp));
+            else if(is_symbol(op, "PRINT"))
+                return lisp_print(l, lisp_eval(l, car(cdr(exp))));
+            else if(is_symbol(op, "LOOP"))
+                return evloop(l, car(cdr(exp)));
+            else if(is_symbol(op, "READ"))
+                return evread(l);
+            else if(is_symbol(op, "DEFSTRUCT"))
+                return defstruct(l, car(cdr(exp)), cdr(cdr(exp)));
         }
 
         switch (op->type) {
         case OBJECT_LAMBDA:
-            return evlamb(l, exp);
+            return evlamb(l, op, cdr(exp));
         case OBJECT_MACRO:
-            return evmacr(l, exp);
+            return evmacr(l, op, exp);
         case OBJECT_FUNCTION:
-            return evfun(l, exp);
+            return evfun(l, op, cdr(exp));
         case OBJECT_SYMBOL:
             break;              // will be handled right after switch statement
         case OBJECT_CONS:
@@ -74,6 +265,13 @@ object_t *lisp_eval(lisp_t * l, object_t * exp) {
         case OBJECT_INTEGER:
         case OBJECT_STRING:
         case OBJECT_STREAM:
+        case OBJECT_VECTOR:
+        case OBJECT_HASHTABLE:
+        case OBJECT_ARRAY:
+        case OBJECT_MAP:
+        case OBJECT_STRUCT:
+        case OBJECT_LAZY:
+        case OBJECT_TRANSDUCER:
             PANIC("lisp_eval: something is wrong: %d", exp->type);
         }
 
@@ -87,7 +285,19 @@ object_t *lisp_eval(lisp_t * l, object_t * exp) {
             return NULL;
         }
 
-        return lisp_eval(l, cons(car(cdr(fpair)), cdr(exp)));
+        /* call what the symbol is bound to without building a new form */
+        object_t *fn = car(cdr(fpair));
+
+        if(object_isa(fn, OBJECT_FUNCTION))
+            return evfun(l, fn, cdr(exp));
+
+        if(object_isa(fn, OBJECT_LAMBDA))
+            return evlamb(l, fn, cdr(exp));
+
+        if(object_isa(fn, OBJECT_MACRO))
+            return evmacr(l, fn, exp);
+
+        return lisp_eval(l, cons(fn, cdr(exp)));
     }
     else {
         return lisp_eval(l, cons(lisp_eval(l, car(exp)), cdr(exp)));
@@ -96,10 +306,104 @@ object_t *lisp_eval(lisp_t * l, object_t * exp) {
     PANIC("lisp_eval: not yet implemented!");
 }
 
+static const char *prim_names[] = {
+    [PRIM_CAR] = "CAR",
+    [PRIM_CDR] = "CDR",
+    [PRIM_CONS] = "CONS",
+    [PRIM_EQ] = "EQ",
+    [PRIM_ATOM] = "ATOM",
+};
+
+#define PRIMS (sizeof(prim_names) / sizeof(prim_names[0]))
+
+/** Which builtin a call of op with the argument forms args is, if it can
+ *  be run in line: op must be bound to it, globally and without being
+ *  shadowed by the current frames, and args must be as many as it takes.
+ *
+ *  What is bound globally is worked out again after label() has rebound
+ *  a builtin, which it tells by bumping l->prim_epoch. */
+static function_prim_t evprim(lisp_t * l, object_t * op, object_t * args) {
+    function_prim_t p = PRIM_NONE;
+
+    for(size_t i = 1; (p == PRIM_NONE) && (i < PRIMS); i++) {
+        if(!strcmp(((object_symbol_t *) op)->name, prim_names[i]))
+            p = i;
+    }
+
+    if(p == PRIM_NONE)
+        return p;
+
+    if(l->prims_epoch != l->prim_epoch) {
+        l->prims = 0;
+
+        for(size_t i = 1; i < PRIMS; i++) {
+            object_t *fn = car(cdr(lisp_env_resolv(l, l->global,
+                                                   object_symbol_new((char *)
+                                                                     prim_names
+                                                                     [i]))));
+
+            if(object_isa(fn, OBJECT_FUNCTION)
+               && (((object_function_t *) fn)->prim == i))
+                l->prims |= 1U << i;
+        }
+
+        l->prims_epoch = l->prim_epoch;
+    }
+
+    if(!(l->prims & (1U << p)))
+        return PRIM_NONE;
+
+    for(lisp_env_t * e = l->env; (e != NULL) && (e != l->global);
+        e = e->outer) {
+        for(object_t * kv = e->labels; kv != NULL; kv = cdr(kv)) {
+            if(eq(l, car(car(kv)), op))
+                return PRIM_NONE;
+        }
+    }
+
+    if((args == NULL) || ((p == PRIM_CONS || p == PRIM_EQ)
+                          ? (cdr(args) == NULL) || (cdr(cdr(args)) != NULL)
+                          : (cdr(args) != NULL)))
+        return PRIM_NONE;
+
+    return p;
+}
+
+/** Run the builtin p on the argument forms args, see evprim(). */
+static object_t *evprimcall(lisp_t * l, function_prim_t p, object_t * args) {
+    object_t *a = lisp_eval(l, car(args));
+
+    switch (p) {
+    case PRIM_CAR:
+        return car(a);
+    case PRIM_CDR:
+        return cdr(a);
+    case PRIM_ATOM:
+        return atom(l, a);
+    case PRIM_CONS:
+        return cons(a, lisp_eval(l, car(cdr(args))));
+    case PRIM_EQ:
+        return eq(l, a, lisp_eval(l, car(cdr(args))));
+    case PRIM_NONE:
+        break;
+    }
+
+    PANIC("evprimcall: not a primitive: %d", p);
+
+    return NULL;
+}
+
 static object_t *evatom(lisp_t * l, object_t * exp) {
     switch (exp->type) {
     case OBJECT_INTEGER:
     case OBJECT_STRING:
+    case OBJECT_VECTOR:
+    case OBJECT_HASHTABLE:
+    case OBJECT_ARRAY:
+    case OBJECT_MAP:
+    case OBJECT_STRUCT:
+    case OBJECT_LAZY:
+    case OBJECT_TRANSDUCER:
         return exp;
     case OBJECT_SYMBOL:
         if(eq(l, exp, l->t))
@@ -125,49 +429,202 @@ static object_t *evatom(lisp_t * l, object_t * exp) {
     return NULL;
 }
 
-static object_t *evfun(lisp_t * l, object_t * exp) {
-    object_function_t *f = (object_function_t *) car(exp);
+/** Call a builtin on the unevaluated argument forms exprs.
+ *
+ *  Functions with the vector convention get their arguments evaluated
+ *  into an array on the C stack, so the call conses nothing.
+ */
+static object_t *evfun(lisp_t * l, object_t * fn, object_t * exprs) {
+    object_function_t *f = (object_function_t *) fn;
 
     // TODO validate args against argdef
 
-    return f->fptr(l, evlis(l, cdr(exp)));
+    if((f->vptr == NULL) && (f->sptr == NULL))
+        return f->fptr(l, evlis(l, exprs));
+
+    size_t argc = 0;
+
+    for(object_t * o = exprs; o != NULL; o = cdr(o))
+        argc++;
+
+    object_t *argv[argc ? argc : 1];
+
+    for(size_t i = 0; i < argc; i++, exprs = cdr(exprs))
+        argv[i] = lisp_eval(l, car(exprs));
+
+    if(f->sptr != NULL)
+        return f->sptr(l, f, argc, argv);
+
+    return f->vptr(l, argc, argv);
 }
 
-static object_t *evmacr(lisp_t * l, object_t * exp) {
-    object_macro_t *m = (object_macro_t *) car(exp);
+/** Evaluate the expansion of the macro call exp.
+ *
+ *  Expansions are remembered by the identity of the call form, as
+ *  (macro . expansion), so a call that is run again costs a lookup plus
+ *  its expansion. The same form may name different macros, through a
+ *  parameter, so it is expanded again when fn is not the cached macro.
+ *  label() forgets them all when it binds or rebinds a macro. The form is
+ *  not displaced in place, as it may share cells with quoted data (see
+ *  hcons()).
+ */
+static object_t *evmacr(lisp_t * l, object_t * fn, object_t * exp) {
+    object_t *x = hashtable_get(l, l->macro_cache, exp, NULL);
 
     // TODO validate args against argdef
 
-    /* Pair argument names to input, create env */
-    object_t *env_pair = pair(l, m->args, cdr(exp));
+    if(car(x) != fn) {
+        x = cons(fn, macro_apply(l, fn, cdr(exp)));
+        hashtable_put(l, l->macro_cache, exp, x);
+    }
 
-    l->env = lisp_env_new(l->env, env_pair);
+    return lisp_eval(l, cdr(x));
+}
 
-    object_t *r = lisp_eval(l, m->expr);
+/** Evaluate (INLINE fn call body), a call inlined by lisp_optimize().
+ *
+ *  body is what call does as long as the operator of call is still bound
+ *  to fn; once it was redefined, or is shadowed here, call is made.
+ */
+static object_t *evinline(lisp_t * l, object_t * exp) {
+    object_t *call = car(cdr(exp));
+    object_t *fn = car(cdr(lisp_env_resolv(l, l->env, car(call))));
 
-    l->env = lisp_env_pop(l->env);
+    if(fn == car(exp))
+        return lisp_eval(l, car(cdr(cdr(exp))));
 
-    return r;
+    return lisp_eval(l, call);
 }
 
-static object_t *evlamb(lisp_t * l, object_t * exp) {
-    object_lambda_t *lamb = (object_lambda_t *) car(exp);
+static object_t *evlamb(lisp_t * l, object_t * fn, object_t * exprs) {
+    size_t argc = 0;
 
     // TODO validate args agains argdef
 
-    /* Pair argument names to input, create env */
-    object_t *args = cdr(exp);
-    object_t *env_pair = pair(l, lamb->args, evlis(l, args));
+    for(object_t * o = exprs; o != NULL; o = cdr(o))
+        argc++;
+
+    object_t *argv[argc ? argc : 1];
+
+    for(size_t i = 0; i < argc; i++, exprs = cdr(exprs))
+        argv[i] = lisp_eval(l, car(exprs));
+
+    return call_lambda(l, fn, argc, argv);
+}
+
+/** Call a lambda on argc evaluated arguments, through its machine code
+ *  once it is hot (see jit_run()), else by evaluating its body. */
+static object_t *call_lambda(lisp_t * l, object_t * fn, size_t argc,
+                             object_t ** argv) {
+    object_t *r, *args = NULL;
+
+    /* machine code runs on the stack at hand: when that runs low, or the
+     * limit is reached, the body is evaluated, see lisp_eval() */
+    if(!eval_stack_low(l) && (l->depth < l->max_depth)) {
+        l->depth++;
+
+        int ran = jit_run(l, (object_lambda_t *) fn, argc, argv, &r);
+
+        l->depth--;
 
-    l->env = lisp_env_new(l->env, env_pair);
+        if(ran)
+            return r;
+    }
+
+    while(argc > 0)
+        args = cons(argv[--argc], args);
+
+    return lisp_apply(l, fn, args);
+}
+
+/** Call a function or lambda with a list of evaluated arguments. */
+object_t *lisp_apply(lisp_t * l, object_t * fn, object_t * args) {
+    if(fn == NULL)
+        PANIC("lisp_apply: function is nil");
+
+    switch (fn->type) {
+    case OBJECT_FUNCTION:
+        if((((object_function_t *) fn)->vptr != NULL)
+           || (((object_function_t *) fn)->sptr != NULL))
+            return apply_vector(l, (object_function_t *) fn, args);
+
+        return ((object_function_t *) fn)->fptr(l, args);
+    case OBJECT_LAMBDA:
+        break;
+    default:
+        PANIC("lisp_apply: cannot apply object of type %d", fn->type);
+    }
+
+    object_lambda_t *lamb = (object_lambda_t *) fn;
+    lisp_env_t *caller = l->env;
+
+    /* Pair argument names to input, followed by what the lambda closed
+     * over; the body sees that frame and the globals, not the caller's */
+    object_t *env_pair = pair(l, lamb->args, args);
+
+    if(env_pair == NULL)
+        env_pair = lamb->closed;
+    else if(lamb->closed != NULL) {
+        object_t *last = env_pair;
+
+        while(cdr(last) != NULL)
+            last = cdr(last);
+
+        ((object_cons_t *) last)->cdr = lamb->closed;
+    }
+
+    l->env = lisp_env_new(l->global, env_pair);
 
     object_t *r = lisp_eval(l, lamb->expr);
 
-    l->env = lisp_env_pop(l->env);
+    l->env = caller;
 
     return r;
 }
 
+/** Call fn on argc arguments, without consing them into a list when fn
+ *  takes them as an array. */
+object_t *lisp_call(lisp_t * l, object_t * fn, size_t argc, object_t ** argv) {
+    if(object_isa(fn, OBJECT_FUNCTION)) {
+        object_function_t *f = (object_function_t *) fn;
+
+        if(f->sptr != NULL)
+            return f->sptr(l, f, argc, argv);
+
+        if(f->vptr != NULL)
+            return f->vptr(l, argc, argv);
+    }
+
+    if(object_isa(fn, OBJECT_LAMBDA))
+        return call_lambda(l, fn, argc, argv);
+
+    object_t *args = NULL;
+
+    while(argc > 0)
+        args = cons(argv[--argc], args);
+
+    return lisp_apply(l, fn, args);
+}
+
+/** Call a vector convention builtin with an argument list. */
+static object_t *apply_vector(lisp_t * l, object_function_t * f,
+                              object_t * args) {
+    size_t argc = 0;
+
+    for(object_t * o = args; o != NULL; o = cdr(o))
+        argc++;
+
+    object_t *argv[argc ? argc : 1];
+
+    for(size_t i = 0; i < argc; i++, args = cdr(args))
+        argv[i] = car(args);
+
+    if(f->sptr != NULL)
+        return f->sptr(l, f, argc, argv);
+
+    return f->vptr(l, argc, argv);
+}
+
 // TODO mother fsck'er!
 static object_t *evread(lisp_t * l) {
     size_t lnsz = 128;
@@ -188,18 +645,27 @@ static object_t *evloop(lisp_t * l, object_t * obj) {
 }
 
 static object_t *evcond(lisp_t * l, object_t * exp) {
-    if(exp == NULL)
-        return NULL;
-
-    if(lisp_eval(l, car(car(exp))))
-        return lisp_eval(l, car(cdr(car(exp))));
+    for(; exp != NULL; exp = cdr(exp)) {
+        if(lisp_eval(l, car(car(exp))))
+            return lisp_eval(l, car(cdr(car(exp))));
+    }
 
-    return evcond(l, cdr(exp));
+    return NULL;
 }
 
 static object_t *evlis(lisp_t * l, object_t * exp) {
-    if(exp == NULL)
-        return NULL;
+    object_t *list = NULL, *tail = NULL;
+
+    for(; exp != NULL; exp = cdr(exp)) {
+        object_t *o = cons(lisp_eval(l, car(exp)), NULL);
+
+        if(list == NULL)
+            list = o;
+        else
+            ((object_cons_t *) tail)->cdr = o;
+
+        tail = o;
+    }
 
-    return cons(lisp_eval(l, car(exp)), evlis(l, cdr(exp)));
+    return list;
 }
@@ -4,5 +4,10 @@
 #include "lisp.h"
 
 object_t *lisp_eval(lisp_t *, object_t *);
+object_t *lisp_apply(lisp_t *, object_t *, object_t *);
+object_t *lisp_call(lisp_t *, object_t *, size_t, object_t **);
+object_t *lisp_call_nested(lisp_t *,
+                           object_t * (*)(lisp_t *, size_t, object_t **),
+                           size_t, object_t **);
 
 #endif
@@ -0,0 +1,247 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lisp_load.h"
+#include "lisp_read.h"
+#include "logger.h"
+#include "stream.h"
+#include "scan.h"
+#include "hcons.h"
+
+/* Files smaller than this are not worth a thread per chunk. */
+#define LOAD_CHUNK_MIN (64 * 1024)
+
+typedef struct {
+    lisp_t *lisp;
+    const char *buf;
+    size_t len;
+    object_t *head;
+    object_t *tail;
+} load_chunk_t;
+
+static void load_split(const char *, size_t, size_t *, size_t);
+static void *load_chunk(void *);
+
+/** Read every top-level form of a data file into one list, in order.
+ *
+ *  The file is split at top-level form boundaries into (at most) nthreads
+ *  chunks which are read concurrently, each by its own reader with its own
+ *  readtable. The per-chunk lists are then joined. Forms are data: they
+ *  are neither macroexpanded nor evaluated. If nthreads is 0, one thread
+ *  per online CPU is used, unless the file is too small to be worth it.
+ */
+object_t *lisp_load_data(lisp_t * l, const char *path, size_t nthreads) {
+    int fd = open(path, O_RDONLY);
+
+    if(fd == -1) {
+        perror("open");
+        return lisp_error(l, object_symbol_new("FILE-ERROR"));
+    }
+
+    struct stat st;
+
+    if(fstat(fd, &st) == -1) {
+        perror("fstat");
+        close(fd);
+        return lisp_error(l, object_symbol_new("FILE-ERROR"));
+    }
+
+    size_t len = st.st_size;
+
+    if(len == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    const char *buf = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if(buf == MAP_FAILED) {
+        perror("mmap");
+        return lisp_error(l, object_symbol_new("FILE-ERROR"));
+    }
+
+    if(nthreads == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+        nthreads = ncpu > 0 ? (size_t) ncpu : 1;
+
+        if(nthreads > len / LOAD_CHUNK_MIN)
+            nthreads = len / LOAD_CHUNK_MIN;
+    }
+
+    if(nthreads > len)
+        nthreads = len;
+
+    if(nthreads == 0)
+        nthreads = 1;
+
+    size_t *splits = calloc(nthreads + 1, sizeof(size_t));
+    load_chunk_t *chunks = calloc(nthreads, sizeof(load_chunk_t));
+    pthread_t *threads = calloc(nthreads, sizeof(pthread_t));
+
+    if((splits == NULL) || (chunks == NULL) || (threads == NULL)) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    load_split(buf, len, splits, nthreads);
+
+    for(size_t i = 0; i < nthreads; i++) {
+        load_chunk_t *c = &chunks[i];
+
+        c->buf = buf + splits[i];
+        c->len = splits[i + 1] - splits[i];
+
+        /* a reader needs only its readtable and T, not an environment */
+        c->lisp = calloc(1, sizeof(lisp_t));
+
+        if(c->lisp == NULL) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+
+        c->lisp->readtable = readtable_new();
+        c->lisp->t = l->t;
+
+        if(i == 0)
+            continue;
+
+        if(0 != pthread_create(&threads[i], NULL, load_chunk, c))
+            PANIC("lisp_load_data: could not create thread");
+    }
+
+    load_chunk(&chunks[0]);
+
+    for(size_t i = 1; i < nthreads; i++) {
+        if(0 != pthread_join(threads[i], NULL))
+            PANIC("lisp_load_data: could not join thread");
+    }
+
+    object_t *list = NULL, *tail = NULL;
+
+    for(size_t i = 0; i < nthreads; i++) {
+        load_chunk_t *c = &chunks[i];
+
+        if(c->head != NULL) {
+            if(list == NULL)
+                list = c->head;
+            else
+                ((object_cons_t *) tail)->cdr = c->head;
+
+            tail = c->tail;
+        }
+
+        free(c->lisp->scratch);
+        free(c->lisp);
+    }
+
+    munmap((void *) buf, len);
+
+    /* the readers had tables of their own, so share across chunks here */
+    if(l->hcons_read) {
+        for(object_cons_t * c = (object_cons_t *) list; c != NULL;
+            c = (object_cons_t *) c->cdr)
+            c->car = hcons_tree(l, c->car);
+    }
+
+    free(splits);
+    free(chunks);
+    free(threads);
+
+    return list;
+}
+
+/** Find n - 1 top-level form boundaries, spread evenly over buf.
+ *
+ *  A boundary is whitespace outside of any list, string or token, and not
+ *  between a quote character and the datum it quotes.
+ */
+static void load_split(const char *buf, size_t len, size_t *splits, size_t n) {
+    size_t depth = 0, k = 1, i = 0;
+    int in_string = 0, quoted = 0;
+
+    splits[0] = 0;
+
+    for(; (i < len) && (k < n); i++) {
+        if(in_string) {
+            i += scan_first_of(buf + i, len - i, "\"");
+            in_string = 0;
+
+            continue;
+        }
+
+        /* skip the bytes of tokens in bulk */
+        size_t skip = scan_first_of(buf + i, len - i, " \t\r\n()\"'`");
+
+        if(skip > 0) {
+            quoted = 0;
+
+            if((i += skip) == len)
+                break;
+        }
+
+        switch (buf[i]) {
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            if((depth == 0) && !quoted && (i >= len / n * k))
+                splits[k++] = i;
+
+            break;
+        case '(':
+            depth++;
+            quoted = 0;
+            break;
+        case ')':
+            if(depth > 0)
+                depth--;
+
+            break;
+        case '"':
+            in_string = 1;
+            quoted = 0;
+            break;
+        case '\'':
+        case '`':
+            if(depth == 0)
+                quoted = 1;
+
+            break;
+        }
+    }
+
+    for(; k <= n; k++)
+        splits[k] = len;
+}
+
+static void *load_chunk(void *arg) {
+    load_chunk_t *c = arg;
+
+    if(c->len == 0)
+        return NULL;
+
+    object_t *stream = istream_mem(c->buf, c->len);
+    object_t *o = NULL;
+
+    while(lisp_read_datum(c->lisp, stream, &o)) {
+        if(c->head == NULL)
+            c->head = c->tail = object_cons_new(o, NULL);
+        else
+            c->tail = ((object_cons_t *) c->tail)->cdr =
+                object_cons_new(o, NULL);
+    }
+
+    stream_close(stream);
+
+    return NULL;
+}
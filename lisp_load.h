@@ -0,0 +1,9 @@
+#ifndef __LISP_LOAD_H
+#define __LISP_LOAD_H
+
+#include "lisp.h"
+#include "object.h"
+
+object_t *lisp_load_data(lisp_t *, const char *, size_t);
+
+#endif
@@ -0,0 +1,652 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lisp_opt.h"
+#include "lisp_eval.h"
+#include "builtin.h"
+#include "logger.h"
+
+#define INLINE_MAX 24           // conses in the largest body inlined
+
+/* Simplifies macroexpanded code before it is evaluated:
+ *  - calls of pure builtins on constant arguments are replaced by their
+ *    result, (CAR '(A B)) by A,
+ *  - (QUOTE 42) and (QUOTE "s") become 42 and "s",
+ *  - COND clauses whose test is constantly false are dropped, and so are
+ *    all clauses after one whose test is constantly true; a COND left with
+ *    such a clause first becomes its expression,
+ *  - calls of small functions are replaced by their body, see opt_inline().
+ * Every simplification is recorded in l->opt_report as (FOLD form value),
+ * (PRUNE clause) or (INLINE name), newest first, see OPT-REPORT.
+ *
+ * Like macroexpand_all() the walk knows the special forms and the names
+ * LAMBDA parameters bind; calls of a parameter are never folded. Builtins
+ * are looked up when the code is read, so redefining one of them later
+ * does not affect code read before. */
+
+static object_t *opt_form(lisp_t *, object_t *, object_t *);
+
+static const char *special_forms[] = {
+    "QUOTE", "LAMBDA", "MACRO", "ERROR", "LABEL", "COND", "PRINT", "LOOP",
+    "READ", "DEFSTRUCT", "INLINE", NULL
+};
+
+static int is_symbol(object_t * o, const char *name) {
+    return object_isa(o, OBJECT_SYMBOL)
+        && !strcmp(((object_symbol_t *) o)->name, name);
+}
+
+static int is_special(object_t * o) {
+    for(size_t i = 0; special_forms[i] != NULL; i++) {
+        if(is_symbol(o, special_forms[i]))
+            return 1;
+    }
+
+    return 0;
+}
+
+/* Is x a constant? If so, store its value in *value. */
+static int opt_constant(lisp_t * l, object_t * x, object_t ** value) {
+    if(x == NULL) {
+        *value = NULL;
+        return 1;
+    }
+
+    switch (x->type) {
+    case OBJECT_INTEGER:
+    case OBJECT_STRING:
+        *value = x;
+        return 1;
+    case OBJECT_SYMBOL:
+        if(is_symbol(x, "NIL")) {
+            *value = NULL;
+            return 1;
+        }
+
+        if(eq(l, x, l->t)) {
+            *value = l->t;
+            return 1;
+        }
+
+        return 0;
+    case OBJECT_CONS:
+        if(is_symbol(car(x), "QUOTE")) {
+            *value = car(cdr(x));
+            return 1;
+        }
+
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+/* The shortest form evaluating to value, NIL as read for (). */
+static object_t *opt_quote(lisp_t * l, object_t * value) {
+    if(value == NULL)
+        return object_symbol_new("NIL");
+
+    if(object_isa(value, OBJECT_INTEGER)
+       || object_isa(value, OBJECT_STRING) || (value == l->t))
+        return value;
+
+    return cons(object_symbol_new("QUOTE"), cons(value, NULL));
+}
+
+static void opt_report(lisp_t * l, const char *what, object_t * args) {
+    object_t *entry = cons(object_symbol_new((char *) what), args);
+
+    l->opt_report = cons(entry, l->opt_report);
+}
+
+/* Replace a call of a pure builtin on constants by its result. */
+static object_t *opt_fold(lisp_t * l, object_t * labels, object_t * form) {
+    object_t *op = car(form);
+
+    if(!object_isa(op, OBJECT_SYMBOL) || is_special(op)
+       || assoc(l, op, labels))
+        return form;
+
+    object_t *fn = car(cdr(lisp_env_resolv(l, l->env, op)));
+
+    if(!object_isa(fn, OBJECT_FUNCTION))
+        return form;
+
+    function_purity_t pure = ((object_function_t *) fn)->pure;
+
+    if((pure != FUNCTION_PURE) && (pure != FUNCTION_PURE_INTEGERS))
+        return form;
+
+    size_t argc = 0;
+
+    for(object_t * a = cdr(form); a != NULL; a = cdr(a)) {
+        if(!object_isa(a, OBJECT_CONS))
+            return form;
+
+        argc++;
+    }
+
+    /* most of these panic without arguments, see object.h */
+    if((pure == FUNCTION_PURE_INTEGERS) && (argc == 0))
+        return form;
+
+    object_t *argv[argc ? argc : 1];
+    object_t *a = cdr(form);
+
+    for(size_t i = 0; i < argc; i++, a = cdr(a)) {
+        if(!opt_constant(l, car(a), &argv[i]))
+            return form;
+
+        if((pure == FUNCTION_PURE_INTEGERS)
+           && !object_isa(argv[i], OBJECT_INTEGER))
+            return form;
+    }
+
+    /* errors, like an overflow, are left for run time */
+    l->opt_folding = 1;
+    l->opt_failed = 0;
+
+    object_t *r = lisp_call(l, fn, argc, argv);
+
+    l->opt_folding = 0;
+
+    if(l->opt_failed)
+        return form;
+
+    r = opt_quote(l, r);
+    opt_report(l, "FOLD", cons(form, cons(r, NULL)));
+
+    return r;
+}
+
+/* Could x be the body of an inlined function with parameters params? It
+ * may only use the parameters, constants and calls of builtins that
+ * neither have side effects nor run Lisp code, none of which the caller
+ * binds in labels, so that it means the same where it is put, and it must
+ * be small. *size counts its conses. */
+static int opt_inlinable(lisp_t * l, object_t * x, object_t * params,
+                         object_t * labels, size_t *size) {
+    object_t *value;
+
+    if(opt_constant(l, x, &value))
+        return 1;
+
+    if(object_isa(x, OBJECT_SYMBOL))
+        return assoc(l, x, params) != NULL;
+
+    if(!object_isa(x, OBJECT_CONS) || (++*size > INLINE_MAX))
+        return 0;
+
+    object_t *op = car(x);
+    object_t *args = cdr(x);
+
+    if(is_symbol(op, "COND")) {
+        for(object_t * c = args; c != NULL; c = cdr(c)) {
+            for(object_t * e = car(c); e != NULL; e = cdr(e)) {
+                if(!opt_inlinable(l, car(e), params, labels, size))
+                    return 0;
+            }
+        }
+
+        return 1;
+    }
+
+    /* a call inlined before is as good as its body, the call itself is
+     * only made if that function is redefined */
+    if(is_symbol(op, "INLINE")) {
+        object_t *call = car(cdr(args));
+
+        if(assoc(l, car(call), params) || assoc(l, car(call), labels))
+            return 0;
+
+        *size += 2;
+        args = cons(car(cdr(cdr(args))), cdr(call));
+    }
+    else {
+        if(!object_isa(op, OBJECT_SYMBOL) || is_special(op)
+           || assoc(l, op, params) || assoc(l, op, labels))
+            return 0;
+
+        object_t *fn = car(cdr(lisp_env_resolv(l, l->env, op)));
+
+        if(!object_isa(fn, OBJECT_FUNCTION)
+           || (((object_function_t *) fn)->pure == FUNCTION_IMPURE))
+            return 0;
+    }
+
+    for(; args != NULL; args = cdr(args)) {
+        if(!object_isa(args, OBJECT_CONS)
+           || !opt_inlinable(l, car(args), params, labels, size))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* Could x be evaluated later than it is written without changing what the
+ * symbols around it mean? It must not bind names, directly or through
+ * EVAL, so it may only call builtins without side effects that the code
+ * does not bind in labels. */
+static int opt_effect_free(lisp_t * l, object_t * x, object_t * labels) {
+    object_t *value;
+
+    if(opt_constant(l, x, &value) || object_isa(x, OBJECT_SYMBOL))
+        return 1;
+
+    if(!object_isa(x, OBJECT_CONS))
+        return 0;
+
+    object_t *op = car(x);
+    object_t *args = cdr(x);
+
+    if(is_symbol(op, "COND")) {
+        for(object_t * c = args; c != NULL; c = cdr(c)) {
+            for(object_t * e = car(c); e != NULL; e = cdr(e)) {
+                if(!opt_effect_free(l, car(e), labels))
+                    return 0;
+            }
+        }
+
+        return 1;
+    }
+
+    /* the call is as good as the body inlined for it */
+    if(is_symbol(op, "INLINE"))
+        return opt_effect_free(l, car(cdr(args)), labels);
+
+    if(!object_isa(op, OBJECT_SYMBOL) || is_special(op)
+       || assoc(l, op, labels))
+        return 0;
+
+    object_t *fn = car(cdr(lisp_env_resolv(l, l->env, op)));
+
+    if(!object_isa(fn, OBJECT_FUNCTION)
+       || (((object_function_t *) fn)->pure == FUNCTION_IMPURE))
+        return 0;
+
+    for(; args != NULL; args = cdr(args)) {
+        if(!object_isa(args, OBJECT_CONS)
+           || !opt_effect_free(l, car(args), labels))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* How often evaluating x evaluates param; *maybe is set if some of these
+ * evaluations depend on a COND. */
+static size_t opt_uses(lisp_t * l, object_t * x, object_t * param,
+                       int *maybe) {
+    if(object_isa(x, OBJECT_SYMBOL))
+        return eq(l, x, param) ? 1 : 0;
+
+    if(!object_isa(x, OBJECT_CONS) || is_symbol(car(x), "QUOTE"))
+        return 0;
+
+    size_t n = 0;
+
+    if(is_symbol(car(x), "COND")) {
+        for(object_t * c = cdr(x); c != NULL; c = cdr(c)) {
+            for(object_t * e = car(c); e != NULL; e = cdr(e))
+                n += opt_uses(l, car(e), param, maybe);
+        }
+
+        if(n > 0)
+            *maybe = 1;
+
+        return n;
+    }
+
+    if(is_symbol(car(x), "INLINE")) {
+        /* either the call or the body is evaluated */
+        size_t a = opt_uses(l, car(cdr(cdr(x))), param, maybe);
+        size_t b = opt_uses(l, car(cdr(cdr(cdr(x)))), param, maybe);
+
+        if(a != b)
+            *maybe = 1;
+
+        return a > b ? a : b;
+    }
+
+    for(object_t * a = cdr(x); a != NULL; a = cdr(a))
+        n += opt_uses(l, car(a), param, maybe);
+
+    return n;
+}
+
+/* x with the arguments bound in env substituted for the parameters. */
+static object_t *opt_subst(lisp_t * l, object_t * x, object_t * env) {
+    if(object_isa(x, OBJECT_SYMBOL)) {
+        object_t *kv = assoc(l, x, env);
+
+        return kv ? car(cdr(kv)) : x;
+    }
+
+    if(!object_isa(x, OBJECT_CONS) || is_symbol(car(x), "QUOTE"))
+        return x;
+
+    object_t *r = NULL, *tail = NULL;
+
+    for(; x != NULL; x = cdr(x)) {
+        object_t *c = cons(opt_subst(l, car(x), env), NULL);
+
+        if(r == NULL)
+            r = tail = c;
+        else
+            tail = ((object_cons_t *) tail)->cdr = c;
+    }
+
+    return r;
+}
+
+/* Inline a call of a small function defined by a LAMBDA.
+ *
+ * The body of the function is copied with the argument forms substituted
+ * for the parameters, which is what the call does as long as every
+ * argument is still evaluated exactly once: arguments other than symbols
+ * and constants must be used once, and not only in some COND branch, and
+ * only one of them may be such an expression, so their order is kept.
+ * Where that expression ends up relative to the symbols passed with it
+ * depends on the body, so then it must not rebind them either, see
+ * opt_effect_free().
+ *
+ * The result is (INLINE fn call body): evinline() checks that the name
+ * is still bound to fn before using body, so redefining the function (or
+ * any function inlined into it) sends the old call sites back to the
+ * call itself. Recursive functions are never inlined, their body calls a
+ * LAMBDA. */
+static object_t *opt_inline(lisp_t * l, object_t * labels, object_t * form) {
+    object_t *op = car(form);
+
+    if(!object_isa(op, OBJECT_SYMBOL) || is_special(op)
+       || assoc(l, op, labels))
+        return form;
+
+    object_t *fn = car(cdr(lisp_env_resolv(l, l->env, op)));
+
+    if(!object_isa(fn, OBJECT_LAMBDA))
+        return form;
+
+    object_t *params = ((object_lambda_t *) fn)->args;
+    object_t *body = ((object_lambda_t *) fn)->expr;
+    object_t *env = NULL;
+    object_t *p = params, *a = cdr(form);
+    object_t *expr = NULL;      // the argument that is neither of these
+    size_t size = 0, complex = 0;
+    int symbols = 0;
+
+    for(; object_isa(p, OBJECT_CONS) && object_isa(a, OBJECT_CONS);
+        p = cdr(p), a = cdr(a)) {
+        if(!object_isa(car(p), OBJECT_SYMBOL))
+            return form;
+
+        env = cons(cons(car(p), cons(car(a), NULL)), env);
+    }
+
+    if((p != NULL) || (a != NULL)
+       || !opt_inlinable(l, body, env, labels, &size))
+        return form;
+
+    for(object_t * kv = env; kv != NULL; kv = cdr(kv)) {
+        object_t *value;
+        int maybe = 0;
+
+        if(object_isa(car(cdr(car(kv))), OBJECT_SYMBOL)) {
+            symbols = 1;
+            continue;
+        }
+
+        if(opt_constant(l, car(cdr(car(kv))), &value))
+            continue;
+
+        if((opt_uses(l, body, car(car(kv)), &maybe) != 1) || maybe
+           || (++complex > 1))
+            return form;
+
+        expr = car(cdr(car(kv)));
+    }
+
+    if(symbols && (expr != NULL) && !opt_effect_free(l, expr, labels))
+        return form;
+
+    object_t *x = opt_form(l, labels, opt_subst(l, body, env));
+
+    opt_report(l, "INLINE", cons(op, NULL));
+
+    return cons(object_symbol_new("INLINE"),
+                cons(fn, cons(form, cons(x, NULL))));
+}
+
+/* Forms nest without recursing, as in macroexpand_all(): each list whose
+ * elements are being optimized has a frame on a stack of its own. */
+
+typedef enum {
+    OPT_CALL,                   // the list is the form itself
+    OPT_BODY,                   // the list follows the second element
+    OPT_INLINE,                 // the list holds the inlined body
+    OPT_COND,                   // the list holds the clauses
+    OPT_CLAUSE,                 // the list is a clause
+} opt_kind_t;
+
+typedef struct {
+    opt_kind_t kind;
+    object_t *form;             // the form the list belongs to
+    object_t *labels;           // the names bound there
+    object_t *list;
+    object_t *cell;             // holds the element being optimized
+    object_t *from;             // the first cell not copied yet
+    object_t *head;             // the copy, up to the last changed element
+    object_t *tail;
+    int changed;                // for a COND, whether a clause changed
+} opt_frame_t;
+
+typedef struct {
+    opt_frame_t *frame;
+    size_t top;
+    size_t sz;
+} opt_stack_t;
+
+static void opt_push(opt_stack_t * s, opt_kind_t kind, object_t * labels,
+                     object_t * form, object_t * list) {
+    if(s->top == s->sz) {
+        s->sz = s->sz ? 2 * s->sz : 16;
+
+        if((s->frame =
+            realloc(s->frame, s->sz * sizeof(opt_frame_t))) == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    opt_frame_t *f = &s->frame[s->top++];
+
+    f->kind = kind;
+    f->labels = labels;
+    f->form = form;
+    f->list = f->cell = f->from = list;
+    f->head = f->tail = NULL;
+    f->changed = 0;
+}
+
+/* Start on form: returns 1 with the optimized form in *o if no code is
+ * left in it, otherwise pushes the frame for the list of code it holds. */
+static int opt_open(lisp_t * l, opt_stack_t * s, object_t * labels,
+                    object_t * form, object_t ** o) {
+    *o = form;
+
+    if(!object_isa(form, OBJECT_CONS))
+        return 1;
+
+    object_t *op = car(form);
+
+    if(is_symbol(op, "QUOTE")) {
+        object_t *value = car(cdr(form));
+
+        if(!object_isa(value, OBJECT_CONS) && !object_isa(value, OBJECT_SYMBOL))
+            *o = opt_quote(l, value);
+
+        return 1;
+    }
+
+    if(is_symbol(op, "MACRO") || is_symbol(op, "DEFSTRUCT"))
+        return 1;
+
+    /* arguments substituted into an inlined body may fold now */
+    if(is_symbol(op, "INLINE"))
+        opt_push(s, OPT_INLINE, labels, form, cdr(cdr(cdr(form))));
+    else if(is_symbol(op, "LAMBDA")) {
+        object_t *inner = labels;
+
+        for(object_t * a = car(cdr(form)); object_isa(a, OBJECT_CONS);
+            a = cdr(a))
+            inner = cons(cons(car(a), NULL), inner);
+
+        opt_push(s, OPT_BODY, inner, form, cdr(cdr(form)));
+    }
+    else if(is_symbol(op, "LABEL"))
+        opt_push(s, OPT_BODY, labels, form, cdr(cdr(form)));
+    else if(is_symbol(op, "COND"))
+        opt_push(s, OPT_COND, labels, form, cdr(form));
+    else
+        opt_push(s, OPT_CALL, labels, form, form);
+
+    return 0;
+}
+
+/* Take a clause of a COND, optimized: clauses whose test is constantly
+ * false are dropped, and so are all clauses after one whose test is
+ * constantly true, which are never reached. */
+static void opt_clause(lisp_t * l, opt_frame_t * f, object_t * clause) {
+    object_t *c = f->cell;
+    object_t *test;
+
+    f->changed |= (clause != car(c));
+    f->cell = cdr(c);
+
+    if(opt_constant(l, car(clause), &test) && (test == NULL)) {
+        opt_report(l, "PRUNE", cons(clause, NULL));
+        f->changed = 1;
+        return;
+    }
+
+    if(f->head == NULL)
+        f->head = f->tail = cons(clause, NULL);
+    else
+        f->tail = ((object_cons_t *) f->tail)->cdr = cons(clause, NULL);
+
+    if(opt_constant(l, car(clause), &test)) {
+        for(object_t * d = cdr(c); d != NULL; d = cdr(d)) {
+            opt_report(l, "PRUNE", cons(car(d), NULL));
+            f->changed = 1;
+        }
+
+        f->cell = NULL;
+    }
+}
+
+/* Take a, the optimized element in f->cell, and move on. */
+static void opt_take(lisp_t * l, opt_frame_t * f, object_t * a) {
+    object_t *c = f->cell;
+
+    if(f->kind == OPT_COND) {
+        opt_clause(l, f, a);
+        return;
+    }
+
+    /* copy the cells up to this one, the rest is shared until the next
+     * element changes */
+    if(a != car(c)) {
+        for(; f->from != cdr(c); f->from = cdr(f->from)) {
+            object_t *x = cons(f->from == c ? a : car(f->from), NULL);
+
+            if(f->head == NULL)
+                f->head = x;
+            else
+                ((object_cons_t *) f->tail)->cdr = x;
+
+            f->tail = x;
+        }
+    }
+
+    f->cell = cdr(c);
+}
+
+/* The optimized form whose list f has walked. */
+static object_t *opt_close(lisp_t * l, opt_frame_t * f) {
+    object_t *op = car(f->form);
+    object_t *x = f->list;
+    object_t *test;
+
+    if(f->kind == OPT_COND) {
+        if(f->head == NULL)
+            return opt_quote(l, NULL);
+
+        if(opt_constant(l, car(car(f->head)), &test))
+            return car(cdr(car(f->head)));
+
+        return f->changed ? cons(op, f->head) : f->form;
+    }
+
+    if(f->head != NULL) {
+        ((object_cons_t *) f->tail)->cdr = f->from;
+        x = f->head;
+    }
+
+    switch (f->kind) {
+    case OPT_INLINE:
+        if(x == f->list)
+            return f->form;
+
+        return cons(op, cons(car(cdr(f->form)), cons(car(cdr(cdr(f->form))),
+                                                     x)));
+    case OPT_BODY:
+        return x == f->list ? f->form : cons(op, cons(car(cdr(f->form)), x));
+    case OPT_CALL:
+        test = opt_fold(l, f->labels, x);
+
+        return test == x ? opt_inline(l, f->labels, x) : test;
+    default:
+        return x;
+    }
+}
+
+static object_t *opt_form(lisp_t * l, object_t * labels, object_t * form) {
+    opt_stack_t s = { NULL, 0, 0 };
+    object_t *o;
+    int done = opt_open(l, &s, labels, form, &o);
+
+    while(s.top > 0) {
+        opt_frame_t *f = &s.frame[s.top - 1];
+
+        if(done) {
+            opt_take(l, f, o);
+            done = 0;
+        }
+
+        if(object_isa(f->cell, OBJECT_CONS)) {
+            if(f->kind == OPT_COND)
+                opt_push(&s, OPT_CLAUSE, f->labels, NULL, car(f->cell));
+            else
+                done = opt_open(l, &s, f->labels, car(f->cell), &o);
+
+            continue;
+        }
+
+        o = opt_close(l, f);
+        s.top--;
+        done = 1;
+    }
+
+    free(s.frame);
+
+    return o;
+}
+
+/** Simplify a macroexpanded form, see above. */
+object_t *lisp_optimize(lisp_t * l, object_t * form) {
+    if(!l->optimize)
+        return form;
+
+    return opt_form(l, NULL, form);
+}
@@ -0,0 +1,9 @@
+#ifndef __LISP_OPT_H
+#define __LISP_OPT_H
+
+#include "lisp.h"
+#include "object.h"
+
+object_t *lisp_optimize(lisp_t *, object_t *);
+
+#endif
@@ -0,0 +1,315 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lisp_parser.h"
+#include "lisp_read.h"
+#include "builtin.h"
+#include "logger.h"
+#include "scan.h"
+#include "hcons.h"
+#include "lisp_opt.h"
+
+/* Bytes ending a token. */
+#define PARSER_DELIMITERS " \t\r\n()\""
+
+static void parser_push(lisp_parser_t *, lisp_parser_frame_type_t);
+static object_t *parser_close(lisp_parser_t *, lisp_parser_frame_t *);
+static void parser_emit(lisp_parser_t *, object_t *);
+static void parser_token_append(lisp_parser_t *, const char *, size_t);
+static void parser_token_flush(lisp_parser_t *);
+static void parser_reset(lisp_parser_t *);
+
+/** Create a push parser.
+ *
+ *  Unlike read(), which pulls characters from a blocking stream, the push
+ *  parser is handed input in chunks of any size as it arrives. Its state
+ *  (open lists, quotes, a partial token or string) is kept in an explicit
+ *  frame stack, so every byte is looked at exactly once and one thread can
+ *  drive any number of parsers.
+ *
+ *  The syntax is the default readtable's: lists, vectors, strings, quote,
+ *  backquote and unquote. Tokens are also terminated by tabs, '(' and '"'.
+ *  As for read(), a () inside a list ends that list too.
+ */
+lisp_parser_t *lisp_parser_new(lisp_t * l) {
+    lisp_parser_t *p = calloc(1, sizeof(lisp_parser_t));
+
+    if(p == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    p->lisp = l;
+
+    return p;
+}
+
+void lisp_parser_destroy(lisp_parser_t * p) {
+    if(p == NULL)
+        return;
+
+    free(p->frames);
+    free(p->token);
+    free(p);
+}
+
+/** Parse a chunk of input, queueing every form it completes. */
+void lisp_parser_feed(lisp_parser_t * p, const char *buf, size_t len) {
+    for(size_t i = 0, n = 0; i < len; i++) {
+        if(p->in_string) {
+            n = scan_first_of(buf + i, len - i, "\"");
+
+            parser_token_append(p, buf + i, n);
+
+            if((i += n) == len)
+                break;
+
+            char *str = calloc(p->token_len + 1, sizeof(char));
+
+            if(str == NULL) {
+                perror("calloc");
+                exit(EXIT_FAILURE);
+            }
+
+            memcpy(str, p->token, p->token_len);
+
+            p->in_string = 0;
+            parser_emit(p, object_string_new(str, p->token_len));
+            p->token_len = 0;
+            continue;
+        }
+
+        char x = buf[i];
+
+        /* a '#' not followed by '(' just begins a token */
+        if((p->frames_len > 0)
+           && (p->frames[p->frames_len - 1].type == PARSER_FRAME_VECTOR)
+           && (x != '(')) {
+            p->frames_len--;
+            parser_token_append(p, "#", 1);
+        }
+
+        switch (x) {
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            parser_token_flush(p);
+            break;
+        case '(':
+            parser_token_flush(p);
+            parser_push(p, PARSER_FRAME_LIST);
+            break;
+        case ')':
+            parser_token_flush(p);
+
+            if((p->frames_len == 0)
+               || (p->frames[p->frames_len - 1].type != PARSER_FRAME_LIST)) {
+                WARN("lisp_parser_feed: unexpected ')', discarding input");
+                parser_reset(p);
+                break;
+            }
+
+            p->frames_len--;
+            parser_emit(p, parser_close(p, &p->frames[p->frames_len]));
+            break;
+        case '"':
+            parser_token_flush(p);
+            p->in_string = 1;
+            break;
+        case '\'':
+            if(p->token_len > 0) {
+                parser_token_append(p, buf + i, 1);
+                break;
+            }
+
+            parser_push(p, PARSER_FRAME_QUOTE);
+            break;
+        case '`':
+            if(p->token_len > 0) {
+                parser_token_append(p, buf + i, 1);
+                break;
+            }
+
+            parser_push(p, PARSER_FRAME_BACKQUOTE);
+            p->backquotes++;
+            break;
+        case '#':
+            if(p->token_len > 0) {
+                parser_token_append(p, buf + i, 1);
+                break;
+            }
+
+            parser_push(p, PARSER_FRAME_VECTOR);
+            break;
+        case ',':
+            if((p->token_len > 0) || (p->backquotes == 0)) {
+                parser_token_append(p, buf + i, 1);
+                break;
+            }
+
+            parser_push(p, PARSER_FRAME_UNQUOTE);
+            break;
+        default:
+            n = scan_first_of(buf + i, len - i, PARSER_DELIMITERS);
+
+            parser_token_append(p, buf + i, n);
+            i += n - 1;
+        }
+    }
+}
+
+/** Signal end of input; completes a pending token. */
+void lisp_parser_finish(lisp_parser_t * p) {
+    if(!p->in_string)
+        parser_token_flush(p);
+
+    if(p->in_string || (p->frames_len > 0)) {
+        WARN("lisp_parser_finish: incomplete form discarded");
+        parser_reset(p);
+    }
+}
+
+/** Take the next completed form, returns 0 if there is none (yet). */
+int lisp_parser_next(lisp_parser_t * p, object_t ** form) {
+    if(p->forms == NULL) {
+        *form = NULL;
+        return 0;
+    }
+
+    *form = car(p->forms);
+
+    p->forms = cdr(p->forms);
+
+    if(p->forms == NULL)
+        p->forms_tail = NULL;
+
+    return 1;
+}
+
+static void parser_push(lisp_parser_t * p, lisp_parser_frame_type_t type) {
+    if(p->frames_len == p->frames_sz) {
+        p->frames_sz = p->frames_sz ? p->frames_sz * 2 : 16;
+        p->frames =
+            realloc(p->frames, p->frames_sz * sizeof(lisp_parser_frame_t));
+
+        if(p->frames == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    lisp_parser_frame_t *f = &p->frames[p->frames_len++];
+
+    f->type = type;
+    f->head = NULL;
+    f->tail = NULL;
+}
+
+/** The list read in the list frame f. */
+static object_t *parser_close(lisp_parser_t * p, lisp_parser_frame_t * f) {
+    object_t *list = f->head;
+
+    if(p->lisp->hcons_read) {
+        object_t *canon = hcons_list(p->lisp, list);
+
+        while(list != NULL) {
+            object_t *next = cdr(list);
+
+            free(list);
+            list = next;
+        }
+
+        list = canon;
+    }
+
+    return list;
+}
+
+/** Hand a completed datum to the innermost open frame; a NIL ends a list,
+ *  () included, as it does for mread_nested(). */
+static void parser_emit(lisp_parser_t * p, object_t * o) {
+    lisp_t *l = p->lisp;
+
+    while(p->frames_len > 0) {
+        lisp_parser_frame_t *f = &p->frames[p->frames_len - 1];
+
+        switch (f->type) {
+        case PARSER_FRAME_LIST:
+            if(o == NULL) {
+                o = parser_close(p, f);
+                break;
+            }
+
+            if(f->head == NULL)
+                f->head = f->tail = cons(o, NULL);
+            else
+                f->tail = ((object_cons_t *) f->tail)->cdr = cons(o, NULL);
+
+            return;
+        case PARSER_FRAME_QUOTE:
+            o = l->hcons_read
+                ? hcons(l, object_symbol_new("QUOTE"), hcons(l, o, NULL))
+                : cons(object_symbol_new("QUOTE"), cons(o, NULL));
+            break;
+        case PARSER_FRAME_UNQUOTE:
+            o = l->hcons_read
+                ? hcons(l, object_symbol_new("UNQUOTE"), hcons(l, o, NULL))
+                : cons(object_symbol_new("UNQUOTE"), cons(o, NULL));
+            break;
+        case PARSER_FRAME_BACKQUOTE:
+            p->backquotes--;
+            o = lisp_read_backquote(l, o);
+            break;
+        case PARSER_FRAME_VECTOR:
+            o = vector(o);
+            break;
+        }
+
+        p->frames_len--;
+    }
+
+    o = cons(lisp_optimize(l, macroexpand_all(l, NULL, o)), NULL);
+
+    if(p->forms == NULL)
+        p->forms = p->forms_tail = o;
+    else
+        p->forms_tail = ((object_cons_t *) p->forms_tail)->cdr = o;
+}
+
+static void parser_token_append(lisp_parser_t * p, const char *s, size_t n) {
+    if(p->token_len + n >= p->token_sz) {
+        while(p->token_len + n >= p->token_sz)
+            p->token_sz = p->token_sz ? p->token_sz * 2 : 256;
+
+        p->token = realloc(p->token, p->token_sz);
+
+        if(p->token == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memcpy(p->token + p->token_len, s, n);
+    p->token_len += n;
+}
+
+static void parser_token_flush(lisp_parser_t * p) {
+    if(p->token_len == 0)
+        return;
+
+    p->token[p->token_len] = 0;
+
+    object_t *o = read_token(p->token, p->token_len);
+
+    p->token_len = 0;
+
+    parser_emit(p, o);
+}
+
+static void parser_reset(lisp_parser_t * p) {
+    p->frames_len = 0;
+    p->token_len = 0;
+    p->in_string = 0;
+    p->backquotes = 0;
+}
@@ -0,0 +1,50 @@
+#ifndef __LISP_PARSER_H
+#define __LISP_PARSER_H
+
+#include "lisp.h"
+#include "object.h"
+
+typedef struct lisp_parser_t lisp_parser_t;
+typedef struct lisp_parser_frame_t lisp_parser_frame_t;
+
+typedef enum {
+    PARSER_FRAME_LIST,
+    PARSER_FRAME_QUOTE,
+    PARSER_FRAME_UNQUOTE,
+    PARSER_FRAME_BACKQUOTE,
+    PARSER_FRAME_VECTOR,
+} lisp_parser_frame_type_t;
+
+/** An open construct waiting for more input. */
+struct lisp_parser_frame_t {
+    lisp_parser_frame_type_t type;
+    object_t *head;
+    object_t *tail;
+};
+
+struct lisp_parser_t {
+    lisp_t *lisp;
+
+    lisp_parser_frame_t *frames;
+    size_t frames_len;
+    size_t frames_sz;
+
+    char *token;
+    size_t token_len;
+    size_t token_sz;
+
+    int in_string;
+    size_t backquotes;
+
+    object_t *forms;            // completed, not yet consumed forms
+    object_t *forms_tail;
+};
+
+lisp_parser_t *lisp_parser_new(lisp_t *);
+void lisp_parser_destroy(lisp_parser_t *);
+
+void lisp_parser_feed(lisp_parser_t *, const char *, size_t);
+void lisp_parser_finish(lisp_parser_t *);
+int lisp_parser_next(lisp_parser_t *, object_t **);
+
+#endif
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
+#include <inttypes.h>
 
 #include "logger.h"
 #include "lisp.h"
@@ -10,10 +11,32 @@
 #include "builtin.h"
 #include "stream.h"
 
-static const char *print_integer(object_t *);
-static const char *print_string(object_t *);
-static const char *print_cons(object_t *);
+/* The conses, vectors and structs still being printed are kept on a
+ * stack, for the reason mread_nested() keeps the forms being read. */
+
+typedef struct print_frame_t print_frame_t;
+typedef struct printer_t printer_t;
+
+struct print_frame_t {
+    object_t *o;                // the cons, vector or struct printed
+    object_t *list;             // what is left of a list
+    size_t i;                   // elements printed so far
+    size_t start;               // where the elements start in the output
+};
+
+struct printer_t {
+    char *s;
+    size_t len;
+    size_t sz;
+    print_frame_t *stack;
+    size_t top;
+    size_t stack_sz;
+};
+
 static const char *print_object(object_t *);
+static void print_value(printer_t *, object_t *);
+static int print_next(printer_t *, print_frame_t *, object_t **);
+static const char *print_array(object_t *);
 
 /** Render object to a string (using lisp_pprint()) and print it, return it. */
 object_t *lisp_print(lisp_t * l, object_t * obj) {
@@ -38,103 +61,233 @@ object_t *lisp_pprint(object_t * object) {
     return object_string_new(s, strlen(s));
 }
 
+static void print_puts(printer_t * p, const char *str) {
+    size_t n = strlen(str);
+
+    if(p->len + n + 1 > p->sz) {
+        while(p->len + n + 1 > p->sz)
+            p->sz = p->sz ? 2 * p->sz : 64;
+
+        if((p->s = realloc(p->s, p->sz)) == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memcpy(p->s + p->len, str, n + 1);
+    p->len += n;
+}
+
+static void print_push(printer_t * p, object_t * o) {
+    if(p->top == p->stack_sz) {
+        p->stack_sz = p->stack_sz ? 2 * p->stack_sz : 16;
+
+        p->stack = realloc(p->stack, p->stack_sz * sizeof(print_frame_t));
+
+        if(p->stack == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    print_frame_t *f = &p->stack[p->top++];
+
+    f->o = f->list = o;
+    f->i = 0;
+    f->start = p->len;
+}
+
 static const char *print_object(object_t * o) {
-    if(o == NULL)
-        return "NIL";
+    printer_t p = { 0 };
+
+    print_puts(&p, "");
+    print_value(&p, o);
+
+    while(p.top > 0) {
+        object_t *next;
+
+        if(print_next(&p, &p.stack[p.top - 1], &next))
+            print_value(&p, next);
+        else {
+            print_puts(&p, ")");
+            p.top--;
+        }
+    }
+
+    free(p.stack);
+
+    return p.s;
+}
+
+/** Print o, or open it if it has elements, see print_next(). */
+static void print_value(printer_t * p, object_t * o) {
+    char s[32];
+
+    if(o == NULL) {
+        print_puts(p, "NIL");
+        return;
+    }
 
     switch (o->type) {
     case OBJECT_ERROR:
-        return "ERR";
+        print_puts(p, "ERR");
+        return;
     case OBJECT_CONS:
-        return print_cons(o);
+        print_puts(p, "(");
+        print_push(p, o);
+        return;
     case OBJECT_INTEGER:
-        return print_integer(o);
+        snprintf(s, sizeof(s), "%" PRId64, ((object_integer_t *) o)->number);
+        print_puts(p, s);
+        return;
     case OBJECT_LAMBDA:
-        return "#<Lambda>";     // TODO
+        print_puts(p, "#<Lambda>");     // TODO
+        return;
     case OBJECT_MACRO:
-        return "#<Macro>";      // TODO
+        print_puts(p, "#<Macro>");      // TODO
+        return;
     case OBJECT_FUNCTION:
-        return "#<Function>";   // TODO
+        print_puts(p, "#<Function>");   // TODO
+        return;
     case OBJECT_STRING:
-        return print_string(o);
+        print_puts(p, ((object_string_t *) o)->string);
+        return;
     case OBJECT_SYMBOL:
-        return ((object_symbol_t *) o)->name;
+        print_puts(p, ((object_symbol_t *) o)->name);
+        return;
     case OBJECT_STREAM:
         PANIC("print_object: cannot print stream");
+    case OBJECT_VECTOR:
+        print_puts(p, "#(");
+        print_push(p, o);
+        return;
+    case OBJECT_HASHTABLE:
+        print_puts(p, "#<Hash-Table>");
+        return;
+    case OBJECT_ARRAY:{
+            char *a = (char *) print_array(o);
+
+            print_puts(p, a);
+            free(a);
+            return;
+        }
+    case OBJECT_MAP:
+        print_puts(p, "#<Map>");
+        return;
+    case OBJECT_STRUCT:
+        print_puts(p, "#S(");
+        print_puts(p, ((object_symbol_t *) ((object_struct_t *) o)->type->
+                       name)->name);
+        print_push(p, o);
+        return;
+    case OBJECT_LAZY:
+        print_puts(p, "#<Lazy>");
+        return;
+    case OBJECT_TRANSDUCER:
+        print_puts(p, "#<Transducer>");
+        return;
     }
 
     PANIC("print_object: unknwon object of type #%d", o->type);
-
-    return NULL;
 }
 
-static const char *print_string(object_t * o) {
-    if(!object_isa(o, OBJECT_STRING))
-        PANIC("print_string: arg is not string!");
+/** Write what goes before the next element of the frame f and store the
+ *  element in *next, return 0 once there are no more.
+ *
+ *  Lists print as (1 2 . 3), stopping at the first NIL after the first
+ *  element; vectors as #(1 2); structs as #S(POINT :X 1 :Y 2). */
+static int print_next(printer_t * p, print_frame_t * f, object_t ** next) {
+    object_t *o = f->o;
 
-    object_string_t *str = (object_string_t *) o;
+    switch (o->type) {
+    case OBJECT_CONS:{
+            object_t *list = f->list;
+            int rest = p->len > f->start;
 
-    const size_t len = str->len + 1;
-    char *s = calloc(len, sizeof(char));
+            if(list == NULL)
+                break;
 
-    if(snprintf(s, len, "%s", str->string) == 0)
-        PANIC("print_string: could not write string %s", str->string);
+            int dotted = list->type != OBJECT_CONS;
 
-    return s;
-}
+            *next = dotted ? list : car(list);
 
-static const char *print_integer(object_t * o) {
-    if(!object_isa(o, OBJECT_INTEGER))
-        PANIC("print_integer: arg is not integer!");
+            if(rest && (*next == NULL))
+                break;
 
-    const size_t len = 15;
-    char *s = calloc(len + 1, sizeof(char));
+            print_puts(p, rest ? (dotted ? " . " : " ") : "");
+            f->list = dotted ? NULL : cdr(list);
 
-    if(s == NULL) {
-        perror("calloc");
-        exit(EXIT_FAILURE);
-    }
+            return 1;
+        }
+    case OBJECT_VECTOR:{
+            object_vector_t *v = (object_vector_t *) o;
 
-    if(snprintf(s, 10, "%d", ((object_integer_t *) o)->number) == 0) {
-        free(s);
-        return NULL;
+            if(f->i == v->len)
+                break;
+
+            print_puts(p, f->i ? " " : "");
+            *next = v->items[f->i++];
+
+            return 1;
+        }
+    case OBJECT_STRUCT:{
+            object_struct_t *st = (object_struct_t *) o;
+
+            if(f->i == st->type->len)
+                break;
+
+            print_puts(p, " :");
+            print_puts(p, ((object_symbol_t *) st->type->slots[f->i])->name);
+            print_puts(p, " ");
+            *next = st->slots[f->i++];
+
+            return 1;
+        }
+    default:
+        PANIC("print_next: cannot print elements of type #%d", o->type);
     }
 
-    return s;
+    return 0;
 }
 
-static const char *print_cons(object_t * list) {
-    const size_t len = 1024;
-    char *s = calloc(len + 1, sizeof(char));
-    size_t si = snprintf(s, len, "(");
+/** Arrays are not readable, they print as #<Array INT32 1 2 3>. */
+static const char *print_array(object_t * o) {
+    if(!object_isa(o, OBJECT_ARRAY))
+        PANIC("print_array: arg is not array!");
 
-    while(list) {
-        object_t *obj = list;
-        bool dotted = true;
+    object_array_t *a = (object_array_t *) o;
 
-        if(obj->type == OBJECT_CONS)
-            dotted = false;
+    size_t len = 64, si = 0;
+    char *s = calloc(len, sizeof(char));
+
+    if(s == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
 
-        if(!dotted)
-            obj = car(list);
+    si += snprintf(s, len, "#<Array %s",
+                   a->type == ARRAY_INT32 ? "INT32" : "INT64");
 
-        if((si > 1) && (obj == NULL))
-            break;
+    for(size_t i = 0; i < a->len; i++) {
+        size_t need = si + 23;
 
-        const char *prefix = (si > 1) ? (dotted ? " . " : " ") : "";
+        if(need > len) {
+            while(need > len)
+                len *= 2;
 
-        si += snprintf(s + si, len - si, "%s%s", prefix, print_object(obj));
+            if((s = realloc(s, len)) == NULL) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
 
-        if(si > len)
-            PANIC("print_cons[..] - string overflow (got: »%s«)", s);
+        int64_t n = a->type == ARRAY_INT32 ? ((int32_t *) a->data)[i]
+            : ((int64_t *) a->data)[i];
 
-        if(list->type == OBJECT_CONS)
-            list = cdr(list);
-        else
-            list = NULL;
+        si += snprintf(s + si, len - si, " %" PRId64, n);
     }
 
-    snprintf(s + si, len - si, ")");
+    snprintf(s + si, len - si, ">");
 
     return s;
 }
@@ -1,24 +1,69 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "lisp_read.h"
 #include "lisp.h"
 #include "builtin.h"
 #include "logger.h"
 #include "stream.h"
+#include "scan.h"
+#include "hcons.h"
+#include "lisp_opt.h"
 
 static object_t *mread_list(lisp_t *, char, object_t *);
 static object_t *mread_str(lisp_t *, char, object_t *);
 static object_t *mread_quote(lisp_t *, char x, object_t *);
 static object_t *mread_unquote(lisp_t *, char, object_t *);
 static object_t *mread_backquote(lisp_t *, char, object_t *);
+static object_t *mread_vector(lisp_t *, char, object_t *);
+static object_t *rcons(lisp_t *, object_t *, object_t *);
 
 object_t *lisp_read(lisp_t * lisp, const char *s, size_t len) {
     TRACE("lisp_read[_, %s, %d]", s, len);
 
     object_t *stream = istream_mem(s, len);
-    object_t *o = read(lisp, stream);
+    object_t *o = NULL;
 
-    return car(macroexpand(lisp, NULL, o));
+    lisp_read_next(lisp, stream, &o);
+    stream_close(stream);
+
+    return o;
+}
+
+/** Read the next top-level form from an open stream.
+ *
+ *  Successive calls return successive forms, whether or not they are
+ *  separated by blank lines. Returns 0 once only whitespace remains,
+ *  otherwise stores the macroexpanded and optimized form in *form and returns 1.
+ */
+int lisp_read_next(lisp_t * lisp, object_t * stream, object_t ** form) {
+    if(!lisp_read_datum(lisp, stream, form))
+        return 0;
+
+    *form = lisp_optimize(lisp, macroexpand_all(lisp, NULL, *form));
+
+    return 1;
+}
+
+/** Like lisp_read_next(), but the form is data and not macroexpanded. */
+int lisp_read_datum(lisp_t * lisp, object_t * stream, object_t ** form) {
+    while(!stream_eof(stream)) {
+        int x = stream_read_char(stream);
+
+        if((x == ' ') || (x == '\t') || (x == '\n'))
+            continue;
+
+        stream_unread_char(stream, x);
+
+        *form = read(lisp, stream);
+
+        return 1;
+    }
+
+    *form = NULL;
+
+    return 0;
 }
 
 object_t *readtable_new(void) {
@@ -37,71 +82,239 @@ object_t *readtable_new(void) {
     entry = cons(object_symbol_new("`"), (object_t *) mread_backquote);
     readtable = cons(entry, readtable);
 
+    entry = cons(object_symbol_new("#"), (object_t *) mread_vector);
+    readtable = cons(entry, readtable);
+
     return readtable;
 }
 
-/** Read list of objects from input-stream. */
-static object_t *mread_list(lisp_t * l, char x, object_t * stream) {
-    if(x != '(')
-        PANIC("mread_list cannot read non-list");
+/** cons, or hcons while the reader is in hash-consing mode. */
+static object_t *rcons(lisp_t * l, object_t * car, object_t * cdr) {
+    return l->hcons_read ? hcons(l, car, cdr) : cons(car, cdr);
+}
+
+/* Lists, vectors and quotes nest without recursing: the forms still being
+ * read are kept on a stack of their own, grown as needed, so how deep they
+ * may nest is not bounded by the C stack. */
+
+typedef enum {
+    READ_LIST,
+    READ_VECTOR,
+    READ_QUOTE,
+} read_kind_t;
+
+typedef struct {
+    read_kind_t kind;
+    object_t *list;
+    object_t *tail;
+} read_frame_t;
+
+/** The reader macro the readtable has for x, NULL if none. */
+static object_t *mread_macro(lisp_t * l, int x) {
+    for(object_t * rt = l->readtable; rt != NULL; rt = cdr(rt)) {
+        const char *name = ((object_symbol_t *) car(car(rt)))->name;
+
+        if((name[0] == x) && (name[1] == '\0'))
+            return cdr(car(rt));
+    }
 
-    object_t *o = read(l, stream);
+    return NULL;
+}
 
-    if(o == NULL)
-        return NULL;
+/** Finish the list read in f, a vector for #(...). */
+static object_t *mread_close(lisp_t * l, read_frame_t * f) {
+    object_t *list = f->list;
 
-    object_t *list = cons(o, NULL);
-    object_t *tail = NULL;
+    if(l->hcons_read && (list != NULL)) {
+        object_t *canon = hcons_list(l, list);
 
-    while((o = read(l, stream))) {
-        if(tail == NULL) {
-            tail = ((object_cons_t *) list)->cdr = cons(o, NULL);
+        /* the spine read above is ours alone and replaced now */
+        while(list != NULL) {
+            object_t *next = cdr(list);
+
+            free(list);
+            list = next;
         }
-        else {
-            tail = ((object_cons_t *) tail)->cdr = cons(o, NULL);
+
+        list = canon;
+    }
+
+    return f->kind == READ_VECTOR ? vector(list) : list;
+}
+
+static read_frame_t *mread_push(read_frame_t * stack, size_t * top,
+                                size_t * sz, read_kind_t kind) {
+    if(*top == *sz) {
+        *sz = *sz ? 2 * *sz : 16;
+
+        if((stack = realloc(stack, *sz * sizeof(read_frame_t))) == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
         }
+    }
+
+    stack[*top].kind = kind;
+    stack[*top].list = stack[*top].tail = NULL;
+    (*top)++;
+
+    return stack;
+}
+
+/** Read the rest of a form of the given kind, whose opening characters
+ *  were read, and everything nested in it. */
+static object_t *mread_nested(lisp_t * l, object_t * stream, read_kind_t kind) {
+    size_t top = 0, sz = 0;
+    read_frame_t *stack = mread_push(NULL, &top, &sz, kind);
+    object_t *o = NULL;
+
+    while(top > 0) {
+        int x = EOF;
+
+        while(!stream_eof(stream)) {
+            x = stream_read_char(stream);
+
+            if((x != ' ') && (x != '\t') && (x != '\n'))
+                break;
+
+            x = EOF;
+        }
+
+        object_t *m = x == EOF ? NULL : mread_macro(l, x);
 
+        if(m == (object_t *) mread_list) {
+            stack = mread_push(stack, &top, &sz, READ_LIST);
+            continue;
+        }
+
+        if(m == (object_t *) mread_quote) {
+            stack = mread_push(stack, &top, &sz, READ_QUOTE);
+            continue;
+        }
+
+        if(m == (object_t *) mread_vector) {
+            if(stream_eof(stream) || (stream_read_char(stream) != '('))
+                PANIC("mread_vector: expected '(' after '#'");
+
+            stack = mread_push(stack, &top, &sz, READ_VECTOR);
+            continue;
+        }
+
+        if(x != EOF)
+            stream_unread_char(stream, x);
+
+        o = read(l, stream);
+
+        /* hand o to the form it belongs to, finishing those it ends; a
+         * NIL ends a list, () included */
+        while(top > 0) {
+            read_frame_t *f = &stack[top - 1];
+
+            if(f->kind == READ_QUOTE)
+                o = rcons(l, object_symbol_new("QUOTE"), rcons(l, o, NULL));
+            else if(o == NULL)
+                o = mread_close(l, f);
+            else {
+                object_t *c = cons(o, NULL);
+
+                if(f->list == NULL)
+                    f->list = c;
+                else
+                    ((object_cons_t *) f->tail)->cdr = c;
+
+                f->tail = c;
+
+                break;
+            }
+
+            top--;
+        }
     }
 
-    return list;
+    free(stack);
+
+    return o;
 }
 
-static object_t *mread_str(lisp_t * l, char x, object_t * stream) {
-    l = l;
+/** Read list of objects from input-stream. */
+static object_t *mread_list(lisp_t * l, char x, object_t * stream) {
+    if(x != '(')
+        PANIC("mread_list cannot read non-list");
 
+    return mread_nested(l, stream, READ_LIST);
+}
+
+/** Read a string literal of any length.
+ *
+ *  From a memory stream the characters are copied straight into the
+ *  resulting string; otherwise they are collected in the lisp_t's scratch
+ *  buffer first, so only the resulting string is allocated either way.
+ */
+static object_t *mread_str(lisp_t * l, char x, object_t * stream) {
     if(x != '"')
         PANIC("mread_str cannot read non-string");
 
-    size_t str_idx = 0, str_sz = 255;
-    char *str = calloc(str_sz + 1, sizeof(char));
+    size_t str_idx = 0;
+    size_t avail;
+    const char *buf = stream_peek(stream, &avail);
+    const char *str = buf;
 
-    while(!stream_eof(stream)) {
-        if(str_idx > str_sz)
-            PANIC("string overflow");
+    if(buf != NULL)             // memory stream, find the closing quote in bulk
+        str_idx = scan_first_of(buf, avail, "\"");
+    else {
+        char *scratch = lisp_scratch(l, 256);
 
-        char x = stream_read_char(stream);
+        while(!stream_eof(stream)) {
+            char x = stream_read_char(stream);
 
-        if(x == '"')
-            break;
+            if(x == '"')
+                break;
 
-        str[str_idx++] = x;
+            scratch = lisp_scratch(l, str_idx + 1);
+            scratch[str_idx++] = x;
+        }
+
+        str = scratch;
     }
 
-    return object_string_new(str, str_idx);
+    char *s = calloc(str_idx + 1, sizeof(char));
+
+    if(s == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(s, str, str_idx);
+
+    if(buf != NULL)
+        stream_skip(stream, str_idx < avail ? str_idx + 1 : str_idx);
+
+    return object_string_new(s, str_idx);
+}
+
+/** Read a vector literal, #(...). Its elements are not evaluated. */
+static object_t *mread_vector(lisp_t * l, char x, object_t * stream) {
+    if(x != '#')
+        PANIC("mread_vector cannot read non-vector");
+
+    if(stream_eof(stream) || ((x = stream_read_char(stream)) != '('))
+        PANIC("mread_vector: expected '(' after '#'");
+
+    return mread_nested(l, stream, READ_VECTOR);
 }
 
 static object_t *mread_quote(lisp_t * l, char x, object_t * stream) {
     if(x != '\'')
         PANIC("mread_quote cannot read non-quote");
 
-    return cons(object_symbol_new("QUOTE"), cons(read(l, stream), NULL));
+    return mread_nested(l, stream, READ_QUOTE);
 }
 
 static object_t *mread_unquote(lisp_t * l, char x, object_t * stream) {
     if(x != ',')
         PANIC("mread_unquote cannot read non-unquote");
 
-    return cons(object_symbol_new("UNQUOTE"), cons(read(l, stream), NULL));
+    return rcons(l, object_symbol_new("UNQUOTE"),
+                 rcons(l, read(l, stream), NULL));
 }
 
 static object_t *mread_backquote(lisp_t * l, char x, object_t * stream) {
@@ -116,9 +329,19 @@ static object_t *mread_backquote(lisp_t * l, char x, object_t * stream) {
         cons(object_symbol_new(","), (object_t *) mread_unquote);
     l->readtable = cons(entry, l->readtable);
 
-    // read elements
+    object_t *list = lisp_read_backquote(l, read(l, stream));
+
+    l->readtable = old_readtable;
+
+    return list;
+}
+
+/** Rewrite the elements of a backquoted list.
+ *
+ *  Elements read as (UNQUOTE x) are replaced by x, all others are quoted.
+ */
+object_t *lisp_read_backquote(lisp_t * l, object_t * elems) {
     object_t *list = NULL, *tail = NULL;
-    object_t *elems = read(l, stream);
 
     while(elems) {
         object_t *o = NULL;
@@ -144,7 +367,5 @@ static object_t *mread_backquote(lisp_t * l, char x, object_t * stream) {
         elems = cdr(elems);
     }
 
-    l->readtable = old_readtable;
-
     return list;
 }
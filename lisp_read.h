@@ -5,6 +5,9 @@
 #include "lisp.h"
 
 object_t *lisp_read(lisp_t *, const char *, size_t);
+int lisp_read_next(lisp_t *, object_t *, object_t **);
+int lisp_read_datum(lisp_t *, object_t *, object_t **);
 object_t *readtable_new(void);
+object_t *lisp_read_backquote(lisp_t *, object_t *);
 
 #endif
@@ -33,6 +33,20 @@ static size_t object_sz(object_type_t type) {
         return sizeof(object_symbol_t);
     case OBJECT_STREAM:
         return sizeof(object_stream_t);
+    case OBJECT_VECTOR:
+        return sizeof(object_vector_t);
+    case OBJECT_HASHTABLE:
+        return sizeof(object_hashtable_t);
+    case OBJECT_ARRAY:
+        return sizeof(object_array_t);
+    case OBJECT_MAP:
+        return sizeof(object_map_t);
+    case OBJECT_STRUCT:
+        return sizeof(object_struct_t);
+    case OBJECT_LAZY:
+        return sizeof(object_lazy_t);
+    case OBJECT_TRANSDUCER:
+        return sizeof(object_transducer_t);
     case OBJECT_ERROR:
         PANIC("object_new: unknwon error");
     }
@@ -66,6 +80,26 @@ object_t *object_function_new(void *fptr) {
     return (object_t *) of;
 }
 
+/** Construct a function taking its arguments as an array, see evfun(). */
+object_t *object_vfunction_new(void *vptr) {
+    object_function_t *of = (object_function_t *) object_new(OBJECT_FUNCTION);
+
+    of->vptr = vptr;
+
+    return (object_t *) of;
+}
+
+/** Construct a function that is passed itself, and so data and index. */
+object_t *object_sfunction_new(void *sptr, void *data, size_t index) {
+    object_function_t *of = (object_function_t *) object_new(OBJECT_FUNCTION);
+
+    of->sptr = sptr;
+    of->data = data;
+    of->index = index;
+
+    return (object_t *) of;
+}
+
 object_t *object_lambda_new(object_t * args, object_t * expr) {
 
     object_lambda_t *l = (object_lambda_t *) object_new(OBJECT_LAMBDA);
@@ -86,7 +120,26 @@ object_t *object_macro_new(object_t * args, object_t * expr) {
     return (object_t *) l;
 }
 
-object_t *object_integer_new(int num) {
+/* Integers are never modified, so small ones are shared instead of
+ * allocating a new object for every counter step. */
+#define SMALL_INT_MIN -256
+#define SMALL_INT_MAX 1023
+
+static object_integer_t small_ints[SMALL_INT_MAX - SMALL_INT_MIN + 1];
+
+/* runs before main(), so reader threads never see the table half filled */
+__attribute__ ((constructor))
+static void small_ints_init(void) {
+    for(int i = SMALL_INT_MIN; i <= SMALL_INT_MAX; i++) {
+        small_ints[i - SMALL_INT_MIN].object.type = OBJECT_INTEGER;
+        small_ints[i - SMALL_INT_MIN].number = i;
+    }
+}
+
+object_t *object_integer_new(int64_t num) {
+    if((num >= SMALL_INT_MIN) && (num <= SMALL_INT_MAX))
+        return (object_t *) &small_ints[num - SMALL_INT_MIN];
+
     object_integer_t *o = (object_integer_t *) object_new(OBJECT_INTEGER);
 
     o->number = num;
@@ -106,7 +159,7 @@ object_t *object_symbol_new(char *s) {
     object_symbol_t *o = (object_symbol_t *) object_new(OBJECT_SYMBOL);
     size_t sz = strlen(s);
 
-    o->name = ALLOC(sz);
+    o->name = ALLOC(sz + 1);
 
     memcpy((char *) o->name, s, sz);
 
@@ -129,6 +182,89 @@ object_t *object_stream_new(FILE * fd, int (*read) (object_stream_t *),
     return (object_t *) o;
 }
 
+/** Construct a vector of len elements, each initialised to fill. */
+object_t *object_vector_new(size_t len, object_t * fill) {
+    object_vector_t *o = (object_vector_t *) object_new(OBJECT_VECTOR);
+
+    o->items = ALLOC((len ? len : 1) * sizeof(object_t *));
+    o->len = len;
+
+    for(size_t i = 0; i < len; i++)
+        o->items[i] = fill;
+
+    return (object_t *) o;
+}
+
+/** Construct an empty hash table comparing keys with test. */
+object_t *object_hashtable_new(hashtable_test_t test) {
+    object_hashtable_t *o =
+        (object_hashtable_t *) object_new(OBJECT_HASHTABLE);
+
+    o->test = test;
+    o->sz = 16;
+    o->entries = ALLOC(o->sz * sizeof(hashtable_entry_t));
+
+    return (object_t *) o;
+}
+
+/** Construct a zero-filled array of len unboxed integers. */
+object_t *object_array_new(array_type_t type, size_t len) {
+    object_array_t *o = (object_array_t *) object_new(OBJECT_ARRAY);
+    size_t elem = type == ARRAY_INT32 ? sizeof(int32_t) : sizeof(int64_t);
+
+    o->type = type;
+    o->data = ALLOC((len ? len : 1) * elem);
+    o->len = len;
+
+    return (object_t *) o;
+}
+
+/** Construct a persistent map of count entries, see hamt.c. */
+object_t *object_map_new(hashtable_test_t test, hamt_node_t * root,
+                         size_t count) {
+    object_map_t *o = (object_map_t *) object_new(OBJECT_MAP);
+
+    o->test = test;
+    o->root = root;
+    o->count = count;
+
+    return (object_t *) o;
+}
+
+/** Construct an instance of type with all slots NIL, stored inline. */
+object_t *object_struct_new(struct_type_t * type) {
+    object_struct_t *o = ALLOC(object_sz(OBJECT_STRUCT) +
+                               type->len * sizeof(object_t *));
+
+    o->object.type = OBJECT_STRUCT;
+    o->type = type;
+
+    return (object_t *) o;
+}
+
+object_t *object_lazy_new(void *next, object_t * src, object_t * fn,
+                          size_t n) {
+    object_lazy_t *o = (object_lazy_t *) object_new(OBJECT_LAZY);
+
+    o->next = next;
+    o->src = src;
+    o->fn = fn;
+    o->n = n;
+
+    return (object_t *) o;
+}
+
+/** Construct a transducer of len stages, to be filled in by the caller. */
+object_t *object_transducer_new(size_t len) {
+    object_transducer_t *o = ALLOC(object_sz(OBJECT_TRANSDUCER) +
+                                   len * sizeof(transducer_stage_t));
+
+    o->object.type = OBJECT_TRANSDUCER;
+    o->len = len;
+
+    return (object_t *) o;
+}
+
 int object_isa(object_t * o, object_type_t t) {
     if(o == NULL)
         return 0;
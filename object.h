@@ -2,6 +2,7 @@
 #define __OBJECT_H
 
 #include <stdio.h>
+#include <stdint.h>
 
 typedef enum object_type_t object_type_t;
 
@@ -14,6 +15,17 @@ typedef struct object_integer_t object_integer_t;
 typedef struct object_string_t object_string_t;
 typedef struct object_symbol_t object_symbol_t;
 typedef struct object_stream_t object_stream_t;
+typedef struct object_vector_t object_vector_t;
+typedef struct object_hashtable_t object_hashtable_t;
+typedef struct hashtable_entry_t hashtable_entry_t;
+typedef struct object_array_t object_array_t;
+typedef struct object_map_t object_map_t;
+typedef struct hamt_node_t hamt_node_t;
+typedef struct hamt_entry_t hamt_entry_t;
+typedef struct object_struct_t object_struct_t;
+typedef struct struct_type_t struct_type_t;
+typedef struct object_lazy_t object_lazy_t;
+typedef struct object_transducer_t object_transducer_t;
 
 enum object_type_t {
     OBJECT_ERROR,
@@ -25,8 +37,36 @@ enum object_type_t {
     OBJECT_STRING,
     OBJECT_SYMBOL,
     OBJECT_STREAM,
+    OBJECT_VECTOR,
+    OBJECT_HASHTABLE,
+    OBJECT_ARRAY,
+    OBJECT_MAP,
+    OBJECT_STRUCT,
+    OBJECT_LAZY,
+    OBJECT_TRANSDUCER,
 };
 
+typedef enum {
+    HASHTABLE_EQ,
+    HASHTABLE_EQUAL,
+} hashtable_test_t;
+
+typedef enum {
+    HASHTABLE_ENTRY_EMPTY,
+    HASHTABLE_ENTRY_FULL,
+    HASHTABLE_ENTRY_DELETED,
+} hashtable_entry_state_t;
+
+typedef enum {
+    TRANSDUCER_MAP,
+    TRANSDUCER_FILTER,
+} transducer_op_t;
+
+typedef enum {
+    ARRAY_INT32,
+    ARRAY_INT64,
+} array_type_t;
+
 struct object_t {
     object_type_t type;
 };
@@ -41,6 +81,9 @@ struct object_lambda_t {
     object_t object;
     object_t *args;
     object_t *expr;
+    object_t *closed;           // captured (NAME value) pairs, see closure()
+    size_t calls;               // counted until it is compiled, see jit_run()
+    void *jit;                  // its jit_code_t once compiled
 };
 
 struct object_macro_t {
@@ -49,14 +92,38 @@ struct object_macro_t {
     object_t *expr;
 };
 
+/** May a call be evaluated ahead of time, see lisp_optimize()? */
+typedef enum {
+    FUNCTION_IMPURE,
+    FUNCTION_EFFECT_FREE,       // no side effects and no calls of Lisp code
+    FUNCTION_PURE,              // no side effects, result depends on args only
+    FUNCTION_PURE_INTEGERS,     // the same, given one or more integers
+} function_purity_t;
+
+/** Builtins lisp_eval() runs in line while their names are bound to them. */
+typedef enum {
+    PRIM_NONE,
+    PRIM_CAR,
+    PRIM_CDR,
+    PRIM_CONS,
+    PRIM_EQ,
+    PRIM_ATOM,
+} function_prim_t;
+
 struct object_function_t {
     object_t object;
-    void *(*fptr) ();
+    void *(*fptr) ();           // (lisp_t *, object_t *args)
+    void *(*vptr) ();           // (lisp_t *, size_t argc, object_t **argv)
+    void *(*sptr) ();           // (lisp_t *, object_function_t *self, argc, argv)
+    void *data;                 // for sptr: what the function was made for
+    size_t index;
+    function_purity_t pure;
+    function_prim_t prim;
 };
 
 struct object_integer_t {
     object_t object;
-    int number;
+    int64_t number;
 };
 
 struct object_string_t {
@@ -74,23 +141,121 @@ struct object_symbol_t {
 struct object_stream_t {
     object_t object;
     FILE *fd;
+    const char *buf;            // memory streams read from buf, not fd
+    size_t len;
+    size_t pos;
     int (*read) (object_stream_t *);
     void (*unread) (object_stream_t *, int);
     void (*write) (object_stream_t *, int);
     void (*close) (object_stream_t *);
 };
 
+struct object_vector_t {
+    object_t object;
+    object_t **items;
+    size_t len;
+};
+
+struct hashtable_entry_t {
+    hashtable_entry_state_t state;
+    unsigned long hash;
+    object_t *key;
+    object_t *value;
+};
+
+struct object_hashtable_t {
+    object_t object;
+    hashtable_test_t test;
+    hashtable_entry_t *entries;
+    size_t sz;                  // number of entries, a power of two
+    size_t count;               // full entries
+    size_t used;                // full and deleted entries
+};
+
+struct object_array_t {
+    object_t object;
+    array_type_t type;
+    void *data;                 // len unboxed int32_t or int64_t
+    size_t len;
+};
+
+struct hamt_entry_t {
+    unsigned long hash;
+    object_t *key;
+    object_t *value;
+    hamt_node_t *node;          // if set, a subtrie instead of key and value
+};
+
+/** A trie node is never modified once it is reachable from a map. */
+struct hamt_node_t {
+    uint32_t bitmap;            // hash fragments present, 0 on collision nodes
+    size_t len;
+    hamt_entry_t slots[];
+};
+
+struct object_map_t {
+    object_t object;
+    hashtable_test_t test;
+    hamt_node_t *root;
+    size_t count;
+};
+
+/** The layout DEFSTRUCT defines, shared by all its instances. */
+struct struct_type_t {
+    object_t *name;
+    object_t **slots;           // slot names
+    size_t len;
+};
+
+struct object_struct_t {
+    object_t object;
+    struct_type_t *type;
+    object_t *slots[];
+};
+
+/** A generator, see lazy.c. */
+struct object_lazy_t {
+    object_t object;
+    int (*next) ();             // (lisp_t *, object_lazy_t *, object_t **)
+    object_t *src;              // what elements are taken from
+    object_t *fn;               // applied to them
+    size_t n;                   // elements left, for TAKE
+    int close;                  // src is a stream to close at the end
+    int done;
+};
+
+typedef struct {
+    transducer_op_t op;
+    object_t *fn;
+} transducer_stage_t;
+
+/** Stages applied in order to every element, see transduce.c. */
+struct object_transducer_t {
+    object_t object;
+    size_t len;
+    transducer_stage_t stages[];
+};
+
 object_t *object_cons_new(object_t *, object_t *);
 object_t *object_function_new(void *);
+object_t *object_vfunction_new(void *);
+object_t *object_sfunction_new(void *, void *, size_t);
 object_t *object_lambda_new(object_t *, object_t *);
 object_t *object_macro_new(object_t *, object_t *);
-object_t *object_integer_new(int);
+object_t *object_integer_new(int64_t);
 object_t *object_string_new(char *, size_t);
 object_t *object_symbol_new(char *);
 object_t *object_stream_new(FILE *, int (*)(object_stream_t *),
                             void (*)(object_stream_t *, int),
                             void (*)(object_stream_t *, int),
                             void (*)(object_stream_t *));
+object_t *object_vector_new(size_t, object_t *);
+object_t *object_hashtable_new(hashtable_test_t);
+object_t *object_array_new(array_type_t, size_t);
+object_t *object_map_new(hashtable_test_t, hamt_node_t *, size_t);
+object_t *object_struct_new(struct_type_t *);
+object_t *object_lazy_new(void *, object_t *, object_t *, size_t);
+object_t *object_transducer_new(size_t);
 
 int object_isa(object_t *, object_type_t);
 
@@ -0,0 +1,116 @@
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+static size_t scan_dispatch(const char *, size_t, const char *);
+
+static size_t (*scan_impl) (const char *, size_t, const char *) =
+    scan_dispatch;
+
+/** Return the index of the first byte of buf that is in set, or len.
+ *
+ *  set is a NUL-terminated string of (at most a handful of) bytes. The
+ *  vectorised variants compare 16 or 32 bytes per step against every byte
+ *  of set and pick the first hit from the combined bitmask; which variant
+ *  runs is decided from the CPU on first use.
+ */
+size_t scan_first_of(const char *buf, size_t len, const char *set) {
+    return scan_impl(buf, len, set);
+}
+
+static size_t scan_scalar(const char *buf, size_t len, const char *set) {
+    for(size_t i = 0; i < len; i++) {
+        for(const char *s = set; *s; s++) {
+            if(buf[i] == *s)
+                return i;
+        }
+    }
+
+    return len;
+}
+
+#ifdef SCAN_X86
+
+__attribute__ ((target("sse2")))
+static size_t scan_sse2(const char *buf, size_t len, const char *set) {
+    size_t i = 0;
+
+    for(; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (buf + i));
+        unsigned mask = 0;
+
+        for(const char *s = set; *s; s++)
+            mask |= _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(*s)));
+
+        if(mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + scan_scalar(buf + i, len - i, set);
+}
+
+__attribute__ ((target("avx2")))
+static size_t scan_avx2(const char *buf, size_t len, const char *set) {
+    size_t i = 0;
+
+    for(; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (buf + i));
+        unsigned mask = 0;
+
+        for(const char *s = set; *s; s++)
+            mask |= (unsigned)
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(v,
+                                                       _mm256_set1_epi8(*s)));
+
+        if(mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + scan_sse2(buf + i, len - i, set);
+}
+
+#endif // SCAN_X86
+
+/** Return the widest variant the running CPU supports. */
+scan_isa_t scan_best(void) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("avx2"))
+        return SCAN_AVX2;
+
+    if(__builtin_cpu_supports("sse2"))
+        return SCAN_SSE2;
+#endif
+
+    return SCAN_SCALAR;
+}
+
+/** Force a variant, e.g. to benchmark against the scalar code. */
+void scan_select(scan_isa_t isa) {
+    switch (isa) {
+#ifdef SCAN_X86
+    case SCAN_AVX2:
+        scan_impl = scan_avx2;
+        return;
+    case SCAN_SSE2:
+        scan_impl = scan_sse2;
+        return;
+#else
+    case SCAN_AVX2:
+    case SCAN_SSE2:
+#endif
+    case SCAN_SCALAR:
+        scan_impl = scan_scalar;
+        return;
+    }
+}
+
+static size_t scan_dispatch(const char *buf, size_t len, const char *set) {
+    scan_select(scan_best());
+
+    return scan_impl(buf, len, set);
+}
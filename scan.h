@@ -0,0 +1,17 @@
+#ifndef __SCAN_H
+#define __SCAN_H
+
+#include <stddef.h>
+
+typedef enum {
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2,
+} scan_isa_t;
+
+size_t scan_first_of(const char *, size_t, const char *);
+
+scan_isa_t scan_best(void);
+void scan_select(scan_isa_t);
+
+#endif
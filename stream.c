@@ -11,27 +11,44 @@ static void fd_writer(object_stream_t *, int);
 static int fd_reader(object_stream_t *);
 static void fd_unreader(object_stream_t *, int);
 static void fd_closer(object_stream_t *);
-
+static int mem_reader(object_stream_t *);
+static void mem_unreader(object_stream_t *, int);
+static void mem_closer(object_stream_t *);
+
+/** Open an input stream over len bytes of str.
+ *
+ *  The bytes are read in place, so str must outlive the stream.
+ */
 object_t *istream_mem(const char *str, size_t len) {
-    FILE *fd = fmemopen((void *) str, len, "r");
+    object_t *o =
+        object_stream_new(NULL, mem_reader, mem_unreader, NULL, mem_closer);
+    object_stream_t *s = (object_stream_t *) o;
 
-    if(fd == NULL) {
-        perror("fmemopen");
-        exit(EXIT_FAILURE);
-    }
+    s->buf = str;
+    s->len = len;
+
+    return o;
+}
+
+/** Open an input stream on the file at path, NULL if it cannot be read. */
+object_t *istream_open(const char *path) {
+    FILE *fd = fopen(path, "r");
+
+    if(fd == NULL)
+        return NULL;
 
     return object_stream_new(fd, fd_reader, fd_unreader, NULL, fd_closer);
 }
 
 object_t *istream_file(const char *path) {
-    FILE *fd = fopen(path, "r");
+    object_t *o = istream_open(path);
 
-    if(fd == NULL) {
+    if(o == NULL) {
         perror("fmemopen");
         exit(EXIT_FAILURE);
     }
 
-    return object_stream_new(fd, fd_reader, fd_unreader, NULL, fd_closer);
+    return o;
 }
 
 object_t *ostream_mem(void) {
@@ -55,6 +72,9 @@ int stream_eof(object_t * o) {
 
     object_stream_t *s = (object_stream_t *) o;
 
+    if(s->buf != NULL)
+        return s->pos >= s->len;
+
     if(feof(s->fd))
         return 1;
 
@@ -92,6 +112,37 @@ void stream_unread_char(object_t * o, int c) {
     stream->unread(stream, c);
 }
 
+/** Return the unread bytes of a memory stream, or NULL for other streams.
+ *
+ *  Lets readers scan ahead in bulk; consume what was used with
+ *  stream_skip().
+ */
+const char *stream_peek(object_t * o, size_t * avail) {
+    if(!object_isa(o, OBJECT_STREAM))
+        PANIC("cannot peek non-stream object");
+
+    object_stream_t *stream = (object_stream_t *) o;
+
+    if(stream->buf == NULL)
+        return NULL;
+
+    *avail = stream->len - stream->pos;
+
+    return stream->buf + stream->pos;
+}
+
+void stream_skip(object_t * o, size_t n) {
+    if(!object_isa(o, OBJECT_STREAM))
+        PANIC("cannot skip in non-stream object");
+
+    object_stream_t *stream = (object_stream_t *) o;
+
+    if((stream->buf == NULL) || (n > stream->len - stream->pos))
+        PANIC("stream_skip: cannot skip %d bytes", n);
+
+    stream->pos += n;
+}
+
 void stream_write_char(object_t * o, int c) {
     if(!object_isa(o, OBJECT_STREAM))
         PANIC("cannot write char to non-stream object");
@@ -185,3 +236,31 @@ static void fd_closer(object_stream_t * stream) {
         exit(EXIT_FAILURE);
     }
 }
+
+static int mem_reader(object_stream_t * stream) {
+    if(stream == NULL)
+        PANIC("stream is null!");
+
+    if(stream->pos >= stream->len)
+        return EOF;
+
+    return (unsigned char) stream->buf[stream->pos++];
+}
+
+/* Only the most recently read characters can be pushed back. */
+static void mem_unreader(object_stream_t * stream, int c) {
+    if(stream == NULL)
+        PANIC("stream is null!");
+
+    if((stream->pos == 0) || (stream->buf[stream->pos - 1] != (char) c))
+        PANIC("mem_unreader: cannot unread %c", c);
+
+    stream->pos--;
+}
+
+static void mem_closer(object_stream_t * stream) {
+    if(stream == NULL)
+        PANIC("stream is null!");
+
+    stream->pos = stream->len;
+}
@@ -4,6 +4,7 @@
 #include "object.h"
 
 object_t *istream_mem(const char *, size_t);
+object_t *istream_open(const char *);
 object_t *istream_file(const char *);
 object_t *ostream_mem(void);
 object_t *ostream_file(const char *);
@@ -11,6 +12,8 @@ object_t *ostream_file(const char *);
 int stream_eof(object_t *);
 int stream_read_char(object_t *);
 void stream_unread_char(object_t *, int);
+const char *stream_peek(object_t *, size_t *);
+void stream_skip(object_t *, size_t);
 void stream_write_char(object_t *, int);
 void stream_write_str(object_t *, object_t *);
 void stream_close(object_t *);
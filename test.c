@@ -10,6 +10,13 @@
 #include "lisp_print.h"
 #include "lisp_eval.h"
 #include "lisp_read.h"
+#include "lisp_parser.h"
+#include "lisp_load.h"
+#include "scan.h"
+#include "hashtable.h"
+#include "kernel.h"
+#include "hamt.h"
+#include "jit.h"
 #include "list.h"
 
 #define ARG_TEST_LIST       "--only-list"
@@ -29,6 +36,15 @@
         fprintf(stderr, "expected »%s«, got »%s«\n", o, tprint(l, i)); \
     CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, i), o); } while(0);
 
+/* what the reader makes of i, in the lisp_t l */
+#define ASSERT_EXPAND(i, o) do { \
+    object_t *r = lisp_pprint(lisp_read(l, i, strlen(i))); \
+    if(strcmp(((object_string_t *)r)->string, o)) \
+        fprintf(stderr, "expected »%s«, got »%s«\n", o, \
+                ((object_string_t *)r)->string); \
+    CU_ASSERT_STRING_EQUAL_FATAL(((object_string_t *)r)->string, o); \
+    } while(0);
+
 /*****************************
  ** Helper functions        **
  *****************************/
@@ -212,6 +228,174 @@ void test_lisp_read_macro_quote() {
     ASSERT_PRINT("'(A)", "(A)");
 }
 
+void test_lisp_read_next() {
+    lisp_t *l = lisp_new();
+    const char *s = "(CONS 1 2) 'A\n42\n\n(CAR\n\n'(B))\n";
+    object_t *stream = istream_mem(s, strlen(s));
+    object_t *o = NULL;
+
+    CU_ASSERT_EQUAL_FATAL(lisp_read_next(l, stream, &o), 1);
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        ((object_string_t *)lisp_pprint(o))->string, "(CONS 1 2)");
+
+    CU_ASSERT_EQUAL_FATAL(lisp_read_next(l, stream, &o), 1);
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        ((object_string_t *)lisp_pprint(o))->string, "(QUOTE A)");
+
+    CU_ASSERT_EQUAL_FATAL(lisp_read_next(l, stream, &o), 1);
+    CU_ASSERT_EQUAL_FATAL(o->type, OBJECT_INTEGER);
+
+    CU_ASSERT_EQUAL_FATAL(lisp_read_next(l, stream, &o), 1);
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        ((object_string_t *)lisp_pprint(lisp_eval(l, o)))->string, "B");
+
+    CU_ASSERT_EQUAL_FATAL(lisp_read_next(l, stream, &o), 0);
+    CU_ASSERT_PTR_NULL_FATAL(o);
+
+    stream_close(stream);
+}
+
+void test_lisp_parser_chunks() {
+    lisp_t *l = lisp_new();
+    lisp_parser_t *a = lisp_parser_new(l);
+    lisp_parser_t *b = lisp_parser_new(l);
+    const char *sa = "(CONS 'A\n  (CONS \"x y\" NIL)) 42";
+    const char *sb = "`(A ,B) (A () B)";
+    object_t *o = NULL;
+
+    /* interleave both inputs one byte at a time */
+    for(size_t i = 0; i < strlen(sa) || i < strlen(sb); i++) {
+        if(i < strlen(sa))
+            lisp_parser_feed(a, sa + i, 1);
+        if(i < strlen(sb))
+            lisp_parser_feed(b, sb + i, 1);
+    }
+
+    CU_ASSERT_EQUAL_FATAL(lisp_parser_next(a, &o), 1);
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        ((object_string_t *)lisp_pprint(lisp_eval(l, o)))->string,
+        "(A x y)");
+
+    /* the trailing token is pending until input ends */
+    CU_ASSERT_EQUAL_FATAL(lisp_parser_next(a, &o), 0);
+    lisp_parser_finish(a);
+    CU_ASSERT_EQUAL_FATAL(lisp_parser_next(a, &o), 1);
+    CU_ASSERT_EQUAL_FATAL(o->type, OBJECT_INTEGER);
+
+    CU_ASSERT_EQUAL_FATAL(lisp_parser_next(b, &o), 1);
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        ((object_string_t *)lisp_pprint(o))->string, "((QUOTE A) B)");
+
+    /* a () ends the list it is in, as it does for the reader, which
+     * leaves the rest to be read on its own */
+    CU_ASSERT_EQUAL_FATAL(lisp_parser_next(b, &o), 1);
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        ((object_string_t *)lisp_pprint(o))->string, "(A)");
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        ((object_string_t *)lisp_pprint(tread(l, "(A () B)")))->string,
+        "(A)");
+
+    CU_ASSERT_EQUAL_FATAL(lisp_parser_next(b, &o), 1);
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        ((object_string_t *)lisp_pprint(o))->string, "B");
+    CU_ASSERT_EQUAL_FATAL(lisp_parser_next(b, &o), 0);
+
+    lisp_parser_destroy(a);
+    lisp_parser_destroy(b);
+}
+
+void test_lisp_read_long() {
+    lisp_t *l = lisp_new();
+    size_t n = 10000;
+    char *s = calloc(2 * n + 16, sizeof(char));
+
+    /* a long symbol, then a long string */
+    memset(s, 'A', n);
+    s[n] = ' ';
+    s[n + 1] = '"';
+    memset(s + n + 2, 'b', n);
+    s[2 * n + 2] = '"';
+
+    object_t *stream = istream_mem(s, strlen(s));
+    object_t *o = NULL;
+
+    CU_ASSERT_EQUAL_FATAL(lisp_read_next(l, stream, &o), 1);
+    CU_ASSERT_EQUAL_FATAL(o->type, OBJECT_SYMBOL);
+    CU_ASSERT_EQUAL_FATAL(strlen(((object_symbol_t *) o)->name), n);
+
+    CU_ASSERT_EQUAL_FATAL(lisp_read_next(l, stream, &o), 1);
+    CU_ASSERT_EQUAL_FATAL(o->type, OBJECT_STRING);
+    CU_ASSERT_EQUAL_FATAL(((object_string_t *) o)->len, n);
+
+    stream_close(stream);
+
+    /* the same through a file stream, read a character at a time */
+    char filepath[256];
+
+    memset(filepath, 0, sizeof(char) * 256);
+    snprintf(filepath, 255, "/tmp/lips_test.%d.lips", getpid());
+
+    FILE *f = fopen(filepath, "w");
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+    fputs(s, f);
+    fclose(f);
+
+    stream = istream_file(filepath);
+
+    CU_ASSERT_EQUAL_FATAL(lisp_read_next(l, stream, &o), 1);
+    CU_ASSERT_EQUAL_FATAL(strlen(((object_symbol_t *) o)->name), n);
+
+    CU_ASSERT_EQUAL_FATAL(lisp_read_next(l, stream, &o), 1);
+    CU_ASSERT_EQUAL_FATAL(((object_string_t *) o)->len, n);
+    CU_ASSERT_EQUAL_FATAL(((object_string_t *) o)->string[n - 1], 'b');
+
+    stream_close(stream);
+    remove(filepath);
+    free(s);
+}
+
+void test_scan_first_of() {
+    char buf[100];
+
+    for(scan_isa_t isa = SCAN_SCALAR; isa <= scan_best(); isa++) {
+        scan_select(isa);
+
+        for(size_t at = 0; at < sizeof(buf); at++) {
+            memset(buf, 'x', sizeof(buf));
+            buf[at] = ')';
+
+            CU_ASSERT_EQUAL_FATAL(scan_first_of(buf, sizeof(buf), " )"), at);
+            CU_ASSERT_EQUAL_FATAL(scan_first_of(buf, at, " )"), at);
+        }
+    }
+
+    scan_select(scan_best());
+}
+
+void test_lisp_read_vector() {
+    ASSERT_PRINT("#(1 A \"b\" (C D))", "#(1 A b (C D))");
+    ASSERT_PRINT("'#()", "#()");
+    ASSERT_PRINT("(VREF #(A B C) 2)", "C");
+
+    lisp_t *l = lisp_new();
+    lisp_parser_t *p = lisp_parser_new(l);
+    const char *s = "#(1 #(2)) #A";
+    object_t *o = NULL;
+
+    lisp_parser_feed(p, s, strlen(s));
+    lisp_parser_finish(p);
+
+    CU_ASSERT_EQUAL_FATAL(lisp_parser_next(p, &o), 1);
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        ((object_string_t *)lisp_pprint(o))->string, "#(1 #(2))");
+
+    CU_ASSERT_EQUAL_FATAL(lisp_parser_next(p, &o), 1);
+    CU_ASSERT_EQUAL_FATAL(o->type, OBJECT_SYMBOL);
+
+    lisp_parser_destroy(p);
+}
+
 int setup_lisp_read_suite() {
     MAKE_SUITE("Lisp reader tests");
 
@@ -219,6 +403,11 @@ int setup_lisp_read_suite() {
     ADD_TEST(test_lisp_read_list, "lisp read list");
 
     ADD_TEST(test_lisp_read_macro_quote, "lisp read macro quote");
+    ADD_TEST(test_lisp_read_next, "lisp read successive forms");
+    ADD_TEST(test_lisp_parser_chunks, "lisp push parser");
+    ADD_TEST(test_lisp_read_long, "lisp read long symbol and string");
+    ADD_TEST(test_lisp_read_vector, "lisp read vector");
+    ADD_TEST(test_scan_first_of, "scan for delimiters");
 
     return 0;
 }
@@ -309,6 +498,10 @@ void test_lisp_eq() {
     ASSERT_PRINT("(EQ '() '())", "T");
     ASSERT_PRINT("(EQ () ())", "T");
     ASSERT_PRINT("(EQ (CONS 1 NIL) (CONS 1 NIL))", "NIL");
+    ASSERT_PRINT("(EQ 1 1)", "T");
+    ASSERT_PRINT("(EQ 1 2)", "NIL");
+    ASSERT_PRINT("(EQ \"ab\" \"ab\")", "T");
+    ASSERT_PRINT("(EQ \"ab\" \"abc\")", "NIL");
 }
 
 void test_lisp_cond() {
@@ -360,6 +553,37 @@ void test_lisp_lambda() {
     ASSERT_PRINT("((LAMBDA (X Y) (CONS X (CDR Y))) 'Z '(A B C))", "(Z B C)");
 }
 
+void test_lisp_closure() {
+    lisp_t *l = lisp_new();
+
+    teval(l, "(DEFUN ADDER (N) (LAMBDA (X) (+ X N)))");
+    teval(l, "(LABEL ADD2 (ADDER 2))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ADD2 40)"), "42");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "((ADDER 1) 2)"), "3");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAPCAR (ADDER 10) '(1 2))"),
+                                 "(11 12)");
+
+    /* closures nest, and capture only what they use */
+    teval(l, "(DEFUN CURRY (A) (LAMBDA (B) (LAMBDA (C) (CONS A (CONS B C)))))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(((CURRY 1) 2) 3)"), "(1 2 . 3)");
+    CU_ASSERT_PTR_NULL_FATAL(((object_lambda_t *)
+                              teval(l, "((LAMBDA (N) (LAMBDA (X) X)) 1)"))
+                             ->closed);
+
+    /* a function no longer sees the variables of its caller */
+    teval(l, "(LABEL Z 'GLOBAL)");
+    teval(l, "(DEFUN GET-Z (IGNORED) Z)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "((LAMBDA (Z) (GET-Z 1)) 'LOCAL)"),
+                                 "GLOBAL");
+
+    /* a lambda LABELled inside a function sees its own name */
+    teval(l, "(LABEL H (LAMBDA (F N) (F N)))");
+    teval(l, "(LABEL G (LAMBDA (N) (H (LABEL F (LAMBDA (K)"
+          " (COND ((EQ K 0) 0) (T (+ K (F (- K 1))))))) N)))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(G 4)"), "10");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(G 100)"), "5050");
+}
+
 void test_lisp_macro() {
     const char *foo_sexpr = "(LABEL FOO (MACRO (A) (CONS 13 (CONS A NIL))))";
     lisp_t *l = lisp_new();
@@ -374,6 +598,294 @@ void test_lisp_macro() {
         ((object_string_t *)lisp_pprint(r))->string, "(13 42)");
 }
 
+void test_lisp_macro_cache() {
+    lisp_t *l = lisp_new();
+    object_hashtable_t *cache = (object_hashtable_t *) l->macro_cache;
+
+    /* TWICE is not a macro yet when F is read, so it is left unexpanded
+     * until F's first call */
+    teval(l, "(DEFUN F (N) (TWICE N))");
+    teval(l, "(LABEL TWICE (MACRO (X) (+ X X)))");
+
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(F 21)"), "42");
+    CU_ASSERT_EQUAL_FATAL(cache->count, 1);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(F 2)"), "4");
+    CU_ASSERT_EQUAL_FATAL(cache->count, 1);
+
+    teval(l, "(LABEL TWICE (MACRO (X) (* X X)))");
+    CU_ASSERT_EQUAL_FATAL(cache->count, 0);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(F 5)"), "25");
+
+    /* the same call form expands whichever macro its operator names */
+    teval(l, "(LABEL SQR (MACRO (X) (* X X)))");
+    teval(l, "(LABEL TWICE (MACRO (X) (+ X X)))");
+    teval(l, "(LABEL APPLYM (LAMBDA (M N) (M N)))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(APPLYM TWICE 5)"), "10");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(APPLYM SQR 5)"), "25");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(APPLYM TWICE 5)"), "10");
+
+    /* macros used below the top level expand like top-level ones,
+     * including macros whose expansion defines a function */
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        tprint(l, "(((LAMBDA (X) (DEFUN G (Y) (CONS Y Y))) 1) 2)"),
+        "(2 . 2)");
+}
+
+void test_lisp_macroexpand_all() {
+    lisp_t *l = lisp_new();
+
+    l->optimize = 0;
+
+    teval(l, "(LABEL TWICE (MACRO (X) (+ X X)))");
+    teval(l, "(LABEL SQ (MACRO (X) (* X X)))");
+
+    ASSERT_EXPAND("(CONS (TWICE 1) (SQ (TWICE 2)))",
+                  "(CONS (+ 1 1) (* (+ 2 2) (+ 2 2)))");
+    ASSERT_EXPAND("(COND ((TWICE A) (SQ B)) (T (TWICE C)))",
+                  "(COND ((+ A A) (* B B)) (T (+ C C)))");
+    ASSERT_EXPAND("(LABEL X (TWICE 2))", "(LABEL X (+ 2 2))");
+
+    /* data, macro bodies and shadowed names are not expanded */
+    ASSERT_EXPAND("'(TWICE 1)", "(QUOTE (TWICE 1))");
+    ASSERT_EXPAND("(MACRO (Y) (TWICE Y))", "(MACRO (Y) (TWICE Y))");
+    ASSERT_EXPAND("(LAMBDA (TWICE) (TWICE (SQ 1)))",
+                  "(LAMBDA (TWICE) (TWICE (* 1 1)))");
+
+    /* a function using a macro no longer meets it when it runs */
+    teval(l, "(DEFUN F (N) (SQ (TWICE N)))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(F 3)"), "36");
+    CU_ASSERT_EQUAL_FATAL(((object_hashtable_t *) l->macro_cache)->count, 0);
+}
+
+void test_lisp_optimize() {
+    lisp_t *l = lisp_new();
+
+    teval(l, "(LABEL TWICE (MACRO (X) (+ X X)))");
+
+    ASSERT_EXPAND("(CONS (TWICE 1) (* (TWICE 2) 4))", "(CONS 2 16)");
+    ASSERT_EXPAND("(CAR '(A B))", "(QUOTE A)");
+    ASSERT_EXPAND("(EQ (CDR '(A)) NIL)", "T");
+    ASSERT_EXPAND("(LAMBDA (CAR) (CAR '(A B)))",
+                  "(LAMBDA (CAR) (CAR (QUOTE (A B))))");
+    ASSERT_EXPAND("(CONS 'A '42)", "(CONS (QUOTE A) 42)");
+
+    /* dead COND clauses */
+    ASSERT_EXPAND("(COND ((EQ 1 2) A) (X B) (T C) (Y D))",
+                  "(COND (X B) (T C))");
+    ASSERT_EXPAND("(COND ((< 1 2) A) (X B))", "A");
+    ASSERT_EXPAND("(COND (NIL A))", "NIL");
+
+    /* errors are left for run time */
+    ASSERT_EXPAND("(/ 1 0)", "(/ 1 0)");
+    ASSERT_EXPAND("(+ 1 A)", "(+ 1 A)");
+    ASSERT_EXPAND("(COND (X 1) (T (-)))", "(COND (X 1) (T (-)))");
+
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(OPT-REPORT)"),
+        "((FOLD (+ 1 1) 2) (FOLD (+ 2 2) 4) (FOLD (* 4 4) 16) "
+        "(FOLD (CAR (QUOTE (A B))) (QUOTE A)) (FOLD (CDR (QUOTE (A))) NIL) (FOLD (EQ NIL NIL) T) "
+        "(FOLD (EQ 1 2) NIL) (PRUNE (NIL A)) (PRUNE (Y D)) (FOLD (< 1 2) T) "
+        "(PRUNE (X B)) (PRUNE (NIL A)))");
+    CU_ASSERT_PTR_NULL_FATAL(teval(l, "(OPT-REPORT)"));
+}
+
+void test_lisp_inline() {
+    lisp_t *l = lisp_new();
+
+    teval(l, "(DEFUN FIRST (X) (CAR X))");
+    teval(l, "(DEFUN REST (X) (CDR X))");
+    teval(l, "(DEFUN SECOND (X) (FIRST (REST X)))");
+    teval(l, "(DEFUN SWAP (A B) (CONS B A))");
+    teval(l, "(DEFUN F (L) (CONS (SECOND L) (SWAP (FIRST L) 3)))");
+
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(F '(1 2))"), "(2 3 . 1)");
+    ASSERT_EXPAND("(FIRST '(A B))",
+                  "(INLINE #<Lambda> (FIRST (QUOTE (A B))) (QUOTE A))");
+
+    /* each argument must still be evaluated once, in order */
+    teval(l, "(DEFUN TWICE (X) (+ X X))");
+    teval(l, "(DEFUN PRINTED (X) (PRINT X))");
+    ASSERT_EXPAND("(TWICE Y)", "(INLINE #<Lambda> (TWICE Y) (+ Y Y))");
+    ASSERT_EXPAND("(TWICE (CAR Y))", "(TWICE (CAR Y))");
+    ASSERT_EXPAND("(SWAP (CAR Y) (CDR Y))", "(SWAP (CAR Y) (CDR Y))");
+    ASSERT_EXPAND("(PRINTED 1)", "(PRINTED 1)");
+
+    /* nor may an expression rebind a symbol passed with it */
+    teval(l, "(DEFUN BACK (X Y) (CONS Y X))");
+    teval(l, "(LABEL Z 1)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(BACK (LABEL Z 5) Z)"), "(5 . 5)");
+    ASSERT_EXPAND("(BACK (CAR W) Z)",
+                  "(INLINE #<Lambda> (BACK (CAR W) Z) (CONS Z (CAR W)))");
+
+    /* redefining a function reaches the code it was inlined into */
+    teval(l, "(DEFUN REST (X) (CDR (CDR X)))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(F '(1 2 3))"), "(3 3 . 1)");
+    teval(l, "(DEFUN SWAP (A B) (CONS A B))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(F '(1 2 3))"), "(3 1 . 3)");
+
+    /* a local binding of a name the body uses prevents inlining */
+    teval(l, "(DEFUN G (FIRST) (CONS FIRST (SECOND '(1 2 3))))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(G 7)"), "(7 . 3)");
+    ASSERT_EXPAND("(LAMBDA (CAR) (FIRST CAR))",
+                  "(LAMBDA (CAR) (FIRST CAR))");
+}
+
+void test_lisp_jit() {
+    lisp_t *l = lisp_new();
+    char sexpr[1024] = "(WALK '(";
+
+    for(int i = 0; i < 2 * JIT_THRESHOLD; i++)
+        sprintf(sexpr + strlen(sexpr), "%d ", i);
+
+    strcat(sexpr, "))");
+
+    teval(l, "(DEFUN WALK (X) (COND ((ATOM X) 0) "
+          "(T (+ (CAR X) (WALK (CDR X))))))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), "19900");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), "19900");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(WALK 'A)"), "0");
+
+    object_lambda_t *walk = (object_lambda_t *) teval(l, "WALK");
+
+#if defined(__x86_64__)
+    CU_ASSERT_PTR_NOT_NULL_FATAL(walk->jit);
+#endif
+
+    /* rebinding a builtin the code open-codes sends it back to the
+     * interpreter, until it is hot again */
+    teval(l, "(LABEL CAR (LAMBDA (X) 1))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(WALK '(5 5 5))"), "3");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), "200");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(WALK '(5 5 5))"), "3");
+
+#if defined(__x86_64__)
+    CU_ASSERT_PTR_NOT_NULL_FATAL(walk->jit);
+#endif
+
+    /* bodies the compiler leaves alone keep being interpreted */
+    teval(l, "(DEFUN MAKE (N) (LAMBDA (X) (+ X N)))");
+    for(int i = 0; i < 2 * JIT_THRESHOLD; i++)
+        teval(l, "(MAKE 1)");
+    CU_ASSERT_PTR_NULL_FATAL(((object_lambda_t *) teval(l, "MAKE"))->jit);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "((MAKE 1) 2)"), "3");
+
+    /* a parameter may hold a macro, before and after it is compiled */
+    teval(l, "(LABEL TWICE (MACRO (X) (+ X X)))");
+    teval(l, "(LABEL APPLYM (LAMBDA (M N) (M N)))");
+    for(int i = 0; i < 2 * JIT_THRESHOLD; i++)
+        CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(APPLYM TWICE (+ 2 3))"),
+                                     "10");
+
+#if defined(__x86_64__)
+    CU_ASSERT_PTR_NOT_NULL_FATAL(((object_lambda_t *) teval(l, "APPLYM"))->jit);
+#endif
+
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(APPLYM CDR '(1 2))"), "(2)");
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(teval(l, "(JIT NIL)"));
+    CU_ASSERT_PTR_NULL_FATAL(teval(l, "(JIT T)"));
+}
+
+void test_lisp_prims() {
+    lisp_t *l = lisp_new();
+
+    teval(l, "(DEFUN SWAP (X) (CONS (CAR (CDR X)) (CONS (CAR X) (CDDR X))))");
+    teval(l, "(DEFUN CDDR (X) (CDR (CDR X)))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(SWAP '(1 2 3))"), "(2 1 3)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ATOM (CAR '(A)))"), "T");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(EQ (CAR '(A)) 'A)"), "T");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(CAR 'A)"), "NIL");
+
+    /* a parameter named like a builtin shadows it */
+    teval(l, "(DEFUN APPLY1 (CAR X) (CAR X))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(APPLY1 (LAMBDA (Y) 42) 1)"),
+                                 "42");
+
+    /* rebinding it takes effect everywhere */
+    teval(l, "(LABEL CAR (LAMBDA (X) 'FIRST))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(SWAP '(1 2 3))"),
+                                 "(FIRST FIRST 3)");
+    teval(l, "(LABEL CONS (LAMBDA (X Y) X))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(SWAP '(1 2 3))"), "FIRST");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(CDR '(1 2))"), "(2)");
+}
+
+void test_lisp_deep() {
+    lisp_t *l = lisp_new();
+    size_t n = 20000;
+    char *sexpr = calloc(2 * n + 16, sizeof(char));
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(sexpr);
+
+    /* nested far deeper than the C stack would allow recursing */
+    strcpy(sexpr, "'");
+    memset(sexpr + 1, '(', n);
+    sexpr[n + 1] = 'A';
+    memset(sexpr + n + 2, ')', n);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), sexpr + 1);
+    free(sexpr);
+
+    /* a call with more arguments than the C stack has room for frames,
+     * the macro call last so the whole list is rebuilt */
+    n = 300000;
+    sexpr = calloc(2 * n + 32, sizeof(char));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(sexpr);
+    strcpy(sexpr, "(+");
+
+    for(size_t i = 0; i < n; i++)
+        strcat(sexpr + 2 * i, " 1");
+
+    strcat(sexpr + 2 * n, " (TWICE 1))");
+    teval(l, "(LABEL TWICE (MACRO (X) (+ X X)))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), "300002");
+    teval(l, "(OPTIMIZE NIL)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), "300002");
+    teval(l, "(OPTIMIZE T)");
+    free(sexpr);
+
+    /* code nested as deep, expanded and optimized as it is read, folded
+     * to a constant or evaluated */
+    n = 100000;
+    sexpr = calloc(6 * n + 64, sizeof(char));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(sexpr);
+
+    for(size_t i = 0; i < n; i++)
+        memcpy(sexpr + 5 * i, "(+ 1 ", 5);
+
+    strcpy(sexpr + 5 * n, "0");
+    memset(sexpr + 5 * n + 1, ')', n);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), "100000");
+    teval(l, "(OPTIMIZE NIL)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), "100000");
+    teval(l, "(OPTIMIZE T)");
+
+    strcpy(sexpr, "(LABEL F (LAMBDA (N) ");
+
+    for(size_t i = 0; i < n; i++)
+        strcat(sexpr + 21 + 5 * i, "(+ N ");
+
+    strcat(sexpr + 21 + 5 * n, "(TWICE N)");
+    memset(sexpr + 30 + 5 * n, ')', n + 2);
+    teval(l, sexpr);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(F 1)"), "100002");
+    free(sexpr);
+
+    teval(l, "(DEFUN D (N) (COND ((EQ N 0) 0) (T (+ 1 (D (- N 1))))))");
+    teval(l, "(JIT NIL)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(D 20000)"), "20000");
+    teval(l, "(JIT T)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(D 20000)"), "20000");
+
+    /* past the limit the error handler's value is taken instead */
+    teval(l, "(LABEL *ERROR-HANDLER* (LAMBDA (C) C))");
+    teval(l, "(DEFUN DOWN (N) (COND ((EQ N 0) 'BOTTOM) (T (DOWN (- N 1)))))");
+    teval(l, "(JIT NIL)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAX-DEPTH 100)"), "1000000");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(DOWN 1000)"), "STACK-OVERFLOW");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(DOWN 10)"), "BOTTOM");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAX-DEPTH 1000000)"), "100");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(DOWN 1000)"), "BOTTOM");
+}
+
 void test_lisp_eval() {
     ASSERT_PRINT("(EVAL 42)", "42");
     ASSERT_PRINT("(EVAL '42)", "42");
@@ -404,7 +916,15 @@ int setup_lisp_suite() {
     ADD_TEST(test_lisp_label, "lisp LABEL");
     ADD_TEST(test_lisp_label_nl, "lisp LABEL with newline after label");
     ADD_TEST(test_lisp_lambda, "lisp LAMBDA");
+    ADD_TEST(test_lisp_closure, "lisp closures");
     ADD_TEST(test_lisp_macro, "lisp MACRO");
+    ADD_TEST(test_lisp_macro_cache, "lisp MACRO expansion cache");
+    ADD_TEST(test_lisp_macroexpand_all, "lisp nested macro expansion");
+    ADD_TEST(test_lisp_optimize, "lisp constant folding");
+    ADD_TEST(test_lisp_inline, "lisp function inlining");
+    ADD_TEST(test_lisp_jit, "lisp JIT compilation of hot lambdas");
+    ADD_TEST(test_lisp_prims, "lisp primitives run in line");
+    ADD_TEST(test_lisp_deep, "lisp deep nesting and MAX-DEPTH");
     //TODO: ADD_TEST(test_lisp_read, "lisp READ");
     ADD_TEST(test_lisp_eval, "lisp EVAL");
     //TODO: ADD_TEST(test_lisp_read, "lisp LOOP");
@@ -437,6 +957,60 @@ void test_fun_assoc() {
     ASSERT_PRINT("(ASSOC 'B '((A 1) (B 2) (C 3)))", "(B 2)");
 }
 
+void test_fun_assoc_index() {
+    lisp_t *l = lisp_new();
+    char sexpr[4096];
+    size_t si = snprintf(sexpr, sizeof(sexpr), "(LABEL AL '(");
+
+    for(int i = 0; i < 100; i++)
+        si += snprintf(sexpr + si, sizeof(sexpr) - si, "(K%d %d) ", i % 90, i);
+
+    snprintf(sexpr + si, sizeof(sexpr) - si, "))");
+    teval(l, sexpr);
+
+    for(int i = 0; i < 20; i++)
+        CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ASSOC 'K50 AL)"), "(K50 50)");
+
+    int indexed = 0;
+    object_t *al = teval(l, "AL");
+
+    for(size_t i = 0; i < ASSOC_CACHE_SZ; i++) {
+        if(l->assoc_cache[i].head == al)
+            indexed = l->assoc_cache[i].index != NULL;
+    }
+
+    CU_ASSERT_EQUAL_FATAL(indexed, 1);
+
+    /* repeated keys resolve to the first pair, missing ones to NIL */
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ASSOC 'K5 AL)"), "(K5 5)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ASSOC 'K95 AL)"), "NIL");
+
+    /* consing onto the front shadows, the old list is unaffected */
+    teval(l, "(LABEL AL2 (CONS '(K60 NEW) AL))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ASSOC 'K60 AL2)"), "(K60 NEW)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ASSOC 'K70 AL2)"), "(K70 70)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ASSOC 'K60 AL)"), "(K60 60)");
+
+    /* modifying the head cell or appending drops the index */
+    object_t *tail = al;
+
+    for(int i = 0; i < 20; i++)
+        tprint(l, "(ASSOC 'K50 AL)");
+
+    ((object_cons_t *) al)->car = teval(l, "'(K50 FIRST)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ASSOC 'K50 AL)"), "(K50 FIRST)");
+
+    while(((object_cons_t *) tail)->cdr != NULL)
+        tail = ((object_cons_t *) tail)->cdr;
+
+    for(int i = 0; i < 20; i++)
+        tprint(l, "(ASSOC 'K50 AL)");
+
+    ((object_cons_t *) tail)->cdr = object_cons_new(teval(l, "'(K95 LAST)"),
+                                                    NULL);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ASSOC 'K95 AL)"), "(K95 LAST)");
+}
+
 void test_fun_pair() {
     ASSERT_PRINT("(PAIR '(A B C) '(1 2 3))", "((A 1) (B 2) (C 3))");
     ASSERT_PRINT("(ASSOC 'B (PAIR '(A B C) '(1 2 3)))", "(B 2)");
@@ -474,15 +1048,593 @@ void test_fun_error_unbound() {
         ((object_string_t *)lisp_pprint(r))->string, "(42 . 42)");
 }
 
+void test_fun_load_data() {
+    char filepath[256];
+
+    memset(filepath, 0, sizeof(char) * 256);
+    snprintf(filepath, 255, "/tmp/lips_test.%d.lips", getpid());
+
+    FILE *f = fopen(filepath, "w");
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+
+    for(int i = 0; i < 1000; i++)
+        fprintf(f, "(%d \"a b ) c\" '(X %d))%s", i, i, i % 3 ? " " : "\n");
+
+    fclose(f);
+
+    lisp_t *l = lisp_new();
+    object_t *list = lisp_load_data(l, filepath, 7);
+
+    for(int i = 0; i < 1000; i++) {
+        CU_ASSERT_PTR_NOT_NULL_FATAL(list);
+
+        object_t *rec = ((object_cons_t *) list)->car;
+        object_t *n = ((object_cons_t *) rec)->car;
+
+        CU_ASSERT_EQUAL_FATAL(n->type, OBJECT_INTEGER);
+        CU_ASSERT_EQUAL_FATAL(((object_integer_t *) n)->number, i);
+
+        list = ((object_cons_t *) list)->cdr;
+    }
+
+    CU_ASSERT_PTR_NULL_FATAL(list);
+
+    char sexpr[512];
+
+    snprintf(sexpr, 511, "(CAR (CDR (CAR (LOAD-DATA \"%s\"))))", filepath);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), "a b ) c");
+
+    remove(filepath);
+}
+
+void test_fun_hcons() {
+    lisp_t *l = lisp_new();
+
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(EQ '(A (1 \"s\")) '(A (1 \"s\")))"),
+                                 "NIL");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(EQ (HCONS 1 NIL) (HCONS 1 NIL))"),
+                                 "T");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(HCONS-READ T)"), "NIL");
+
+    /* read data is shared now, down to the last cell */
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(EQ '(A (1 \"s\")) '(A (1 \"s\")))"),
+                                 "T");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(EQ (CDR '(X 'B)) (CDR '(Y 'B)))"),
+                                 "T");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(EQ '(A B) '(A C))"), "NIL");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(EQ (HCONS 'A '(B)) '(A B))"),
+                                 "T");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(CONS 1 '(2 (3)))"), "(1 2 (3))");
+
+    lisp_parser_t *p = lisp_parser_new(l);
+    object_t *a = NULL, *b = NULL;
+    const char *s = "(A '(B 1)) (A '(B 1))";
+
+    lisp_parser_feed(p, s, strlen(s));
+    CU_ASSERT_EQUAL_FATAL(lisp_parser_next(p, &a), 1);
+    CU_ASSERT_EQUAL_FATAL(lisp_parser_next(p, &b), 1);
+    CU_ASSERT_PTR_EQUAL_FATAL(a, b);
+    lisp_parser_destroy(p);
+
+    /* records read by different threads are shared too */
+    char filepath[256];
+
+    memset(filepath, 0, sizeof(char) * 256);
+    snprintf(filepath, 255, "/tmp/lips_test_hcons.%d.lips", getpid());
+
+    FILE *f = fopen(filepath, "w");
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+
+    for(int i = 0; i < 1000; i++)
+        fprintf(f, "(%d (STATUS \"ok\"))\n", i % 10);
+
+    fclose(f);
+
+    object_t *list = lisp_load_data(l, filepath, 4);
+    object_t *first = ((object_cons_t *) list)->car;
+
+    for(int i = 0; i < 1000; i++) {
+        object_t *rec = ((object_cons_t *) list)->car;
+
+        CU_ASSERT_PTR_EQUAL_FATAL(((object_cons_t *) rec)->cdr,
+                                  ((object_cons_t *) first)->cdr);
+
+        if(i % 10 == 0)
+            CU_ASSERT_PTR_EQUAL_FATAL(rec, first);
+
+        list = ((object_cons_t *) list)->cdr;
+    }
+
+    remove(filepath);
+}
+
+void test_fun_lazy() {
+    lisp_t *l = lisp_new();
+    char filepath[256], sexpr[512];
+
+    memset(filepath, 0, sizeof(char) * 256);
+    snprintf(filepath, 255, "/tmp/lips_test_lazy.%d.lips", getpid());
+
+    FILE *f = fopen(filepath, "w");
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+
+    for(int i = 0; i < 1000; i++)
+        fprintf(f, "%d\n", i);
+
+    fclose(f);
+
+    snprintf(sexpr, 511, "(FORCE (TAKE 2 (LINES \"%s\")))", filepath);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), "(0 1)");
+
+    snprintf(sexpr, 511, "(LAZY-REDUCE (LAMBDA (N X) (+ N 1)) 0 "
+             "(LINES \"%s\"))", filepath);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), "1000");
+
+    /* sum of the odd numbers, one form at a time */
+    snprintf(sexpr, 511, "(LAZY-REDUCE + 0 "
+             "(LAZY-FILTER (LAMBDA (X) (EQ (MOD X 2) 1)) "
+             "(FORMS \"%s\")))", filepath);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), "250000");
+
+    /* sequences are consumed as they are read */
+    snprintf(sexpr, 511, "(LABEL S (FORMS \"%s\"))", filepath);
+    teval(l, sexpr);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(FORCE (TAKE 3 S))"), "(0 1 2)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(FORCE (TAKE 1 S))"), "(3)");
+
+    remove(filepath);
+
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        tprint(l, "(FORCE (LAZY-MAP (LAMBDA (X) (* X X)) '(1 2 3)))"),
+        "(1 4 9)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(FORCE (TAKE 5 '(1 2)))"),
+                                 "(1 2)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(FORCE (TAKE 0 '(1 2)))"), "NIL");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(LAZY-MAP CAR '((1)))"),
+                                 "#<Lazy>");
+
+    teval(l, "(LABEL *ERROR-HANDLER* (LAMBDA (C) C))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(LINES \"/nonexistent/x\")"),
+                                 "FILE-ERROR");
+}
+
+void test_fun_transduce() {
+    lisp_t *l = lisp_new();
+
+    teval(l, "(DEFUN SQ (X) (* X X))");
+    teval(l, "(DEFUN ODD (X) (EQ (MOD X 2) 1))");
+    teval(l, "(LABEL XS '(1 2 3 4 5))");
+
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAPCAR SQ XS)"), "(1 4 9 16 25)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(FILTER ODD XS)"), "(1 3 5)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(REDUCE + 0 XS)"), "15");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(REDUCE + 0 NIL)"), "0");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(REDUCE CONS NIL '(1 2))"),
+                                 "((NIL . 1) . 2)");
+
+    /* stages apply left to right */
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        tprint(l, "(TRANSDUCE (COMP (MAP SQ) (FILTER ODD)) + 0 XS)"), "35");
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        tprint(l, "(TRANSDUCE (COMP (FILTER ODD) (MAP SQ) (MAP SQ)) + 0 XS)"),
+        "707");
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        tprint(l, "(TRANSDUCE (COMP) + 0 XS)"), "15");
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        tprint(l, "(TRANSDUCE (COMP (COMP (MAP SQ)) (FILTER ODD)) + 0 "
+               "(LAZY-MAP SQ XS))"), "707");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAP SQ)"), "#<Transducer>");
+}
+
+void test_fun_vector() {
+    lisp_t *l = lisp_new();
+
+    ASSERT_PRINT("(VLENGTH (MAKE-VECTOR 3 'A))", "3");
+    ASSERT_PRINT("(MAKE-VECTOR 2 'A)", "#(A A)");
+
+    teval(l, "(LABEL V (MAKE-VECTOR 3))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(VSET V 1 'X)"), "X");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(VREF V 1)"), "X");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "V"), "#(NIL X NIL)");
+
+    teval(l, "(LABEL *ERROR-HANDLER* (LAMBDA (C) C))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(VREF V 3)"),
+                                 "INDEX-OUT-OF-RANGE");
+}
+
+void test_fun_defstruct() {
+    lisp_t *l = lisp_new();
+
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(DEFSTRUCT POINT X Y)"), "POINT");
+    teval(l, "(LABEL P (MAKE-POINT 1 '(2)))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "P"), "#S(POINT :X 1 :Y (2))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(POINT-X P)"), "1");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(POINT-Y P)"), "(2)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(SET-POINT-X P 5)"), "5");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(POINT-X P)"), "5");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAKE-POINT 1)"),
+                                 "#S(POINT :X 1 :Y NIL)");
+
+    teval(l, "(DEFSTRUCT POINT3 X Y Z)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(POINT-P P)"), "T");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(POINT3-P P)"), "NIL");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(POINT-P '(1 2))"), "NIL");
+
+    /* accessors are ordinary functions */
+    teval(l, "(DEFUN NORM1 (P) (+ (POINT3-X P) (POINT3-Y P) (POINT3-Z P)))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(NORM1 (MAKE-POINT3 1 2 3))"),
+                                 "6");
+
+    object_t *r = lisp_apply(l, teval(l, "POINT-Y"), teval(l, "(CONS P NIL)"));
+
+    CU_ASSERT_STRING_EQUAL_FATAL(((object_string_t *) lisp_pprint(r))->string,
+                                 "(2)");
+
+    teval(l, "(LABEL *ERROR-HANDLER* (LAMBDA (C) C))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAKE-POINT 1 2 3)"),
+                                 "TOO-MANY-ARGUMENTS");
+}
+
+void test_fun_hash_table() {
+    lisp_t *l = lisp_new();
+
+    teval(l, "(LABEL H (MAKE-HASH-TABLE))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(PUTHASH 'A 1 H)"), "1");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(PUTHASH \"s\" 2 H)"), "2");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(GETHASH 'A H)"), "1");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(GETHASH \"s\" H)"), "2");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(GETHASH 'B H 'NONE)"), "NONE");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(HASH-TABLE-COUNT H)"), "2");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(REMHASH 'A H)"), "T");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(REMHASH 'A H)"), "NIL");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(GETHASH 'A H)"), "NIL");
+
+    teval(l, "(LABEL R (MAKE-HASH-TABLE))");
+    teval(l, "(MAPHASH (LAMBDA (K V) (PUTHASH V K R)) H)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(GETHASH 2 R)"), "s");
+
+    /* keys put while walking the table, growing it, are not visited */
+    char put[64];
+
+    teval(l, "(LABEL W (MAKE-HASH-TABLE))");
+    teval(l, "(LABEL SEEN (MAKE-HASH-TABLE))");
+
+    for(int i = 1; i <= 32; i++) {
+        snprintf(put, sizeof(put), "(PUTHASH %d %d W)", i, i);
+        teval(l, put);
+    }
+
+    teval(l, "(MAPHASH (LAMBDA (K V)"
+          " (PUTHASH K (PUTHASH (+ K 1000) V W) SEEN)) W)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(HASH-TABLE-COUNT SEEN)"), "32");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(HASH-TABLE-COUNT W)"), "64");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(GETHASH 1032 W)"), "32");
+
+    teval(l, "(LABEL E (MAKE-HASH-TABLE 'EQUAL))");
+    teval(l, "(PUTHASH '(A (B)) 'X E)");
+    teval(l, "(PUTHASH '(A (B)) 'X H)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(GETHASH '(A (B)) E)"), "X");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(GETHASH '(A (B)) H)"), "NIL");
+
+    /* grow, and reuse deleted entries */
+    object_t *h = object_hashtable_new(HASHTABLE_EQ);
+
+    for(int i = 0; i < 10000; i++)
+        hashtable_put(l, h, object_integer_new(i), object_integer_new(-i));
+
+    for(int i = 0; i < 10000; i += 2)
+        CU_ASSERT_EQUAL_FATAL(hashtable_remove(l, h, object_integer_new(i)),
+                              1);
+
+    for(int i = 0; i < 10000; i++) {
+        int found;
+        object_t *v = hashtable_get(l, h, object_integer_new(i), &found);
+
+        CU_ASSERT_EQUAL_FATAL(found, i % 2);
+
+        if(found)
+            CU_ASSERT_EQUAL_FATAL(((object_integer_t *) v)->number, -i);
+    }
+
+    CU_ASSERT_EQUAL_FATAL(((object_hashtable_t *) h)->count, 5000);
+}
+
+void test_fun_map() {
+    lisp_t *l = lisp_new();
+
+    teval(l, "(LABEL M0 (MAKE-MAP))");
+    teval(l, "(LABEL M1 (MAP-PUT 'A 1 M0))");
+    teval(l, "(LABEL M2 (MAP-PUT 'B 2 M1))");
+    teval(l, "(LABEL M3 (MAP-PUT 'A 3 M2))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAP-GET 'A M1)"), "1");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAP-GET 'A M3)"), "3");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAP-GET 'B M1 'NONE)"), "NONE");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAP-COUNT M3)"), "2");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAP-COUNT M0)"), "0");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAP-ALIST M1)"), "((A 1))");
+
+    teval(l, "(LABEL M4 (MAP-REMOVE 'A M3))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAP-GET 'A M4)"), "NIL");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAP-GET 'A M3)"), "3");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAP-COUNT M4)"), "1");
+
+    teval(l, "(LABEL E (MAP-PUT '(A (B)) 'X (MAKE-MAP 'EQUAL)))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(MAP-GET '(A (B)) E)"), "X");
+
+    /* every version keeps its own entries while sharing structure */
+    object_t *versions[5];
+    object_t *m = teval(l, "M0");
+
+    for(int i = 0; i < 5000; i++) {
+        if(i % 1000 == 0)
+            versions[i / 1000] = m;
+
+        m = hamt_put(l, m, object_integer_new(i), object_integer_new(-i));
+    }
+
+    for(int i = 0; i < 5000; i += 2)
+        m = hamt_remove(l, m, object_integer_new(i));
+
+    CU_ASSERT_EQUAL_FATAL(((object_map_t *) m)->count, 2500);
+
+    for(size_t v = 0; v < 5; v++) {
+        CU_ASSERT_EQUAL_FATAL(((object_map_t *) versions[v])->count, v * 1000);
+
+        for(size_t i = 0; i < 5000; i++) {
+            int found;
+            object_t *r =
+                hamt_get(l, versions[v], object_integer_new(i), &found);
+
+            CU_ASSERT_EQUAL_FATAL(found, i < v * 1000);
+
+            if(found)
+                CU_ASSERT_EQUAL_FATAL(((object_integer_t *) r)->number,
+                                      -(int64_t) i);
+
+            hamt_get(l, m, object_integer_new(i), &found);
+            CU_ASSERT_EQUAL_FATAL((size_t) found, i % 2);
+        }
+    }
+}
+
+void test_fun_array() {
+    lisp_t *l = lisp_new();
+
+    ASSERT_PRINT("(MAKE-ARRAY 'INT32 3)", "#<Array INT32 0 0 0>");
+    ASSERT_PRINT("(MAKE-ARRAY 'INT64 '(1 2 3))", "#<Array INT64 1 2 3>");
+
+    teval(l, "(LABEL A (MAKE-ARRAY 'INT32 '(3 1 4 1 5 9 2 6 5)))");
+    teval(l, "(LABEL B (MAKE-ARRAY 'INT32 '(1 1 1 1 1 1 1 1 2)))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ALENGTH A)"), "9");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ASET A 0 7)"), "7");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(AREF A 0)"), "7");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ARRAY-SUM A)"), "40");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ARRAY-MIN A)"), "1");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ARRAY-MAX A)"), "9");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ARRAY-DOT A B)"), "45");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ARRAY-ADD A B)"),
+                                 "#<Array INT32 8 2 5 2 6 10 3 7 7>");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ARRAY-MUL A B)"),
+                                 "#<Array INT32 7 1 4 1 5 9 2 6 10>");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ARRAY-PREFIX-SUM A)"),
+                                 "#<Array INT32 7 8 12 13 18 27 29 35 40>");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ARRAY-MIN (MAKE-ARRAY 'INT64 0))"),
+                                 "NIL");
+
+    teval(l, "(LABEL *ERROR-HANDLER* (LAMBDA (C) C))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(AREF A 9)"),
+                                 "INDEX-OUT-OF-RANGE");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(ASET A 0 9999999999)"),
+                                 "VALUE-OUT-OF-RANGE");
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        tprint(l, "(ARRAY-ADD A (MAKE-ARRAY 'INT32 2))"), "LENGTH-MISMATCH");
+}
+
+/** Every instruction set must agree with the scalar loops, tails included. */
+void test_kernel_ops() {
+    int32_t a32[67], b32[67], r32[67], s32[67];
+    int64_t a64[67], b64[67], r64[67], s64[67];
+
+    for(int i = 0; i < 67; i++) {
+        a32[i] = (i * 2654435761u) ^ (i << 29);
+        b32[i] = 7 - i * 13;
+        a64[i] = (int64_t) a32[i] * 1000003 - ((int64_t) i << 40);
+        b64[i] = -b32[i];
+    }
+
+    for(kernel_isa_t isa = KERNEL_SSE41; isa <= kernel_best(); isa++) {
+        for(size_t n = 1; n <= 67; n++) {
+            kernel_select(KERNEL_SCALAR);
+
+            const kernel_ops_t *s = kernel_ops();
+
+            kernel_select(isa);
+
+            const kernel_ops_t *k = kernel_ops();
+
+            CU_ASSERT_EQUAL_FATAL(k->sum_i32(a32, n), s->sum_i32(a32, n));
+            CU_ASSERT_EQUAL_FATAL(k->min_i32(a32, n), s->min_i32(a32, n));
+            CU_ASSERT_EQUAL_FATAL(k->max_i32(a32, n), s->max_i32(a32, n));
+            CU_ASSERT_EQUAL_FATAL(k->dot_i32(a32, b32, n),
+                                  s->dot_i32(a32, b32, n));
+            CU_ASSERT_EQUAL_FATAL(k->sum_i64(a64, n), s->sum_i64(a64, n));
+            CU_ASSERT_EQUAL_FATAL(k->min_i64(a64, n), s->min_i64(a64, n));
+            CU_ASSERT_EQUAL_FATAL(k->max_i64(a64, n), s->max_i64(a64, n));
+
+            k->mul_i32(r32, a32, b32, n);
+            s->mul_i32(s32, a32, b32, n);
+            CU_ASSERT_FATAL(!memcmp(r32, s32, n * sizeof(int32_t)));
+
+            k->prefix_sum_i32(r32, a32, n);
+            s->prefix_sum_i32(s32, a32, n);
+            CU_ASSERT_FATAL(!memcmp(r32, s32, n * sizeof(int32_t)));
+
+            k->add_i64(r64, a64, b64, n);
+            s->add_i64(s64, a64, b64, n);
+            CU_ASSERT_FATAL(!memcmp(r64, s64, n * sizeof(int64_t)));
+
+            k->prefix_sum_i64(r64, a64, n);
+            s->prefix_sum_i64(s64, a64, n);
+            CU_ASSERT_FATAL(!memcmp(r64, s64, n * sizeof(int64_t)));
+        }
+    }
+
+    kernel_select(kernel_best());
+}
+
+void test_fun_arithmetic() {
+    lisp_t *l = lisp_new();
+
+    ASSERT_PRINT("(+)", "0");
+    ASSERT_PRINT("(+ 1 2 3)", "6");
+    ASSERT_PRINT("(- 5)", "-5");
+    ASSERT_PRINT("(- 10 -1 2)", "9");
+    ASSERT_PRINT("(* 2 3 -4)", "-24");
+    ASSERT_PRINT("(/ 7 2)", "3");
+    ASSERT_PRINT("(/ -7 2)", "-3");
+    ASSERT_PRINT("(MOD -7 2)", "1");
+    ASSERT_PRINT("(MOD 7 -2)", "-1");
+    ASSERT_PRINT("(* 2147483648 4294967295)", "9223372034707292160");
+    ASSERT_PRINT("(< 1 2 3)", "T");
+    ASSERT_PRINT("(< 1 3 2)", "NIL");
+    ASSERT_PRINT("(<= 1 1 2)", "T");
+    ASSERT_PRINT("(>= 3 3 4)", "NIL");
+    ASSERT_PRINT("(= 2 2 2)", "T");
+    ASSERT_PRINT("(> 3 2)", "T");
+
+    teval(l, "(DEFUN FIB (N) "
+          "(COND ((< N 2) N) (T (+ (FIB (- N 1)) (FIB (- N 2))))))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(FIB 15)"), "610");
+
+    teval(l, "(LABEL *ERROR-HANDLER* (LAMBDA (C) C))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(/ 1 0)"), "DIVISION-BY-ZERO");
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        tprint(l, "(* 4294967296 4294967296)"), "ARITHMETIC-OVERFLOW");
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        tprint(l, "(- (- -9223372036854775807 1))"), "ARITHMETIC-OVERFLOW");
+
+    /* builtins taking an argument array can still be applied to a list */
+    object_t *r = lisp_apply(l, teval(l, "+"), teval(l, "'(3 4)"));
+
+    CU_ASSERT_EQUAL_FATAL(((object_integer_t *) r)->number, 7);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(EQ (+ 1 2) 3)"), "T");
+}
+
+void test_fun_compile() {
+    lisp_t *l = lisp_new();
+    char filepath[256], path[256], sexpr[512];
+
+    memset(filepath, 0, sizeof(char) * 256);
+    /* the quote would end the path if it went through a shell */
+    snprintf(filepath, 255, "/tmp/lips_test_compile.'%d.lips", getpid());
+
+    FILE *f = fopen(filepath, "w");
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+    fputs("(DEFUN FIB (N) "
+          "(COND ((< N 2) N) (T (+ (FIB (- N 1)) (FIB (- N 2))))))\n"
+          "(DEFUN LEN (X) (COND ((ATOM X) 0) (T (+ 1 (LEN (CDR X))))))\n"
+          "(DEFUN TWICE (F X) (F (F X)))\n"
+          "(DEFUN SQ (X) (* X X))\n"
+          "(DEFUN POLY (A B) (< (- (* A A) (* 2 B)) (+ A 1)))\n"
+          "(DEFUN TEST (X) (COND ((EQ X 1)) (T 'NO)))\n"
+          "(DEFUN WRAP (X) (CONS (STEP X) '(END)))\n"
+          "(DEFUN EV (X) (EVAL (QUOTE X)))\n"
+          "(DEFUN DEEP (N) (COND ((EQ N 0) 'BOTTOM) (T (DEEP (- N 1)))))\n",
+          f);
+    fclose(f);
+
+    teval(l, "(DEFUN STEP (X) (* X 10))");
+    snprintf(sexpr, 511, "(COMPILE-FILE \"%s\")", filepath);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), "(FIB LEN TWICE SQ POLY TEST WRAP DEEP)");
+    CU_ASSERT_EQUAL_FATAL(teval(l, "FIB")->type, OBJECT_FUNCTION);
+
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(FIB 15)"), "610");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(LEN '(A B C))"), "3");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(TWICE STEP 2)"), "200");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(WRAP 4)"), "(40 END)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(POLY 3 2)"), "NIL");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(POLY 3 3)"), "T");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(TEST 1)"), "NIL");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(TEST 2)"), "NO");
+
+    /* EVAL needs the frame the interpreter binds */
+    CU_ASSERT_EQUAL_FATAL(teval(l, "EV")->type, OBJECT_LAMBDA);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(EV 42)"), "42");
+
+    /* a parameter holding a macro expands the call, as interpreted */
+    teval(l, "(LABEL DOUBLE (MACRO (X) (+ X X)))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(TWICE DOUBLE 3)"), "12");
+
+    /* calls out of the file follow redefinitions */
+    teval(l, "(DEFUN STEP (X) (+ X 1))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(WRAP 4)"), "(5 END)");
+
+    /* and open-coded arithmetic still overflows into an error */
+    teval(l, "(LABEL *ERROR-HANDLER* (LAMBDA (C) C))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(SQ 4294967296)"),
+                                 "ARITHMETIC-OVERFLOW");
+
+    /* direct calls between compiled functions are nested evaluations */
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(DEEP 200000)"), "BOTTOM");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(DEEP 3000000)"),
+                                 "STACK-OVERFLOW");
+
+    /* in intermediate results too, where the handler's value is used on */
+    teval(l, "(LABEL *ERROR-HANDLER* (LAMBDA (C) 0))");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(POLY 4294967296 0)"), "T");
+    teval(l, "(LABEL *ERROR-HANDLER* (LAMBDA (C) C))");
+    CU_ASSERT_STRING_EQUAL_FATAL(
+        tprint(l, "(COMPILE-FILE \"/nonexistent/x.lips\")"), "FILE-ERROR");
+
+    /* compiling again loads new code, the old stays good */
+    teval(l, "(LABEL OLD WRAP)");
+    f = fopen(filepath, "w");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+    fputs("(DEFUN WRAP (X) (CONS X 'NEW))\n", f);
+    fclose(f);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), "(WRAP)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(WRAP 5)"), "(5 . NEW)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(OLD 4)"), "(5 END)");
+
+    f = fopen(filepath, "w");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+    fputs("(DEFUN WRAP (X) X)\n", f);
+    fclose(f);
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, sexpr), "(WRAP)");
+    CU_ASSERT_STRING_EQUAL_FATAL(tprint(l, "(OLD 4)"), "(5 END)");
+
+    remove(filepath);
+    strcpy(path, filepath);
+    strcpy(strrchr(path, '.'), ".c");
+    remove(path);
+}
+
 int setup_fun_suite() {
     MAKE_SUITE("Lisp functional tests");
 
     ADD_TEST(test_fun_defun, "DEFUN");
     ADD_TEST(test_fun_assoc, "ASSOC");
+    ADD_TEST(test_fun_assoc_index, "ASSOC on long lists");
     ADD_TEST(test_fun_pair, "PAIR");
     ADD_TEST(test_fun_error, "ERROR");
     ADD_TEST(test_fun_format, "FORMAT");
     ADD_TEST(test_fun_error_unbound, "ERROR - unbound");
+    ADD_TEST(test_fun_load_data, "LOAD-DATA");
+    ADD_TEST(test_fun_hcons, "hash-consing");
+    ADD_TEST(test_fun_lazy, "lazy sequences");
+    ADD_TEST(test_fun_transduce, "MAPCAR, FILTER, REDUCE, TRANSDUCE");
+    ADD_TEST(test_fun_vector, "MAKE-VECTOR, VREF, VSET, VLENGTH");
+    ADD_TEST(test_fun_hash_table, "hash tables");
+    ADD_TEST(test_fun_defstruct, "DEFSTRUCT");
+    ADD_TEST(test_fun_map, "persistent maps");
+    ADD_TEST(test_fun_array, "typed arrays");
+    ADD_TEST(test_kernel_ops, "array kernels");
+    ADD_TEST(test_fun_arithmetic, "arithmetic");
+    ADD_TEST(test_fun_compile, "COMPILE-FILE");
 
     return 0;
 }
@@ -0,0 +1,118 @@
+#include <string.h>
+
+#include "transduce.h"
+#include "lisp_eval.h"
+#include "lazy.h"
+#include "builtin.h"
+#include "logger.h"
+
+/* A transducer is a flat array of MAP and FILTER stages. Composing
+ * transducers concatenates their stages, and running one takes every input
+ * element through all stages before looking at the next, so a pipeline of
+ * any length makes one pass and builds no list between its stages. */
+
+/** A transducer of a single stage. */
+object_t *transducer(transducer_op_t op, object_t * fn) {
+    object_transducer_t *xf =
+        (object_transducer_t *) object_transducer_new(1);
+
+    xf->stages[0].op = op;
+    xf->stages[0].fn = fn;
+
+    return (object_t *) xf;
+}
+
+/** Compose a list of transducers, the first one sees the input first. */
+object_t *transducer_comp(object_t * xfs) {
+    size_t len = 0;
+
+    for(object_t * o = xfs; o != NULL; o = cdr(o)) {
+        if(!object_isa(car(o), OBJECT_TRANSDUCER))
+            PANIC("transducer_comp: not a transducer!");
+
+        len += ((object_transducer_t *) car(o))->len;
+    }
+
+    object_transducer_t *r =
+        (object_transducer_t *) object_transducer_new(len);
+    size_t i = 0;
+
+    for(object_t * o = xfs; o != NULL; o = cdr(o)) {
+        object_transducer_t *xf = (object_transducer_t *) car(o);
+
+        memcpy(r->stages + i, xf->stages,
+               xf->len * sizeof(transducer_stage_t));
+        i += xf->len;
+    }
+
+    return (object_t *) r;
+}
+
+/* Take *x through the stages, returns 0 if one of them drops it. */
+static int transducer_step(lisp_t * l, object_transducer_t * xf,
+                           object_t ** x) {
+    for(size_t i = 0; i < xf->len; i++) {
+        transducer_stage_t *s = &xf->stages[i];
+
+        switch (s->op) {
+        case TRANSDUCER_MAP:
+            *x = lisp_call(l, s->fn, 1, x);
+            break;
+        case TRANSDUCER_FILTER:
+            if(lisp_call(l, s->fn, 1, x) == NULL)
+                return 0;
+
+            break;
+        }
+    }
+
+    return 1;
+}
+
+static object_transducer_t *transducer_arg(object_t * xf) {
+    if(!object_isa(xf, OBJECT_TRANSDUCER))
+        PANIC("transduce: not a transducer!");
+
+    return (object_transducer_t *) xf;
+}
+
+/** Fold fn over the elements of seq (a list or lazy sequence) as they come
+ *  out of xf, starting from acc. */
+object_t *transduce(lisp_t * l, object_t * xf, object_t * fn, object_t * acc,
+                    object_t * seq) {
+    object_transducer_t *t = transducer_arg(xf);
+    object_t *x;
+
+    seq = lazy_seq(l, seq);
+
+    while(lazy_next(l, seq, &x)) {
+        if(!transducer_step(l, t, &x))
+            continue;
+
+        object_t *argv[2] = { acc, x };
+
+        acc = lisp_call(l, fn, 2, argv);
+    }
+
+    return acc;
+}
+
+/** Collect the elements of seq that come out of xf into a list. */
+object_t *transduce_list(lisp_t * l, object_t * xf, object_t * seq) {
+    object_transducer_t *t = transducer_arg(xf);
+    object_t *list = NULL, *tail = NULL, *x;
+
+    seq = lazy_seq(l, seq);
+
+    while(lazy_next(l, seq, &x)) {
+        if(!transducer_step(l, t, &x))
+            continue;
+
+        if(list == NULL)
+            list = tail = cons(x, NULL);
+        else
+            tail = ((object_cons_t *) tail)->cdr = cons(x, NULL);
+    }
+
+    return list;
+}
@@ -0,0 +1,13 @@
+#ifndef __TRANSDUCE_H
+#define __TRANSDUCE_H
+
+#include "lisp.h"
+#include "object.h"
+
+object_t *transducer(transducer_op_t, object_t *);
+object_t *transducer_comp(object_t *);
+
+object_t *transduce(lisp_t *, object_t *, object_t *, object_t *, object_t *);
+object_t *transduce_list(lisp_t *, object_t *, object_t *);
+
+#endif